@@ -0,0 +1,201 @@
+/* vk_culling.h
+ *
+ * Frustum culls render objects on the GPU and turns the survivors into indirect draws.
+ * Every object is an instance in persistent device buffers: its bounding sphere and draw arguments, and its world
+ * matrix, which the vertex shader also reads. Each frame only the instances which changed since the previous frame
+ * are staged and copied in; matrices are only compared when their transform version differs. Instances are grouped
+ * into batches, runs of draws sharing a material, which own a region of the command buffer sized for all their
+ * instances. The culling pass appends every visible instance to its batch's region, counting them atomically, and each
+ * batch is then drawn with one vkCmdDrawIndexedIndirectCount call.
+ * The visible totals are copied to host memory and read back once the frame has finished, one frame late.
+ *
+ * With occlusion culling, culling runs in two phases around a depth pyramid built from the first. A visibility flag is
+ * kept per instance across frames. The early phase emits the instances which were visible last frame and are still
+ * in the frustum; once they are drawn and the pyramid is built from their depth, the late phase tests every instance
+ * in the frustum against the pyramid, emits those which are visible but were not drawn early, and updates the flags.
+ * Each phase has its own command region and draw counts, so the early draws are not disturbed by the late phase.
+ *
+ */
+#pragma once
+
+#include "vk_timeline.h"
+#include "vk_types.h"
+#include <span>
+#include <vector>
+
+struct RenderObject;
+
+// A render object as cull.comp sees it. The world matrix is the GPUDrawData at the same index.
+struct GPUCullInstance
+{
+    glm::vec4 sphere; // Object-space bounding sphere: center and radius.
+    uint32_t first_index;
+    uint32_t index_count;
+    int32_t vertex_offset;
+    uint32_t batch;       // Index of the batch's draw count.
+    uint32_t batch_first; // First command of the batch's region.
+    uint32_t padding[3];
+};
+
+// The camera as cull.comp sees it.
+struct GPUCullView
+{
+    glm::vec4 planes[6]; // World-space frustum planes, pointing inwards.
+    glm::mat4 view;
+    glm::vec4 projection; // P00, P11, P22 and P32 of the projection matrix.
+    glm::vec2 pyramid_size;
+    float znear;
+    uint32_t occlusion; // Nonzero if the late phase follows.
+};
+
+// Push constants of cull.comp.
+struct GPUCullPushConstants
+{
+    VkDeviceAddress instances;
+    VkDeviceAddress draw_data;
+    VkDeviceAddress commands;     // The phase's command region.
+    VkDeviceAddress counts;       // Totals of both phases.
+    VkDeviceAddress batch_counts; // The phase's draw counts.
+    VkDeviceAddress view;
+    VkDeviceAddress visibility;
+    uint32_t instance_count;
+    uint32_t phase;
+};
+
+// Which part of a two-phase pass a cull or draw belongs to.
+enum class CullPhase : uint32_t
+{
+    Early = 0, // Also the only phase without occlusion culling.
+    Late  = 1,
+};
+
+// What a culling pass tests against.
+struct CullView
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    float znear;                     // Distance to the near plane.
+    bool occlusion{false};           // Whether cull_late() follows.
+    VkExtent2D pyramid_extent{0, 0}; // Size of the pyramid's mip 0, which spans the viewport.
+};
+
+// A run of instances sharing a material. Their commands are written to [first, first + count) in cull order.
+struct CullBatch
+{
+    uint32_t first;
+    uint32_t count;
+};
+
+// Totals of a finished culling pass.
+struct CullStats
+{
+    uint32_t instances{0};
+    uint32_t visible{0};
+    uint32_t visible_triangles{0};
+    uint32_t occluded{0}; // Instances in the frustum which failed the occlusion test.
+};
+
+class GpuCuller
+{
+  public:
+    // Creates the culling pipeline, whose set 0 is pyramid_layout. Buffers replaced when the instance count grows are
+    // released through deletion_queue once the graphics queue has finished with them.
+    void init(VkDevice device,
+              VmaAllocator allocator,
+              DeviceTimeline& timeline,
+              TimelineDeletionQueue& deletion_queue,
+              VkDescriptorSetLayout pyramid_layout,
+              uint32_t frame_count);
+    // Must only be called once the device is idle.
+    void destroy();
+
+    // Records the copies of the instances of draws which changed since the last call, then the early culling
+    // dispatch, and the readback of its totals unless view.occlusion is set. frame_index selects the staging and
+    // readback buffers, which must no longer be in use. pyramid_set is only sampled by the late phase. Must be
+    // recorded outside of rendering, before the draws.
+    void cull(VkCommandBuffer cmd,
+              std::span<const RenderObject* const> draws,
+              const CullView& view,
+              VkDescriptorSet pyramid_set,
+              uint32_t frame_index);
+    // Records the late culling dispatch of the pass cull() recorded with view.occlusion set, and the readback of the
+    // totals of both phases. The pyramid must have been built from the depth of the early draws.
+    void cull_late(VkCommandBuffer cmd, uint32_t frame_index);
+
+    // Returns the totals of the pass recorded with frame_index since the last call, or zeroes if there was none.
+    // Must only be called once the frame which recorded it has finished.
+    CullStats collect(uint32_t frame_index);
+
+    // Rebuilds the batches from draws and updates the host copies of the instances, appending the indices of those
+    // which differ from what the device buffers hold to changed. cull() stages exactly those. Records nothing, so it
+    // also works without init(), as in the culling benchmark's checks.
+    void find_changed_instances(std::span<const RenderObject* const> draws, std::vector<uint32_t>& changed);
+
+    // Batches of the last cull(), and the batch of each of its draws.
+    const std::vector<CullBatch>& batches() const { return _batches; }
+    const std::vector<uint32_t>& draw_batches() const { return _draw_batches; }
+
+    VkBuffer command_buffer() const { return _commands.buffer; }
+    VkBuffer count_buffer() const { return _counts.buffer; }
+    VkDeviceAddress draw_data_address() const { return _draw_data_address; }
+
+    // Offset of a phase's command region in command_buffer(). A batch's commands start at its first draw within it.
+    VkDeviceSize commands_offset(CullPhase phase) const;
+    // Offset of the draw count of a phase's first batch in count_buffer(). The other batches' counts follow.
+    VkDeviceSize counts_offset(CullPhase phase) const;
+
+  private:
+    // Host-visible buffers of one frame in flight.
+    struct FrameResources
+    {
+        AllocatedBuffer staging; // The GPUCullView followed by the changed instances, grown as needed.
+        VkDeviceAddress staging_address{0};
+        AllocatedBuffer readback;
+        uint32_t readback_instances{0}; // Instance count of the pass the readback belongs to; 0 if none.
+    };
+
+    // Recreates the device buffers with room for at least instance_count instances. Every instance is copied again.
+    void grow(uint32_t instance_count);
+    // Fills _instances and _draw_data from draws and records copies of the entries which differ from last frame's.
+    void update_instances(VkCommandBuffer cmd, std::span<const RenderObject* const> draws, FrameResources& frame);
+    // Records one phase's culling dispatch over the instances of the last cull().
+    void dispatch(VkCommandBuffer cmd, FrameResources& frame, CullPhase phase);
+    // Records the copy of the totals into the frame's readback buffer.
+    void read_back(VkCommandBuffer cmd, FrameResources& frame);
+    // Returns a pointer to the frame's staging memory, growing the buffer to at least size bytes.
+    uint8_t* staging_memory(FrameResources& frame, VkDeviceSize size);
+
+    VkDevice _device{VK_NULL_HANDLE};
+    VmaAllocator _allocator{VK_NULL_HANDLE};
+    DeviceTimeline* _timeline{nullptr};
+    TimelineDeletionQueue* _deletion_queue{nullptr};
+
+    VkPipelineLayout _layout{VK_NULL_HANDLE};
+    VkPipeline _pipeline{VK_NULL_HANDLE};
+
+    // Device buffers, sized for _capacity instances in each phase.
+    uint32_t _capacity{0};
+    AllocatedBuffer _instance_buffer;
+    AllocatedBuffer _draw_data_buffer;
+    AllocatedBuffer _commands;   // The early region, then the late one.
+    AllocatedBuffer _counts;     // The totals, then the draw counts of each batch in the early and in the late phase.
+    AllocatedBuffer _visibility; // Nonzero for the instances drawn last frame; kept across frames.
+    VkDeviceAddress _instance_address{0};
+    VkDeviceAddress _draw_data_address{0};
+    VkDeviceAddress _commands_address{0};
+    VkDeviceAddress _counts_address{0};
+    VkDeviceAddress _visibility_address{0};
+
+    uint32_t _instance_count{0};                  // Instances of the last cull().
+    VkDescriptorSet _pyramid_set{VK_NULL_HANDLE}; // Pyramid of the last cull().
+
+    // What the device buffers hold, compared against each frame to find the changed instances.
+    std::vector<GPUCullInstance> _instances;
+    std::vector<GPUDrawData> _draw_data;
+    std::vector<uint64_t> _draw_versions; // RenderObject::transform_version of each entry of _draw_data.
+
+    std::vector<CullBatch> _batches;
+    std::vector<uint32_t> _draw_batches;
+
+    std::vector<FrameResources> _frames;
+};
@@ -0,0 +1,69 @@
+/* vk_depth_pyramid.h
+ *
+ * Builds a hierarchical depth buffer (Hi-Z) for occlusion culling.
+ * Each mip of the pyramid holds the farthest depth of the 2x2 texels below it, so a single sample of the mip at which
+ * a screen rectangle spans about two texels bounds the depth of everything drawn within it. Depth is reversed (1 is
+ * near), making the farthest depth the smallest, and the reduction is done by a min-filtering sampler.
+ * Mip 0 has the power-of-two size just below the depth image and covers only the frame's draw extent, so the pyramid
+ * maps to the drawn region at any render scale.
+ *
+ */
+#pragma once
+
+#include "vk_descriptors.h"
+#include "vk_types.h"
+#include <vector>
+
+class DepthPyramid
+{
+  public:
+    // Creates the reduction pipeline, the min-filtering sampler and the descriptor layouts.
+    void init(VkDevice device, VmaAllocator allocator);
+    // Must only be called once the device is idle. Also destroys the targets.
+    void destroy();
+
+    // Creates the pyramid for a depth image of the given extent, which mip 0 is reduced from.
+    void create_targets(VkImageView depth_view, VkExtent2D depth_extent);
+    // Destroys the pyramid. The GPU must not be using it.
+    void destroy_targets();
+
+    // Reduces the draw_extent region of the depth image into every mip. The depth image must be in
+    // VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, and its writes visible to compute shaders. Afterwards the pyramid may
+    // be sampled by compute and fragment shaders in VK_IMAGE_LAYOUT_GENERAL.
+    void build(VkCommandBuffer cmd, VkExtent2D draw_extent);
+
+    // Binding 0 samples the whole pyramid through the min-filtering sampler.
+    VkDescriptorSetLayout read_layout() const { return _read_layout; }
+    VkDescriptorSet read_set() const { return _read_set; }
+
+    VkExtent2D extent() const { return _extent; }
+    uint32_t mip_count() const { return (uint32_t)_mip_views.size(); }
+    // True once build() has been recorded since the targets were created.
+    bool built() const { return _built; }
+
+    // A greyscale view of one mip, for debug displays.
+    VkImageView debug_view(uint32_t mip) const { return _debug_views[mip]; }
+
+  private:
+    VkDevice _device{VK_NULL_HANDLE};
+    VmaAllocator _allocator{VK_NULL_HANDLE};
+
+    VkSampler _min_sampler{VK_NULL_HANDLE};
+
+    VkDescriptorSetLayout _reduce_layout{VK_NULL_HANDLE}; // Source sampler and destination storage image.
+    VkDescriptorSetLayout _read_layout{VK_NULL_HANDLE};
+    VkPipelineLayout _pipeline_layout{VK_NULL_HANDLE};
+    VkPipeline _pipeline{VK_NULL_HANDLE};
+
+    DescriptorAllocatorGrowable _descriptor_allocator;
+
+    // Targets.
+    AllocatedImage _image{};
+    VkExtent2D _extent{0, 0};
+    VkExtent2D _depth_extent{0, 0};
+    std::vector<VkImageView> _mip_views;
+    std::vector<VkImageView> _debug_views;
+    std::vector<VkDescriptorSet> _reduce_sets; // Reduction into each mip.
+    VkDescriptorSet _read_set{VK_NULL_HANDLE};
+    bool _built{false};
+};
@@ -76,7 +76,11 @@ struct DescriptorAllocatorGrowable
         float ratio;
     };
     // Allocates the first descriptor pool and adds it to the allocator's ready_pools array.
-    void init(VkDevice device, uint32_t max_sets, std::span<PoolSizeRatio> pool_ratios);
+    // The flags are applied to every pool (e.g. VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT).
+    void init(VkDevice device,
+              uint32_t max_sets,
+              std::span<PoolSizeRatio> pool_ratios,
+              VkDescriptorPoolCreateFlags flags = 0);
     // Resets all descriptor pools and places them in the ready_pools list.
     void clear_pools(VkDevice device);
     // Destroys all descriptor pools.
@@ -97,4 +101,5 @@ struct DescriptorAllocatorGrowable
     // List of new and/or usable pools.
     std::vector<VkDescriptorPool> ready_pools;
     uint32_t sets_per_pool;
+    VkDescriptorPoolCreateFlags pool_flags{0};
 };
\ No newline at end of file
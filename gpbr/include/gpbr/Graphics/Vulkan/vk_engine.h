@@ -11,10 +11,25 @@
 #include "vma/vk_mem_alloc.h"
 #include <deque>
 #include <functional>
+#include <stdexcept>
+#include <cstring>
+#include <mutex>
+#include <thread>
 #include "vk_descriptors.h"
 #include "vk_loader.h"
+#include "vk_profiler.h"
+#include "vk_culling.h"
+#include "vk_depth_pyramid.h"
+#include "vk_geometry.h"
+#include "vk_timeline.h"
+#include "vk_upload.h"
 #include "../camera.h"
+#include "../dynamic_resolution.h"
+#include "../frustum_culling.h"
 #include "../light.h"
+#include "../../Util/benchmark.h"
+#include "../../Util/job_system.h"
+#include "../../Util/triple_buffer.h"
 
 // Implements a queue to store destructor functions.
 struct DeletionQueue
@@ -35,20 +50,123 @@ struct DeletionQueue
     }
 };
 
+// A sub-allocation of a TransientRing.
+struct TransientAllocation
+{
+    void* data;      // Mapped pointer to the start of the allocation.
+    uint32_t offset; // Offset from the start of the ring's buffer; usable as a dynamic offset.
+};
+
+// A persistently mapped linear allocator for data which only lives for one frame (e.g. uniforms).
+// Allocating is a pointer bump; the whole ring is released at once when its frame's timeline point has been reached.
+// Frames share one buffer and each owns the region [begin, end), so a single descriptor can address all of them.
+struct TransientRing
+{
+    AllocatedBuffer buffer;
+    VkDeviceSize begin{0};
+    VkDeviceSize end{0};
+    VkDeviceSize alignment{256}; // Satisfies the device's uniform and storage buffer offset alignments.
+    VkDeviceSize head{0};
+
+    // Returns an aligned block of the given size. Throws if the ring is full.
+    TransientAllocation allocate(VkDeviceSize size)
+    {
+        VkDeviceSize offset = (head + alignment - 1) & ~(alignment - 1);
+
+        if (offset + size > end)
+        {
+            throw std::runtime_error("Transient ring is full!\n");
+        }
+
+        head = offset + size;
+        return {(uint8_t*)buffer.info.pMappedData + offset, (uint32_t)offset};
+    }
+
+    // Copies a value into the ring and returns its offset.
+    template <typename T> uint32_t push(const T& value)
+    {
+        TransientAllocation allocation = allocate(sizeof(T));
+        memcpy(allocation.data, &value, sizeof(T));
+        return allocation.offset;
+    }
+
+    // Releases every allocation.
+    void reset() { head = begin; }
+};
+
+// Indirect commands followed by per-draw data, for the indirect draws built on the CPU. Persistent and grown to the
+// largest frame seen, as their size follows the scene rather than a fixed budget.
+struct IndirectDrawStorage
+{
+    AllocatedBuffer buffer{};
+    VkDeviceAddress address{0};
+    uint32_t capacity{0};     // Draws the buffer holds.
+    uint32_t used{0};         // Draws handed out during the current frame.
+    uint32_t failed_count{0}; // Largest draw count the buffer could not grow to, so it is not retried every frame.
+
+    // Byte offset of the first draw's data, after the commands of every draw.
+    VkDeviceSize draw_data_offset() const
+    {
+        return ((VkDeviceSize)capacity * sizeof(VkDrawIndexedIndirectCommand) + 255) & ~(VkDeviceSize)255;
+    }
+};
+
+// Secondary command buffers recorded by a single thread.
+struct RecordingContext
+{
+    VkCommandPool pool;
+    std::vector<VkCommandBuffer> buffers;
+    uint32_t used{0}; // Buffers handed out since the pool was last reset.
+};
+
 // A group of data structures required to draw a frame.
 struct FrameData
 {
+    // Binary, as swapchain acquire and present only accept binary semaphores.
     VkSemaphore _swapchain_semaphore, _render_semaphore;
-    VkFence _render_fence;
+    // Graphics timeline point signalled once the frame's commands have finished executing.
+    TimelinePoint _submitted;
 
     VkCommandPool _command_pool;
     VkCommandBuffer _main_command_buffer;
 
-    DeletionQueue _deletion_queue;
     DescriptorAllocatorGrowable _frame_descriptors;
+
+    // Per-frame constants (scene and light data) and other transient buffers.
+    TransientRing _transient_ring;
+    // Indirect draws recorded by the geometry passes, with --indirect.
+    IndirectDrawStorage _indirect_storage;
+
+    // One context per thread of the engine's job system, indexed by thread index.
+    std::vector<RecordingContext> _recording_contexts;
+
+    // Times the passes recorded into this frame's command buffer.
+    GpuProfiler _gpu_profiler;
+
+    // Async compute only. The background effect is rendered into _background_image on the compute queue and copied
+    // into the draw image by the graphics queue.
+    VkCommandPool _compute_command_pool{VK_NULL_HANDLE};
+    VkCommandBuffer _compute_command_buffer{VK_NULL_HANDLE};
+    GpuProfiler _compute_profiler;
+    AllocatedImage _background_image;
+    VkDescriptorSet _background_descriptors{VK_NULL_HANDLE};
+
+    // Headless mode only. Receives the tonemapped image once the frame has finished rendering.
+    AllocatedBuffer _readback_buffer;
+    bool _readback_pending{false};
+    int _readback_frame_number{0};
+    VkExtent2D _readback_extent{0, 0};
 };
 
-constexpr unsigned int FRAME_OVERLAP = 2;
+constexpr unsigned int FRAME_OVERLAP     = 2;
+constexpr VkDeviceSize TRANSIENT_RING_SIZE = 256 * 1024;       // Bytes of transient data per frame in flight.
+constexpr uint32_t MAX_BINDLESS_TEXTURES   = 4048;             // Size of the bindless texture array.
+constexpr size_t MIN_DRAWS_PER_CHUNK       = 64;               // Smallest batch worth a secondary command buffer.
+constexpr VkDeviceSize STAGING_RING_SIZE   = 64 * 1024 * 1024; // Bytes of staging memory for uploads in flight.
+constexpr uint32_t GEOMETRY_VERTICES       = 64 * 1024;        // Initial vertex capacity of the geometry arena.
+constexpr uint32_t GEOMETRY_INDICES        = 256 * 1024;       // Initial index capacity of the geometry arena.
+constexpr uint32_t CULL_BATCH_SIZE         = 256;              // Render objects per culling job.
+constexpr float MAX_RENDER_SCALE           = 1.f;              // Largest _render_scale the render targets allow.
 
 // Uniform data to be used in compute shaders.
 struct ComputePushConstants
@@ -59,6 +177,32 @@ struct ComputePushConstants
     glm::vec4 data4;
 };
 
+// Uniform data for the tonemapping compute shader.
+struct TonemapPushConstants
+{
+    float exposure;
+    uint32_t mode; // 0 = clamp, 1 = Reinhard, 2 = ACES (fitted)
+    float padding[2];
+};
+
+// Operators supported by tonemap.comp.
+enum class TonemapMode : uint32_t
+{
+    Clamp,
+    Reinhard,
+    ACES
+};
+
+// A tonemapped frame read back from the GPU in headless mode.
+// Pixels are tightly packed RGBA8 and only valid for the duration of the callback.
+struct HeadlessFrame
+{
+    int frame_number;
+    uint32_t width;
+    uint32_t height;
+    std::span<const uint8_t> pixels;
+};
+
 // Describes a compute shader pipeline.
 struct ComputeEffect
 {
@@ -116,22 +260,115 @@ struct GLTFMetallic_Roughness
 // Contains necessary data structures for a single vkCmdDrawIndexed call.
 struct RenderObject
 {
+    // Ranges within the engine's geometry arena.
     uint32_t index_count;
     uint32_t first_index;
-    VkBuffer index_buffer;
+    int32_t vertex_offset;
 
     MaterialInstance* material;
     Bounds bounds;
+    WorldBounds world_bounds; // bounds under transform.
     glm::mat4 transform;
-    VkDeviceAddress vertex_buffer_address;
+    uint64_t transform_version; // Equal non-zero versions stand for equal transforms; 0 if unknown.
 };
 
+// Culls an object by the perspective-divided corners of its bounding box. Deprecated: slow, and it culls objects close
+// to the camera too early. Kept as the baseline of the culling benchmark.
+bool in_frustum(const RenderObject& obj, const glm::mat4& viewproj, const Camera& camera);
+
 // Contains lists of RenderObjects to be drawn.
 struct DrawContext
 {
     std::vector<RenderObject> opaque_surfaces;
     std::vector<RenderObject> transparent_surfaces;
     std::vector<RenderObject> mask_surfaces;
+
+    // Appends object to the list of its material's pass.
+    void add(const RenderObject& object);
+};
+
+// Render objects owned elsewhere, by pass.
+struct DrawRefs
+{
+    std::vector<const RenderObject*> opaque_surfaces;
+    std::vector<const RenderObject*> transparent_surfaces;
+    std::vector<const RenderObject*> mask_surfaces;
+
+    // Appends object to the list of its material's pass.
+    void add(const RenderObject& object);
+    void clear();
+};
+
+// Render objects of every surface of a scene, by surface index, kept from tick to tick. Rebuilt when the scene's
+// structure changes, and patched when its nodes move. Belongs to the thread which edits the scene (see LoadedGLTF).
+struct SceneObjects
+{
+    std::vector<RenderObject> objects;
+    uint64_t version{0}; // structure_version of the scene objects was built from.
+    DrawRefs refs;       // All of objects.
+
+    // Updates the transforms of the nodes of scene which moved, then rebuilds objects if the structure of scene
+    // changed, otherwise patches the surfaces which moved.
+    void update(LoadedGLTF& scene);
+    void clear();
+};
+
+// Everything the renderer needs from one game-thread tick. Never modified once published.
+struct SceneSnapshot
+{
+    DrawContext draw_context;      // Opaque surfaces are sorted, and culled unless gpu_culling is set.
+    bool gpu_culling{false};       // Opaque and mask surfaces are left for the GPU to cull.
+    bool occlusion_culling{false}; // The GPU also culls them against the depth pyramid; requires gpu_culling.
+    GPUSceneData scene_data;
+    GPULightData light_data;
+    Camera camera;
+
+    uint64_t tick{0}; // Number of the tick which produced the snapshot, starting at 1.
+    float scene_update_time{0.f};
+};
+
+// The buffers of a frame's indirect draws, with one entry per draw.
+// Either the CPU writes the commands and draw data into the transient ring while recording, or the culling pass has
+// written them, in which case commands and draw_data are null and count_buffer holds each batch's draw count.
+struct IndirectDrawBuffers
+{
+    VkDrawIndexedIndirectCommand* commands;
+    GPUDrawData* draw_data;
+    VkBuffer command_buffer;
+    VkDeviceSize commands_offset;      // Offset of the first draw's command in command_buffer.
+    VkDeviceAddress draw_data_address; // Device address of the first draw's data.
+
+    // GPU culling only.
+    VkBuffer count_buffer{VK_NULL_HANDLE};
+    VkDeviceSize counts_offset{0}; // Offset of the first batch's draw count in count_buffer.
+    const CullBatch* batches{nullptr};
+    const uint32_t* draw_batches{nullptr}; // Batch of each draw.
+};
+
+// Counters accumulated while recording draws.
+struct DrawCounts
+{
+    uint32_t draws{0};
+    uint32_t api_calls{0};
+    uint32_t triangles{0};
+};
+
+// The part of the scene one rendering pass draws. With occlusion culling the geometry is drawn in two passes: the
+// early one draws the GPU-culled surfaces visible last frame, the late one those the depth pyramid built in between
+// reveals, followed by the transparent surfaces.
+enum class GeometryPass
+{
+    All,
+    Early,
+    Late,
+};
+
+// Orders opaque draws by material, then by mesh, to minimise state changes.
+struct DrawSortKey
+{
+    uintptr_t material;
+    uintptr_t mesh;
+    uint32_t draw; // Index into the list of visible draws.
 };
 
 // Contains statistics related to engine performance.
@@ -139,17 +376,44 @@ struct EngineStats
 {
     float frame_time;
     int triangle_count;
-    int drawcall_count;
+    int drawcall_count; // Objects drawn; with indirect draws, many of them share one API call.
+    int draw_api_calls; // vkCmdDrawIndexed and vkCmdDrawIndexed*Indirect* calls recorded.
     float scene_update_time;
     float mesh_draw_time;
+    float gpu_frame_time; // Measured with timestamp queries; lags FRAME_OVERLAP frames behind.
+
+    std::vector<GpuScopeTiming> gpu_scopes; // Per-pass GPU times of the same frame as gpu_frame_time.
+
+    // GPU culling only. Totals of the culling pass of the last finished frame; included in the counts above.
+    CullStats gpu_cull;
+
+    // Async compute only. GPU time of the frame's compute queue work, and the part of it which ran while the graphics
+    // queue was busy with this or the previous frame.
+    float gpu_compute_time;
+    float gpu_compute_overlap_time;
+
+    std::vector<util::WorkerStats> job_workers; // Job system utilization over the last frame; index 0 is main.
 };
 
 // A drawable node containing mesh data.
 struct MeshNode : public Node
 {
     std::shared_ptr<MeshAsset> mesh;
+    std::vector<WorldBounds> surface_bounds; // World-space bounds of each surface, under world_transform.
+    uint32_t first_surface{0};               // Index of the first surface in LoadedGLTF::surfaces.
+
+    // Also updates the world-space bounds of the surfaces.
+    virtual void refresh_transform(const glm::mat4& parent_matrix) override;
+    // Recomputes the world-space bounds of the surfaces from world_transform.
+    void update_bounds();
     // Appends render objects to the draw context.
     virtual void draw(const glm::mat4& top_matrix, DrawContext& ctx) override;
+    // Returns the render object of one surface under transform, whose bounds are bounds. See
+    // RenderObject::transform_version for version.
+    RenderObject render_object(uint32_t surface,
+                               const glm::mat4& transform,
+                               uint64_t version,
+                               const WorldBounds& bounds) const;
 };
 
 // The index of a given texture.
@@ -164,6 +428,8 @@ struct TextureCache
     // List of descriptor image information.
     std::vector<VkDescriptorImageInfo> cache;
     std::unordered_map<std::string, TextureID> name_map;
+    // Indices added since the bindless descriptor set was last updated.
+    std::vector<uint32_t> pending;
     // Creates a descriptor texture and returns a corresponding ID.
     TextureID add_texture(const VkImageView& image_view, VkSampler sampler, const std::string& name);
     // Returns the ID of a texture if it exists.
@@ -183,7 +449,40 @@ class VulkanEngine
 
     struct SDL_Window* _window{nullptr};
     std::string _window_title{"GPBR"};
-    VkExtent2D _window_extent{1700, 900};
+    VkExtent2D _window_extent{1700, 900}; // Also used as the output resolution in headless mode.
+
+    // Headless mode renders offscreen without SDL, a surface, or a swapchain.
+    // Must be configured before init() is called.
+
+    bool _headless{false};
+    std::string _headless_output_dir{}; // Frames are written here as PNG files when non-empty.
+    std::function<void(const HeadlessFrame&)> _headless_frame_callback{};
+    TonemapMode _tonemap_mode{TonemapMode::Clamp};
+    float _tonemap_exposure{1.f};
+
+    // Job system. Culling, sort keys and asset decoding are spread across its threads. Geometry is split into
+    // chunks recorded into secondary command buffers when _record_threads is greater than 1.
+
+    uint32_t _worker_count{0}; // Worker threads created by init(); 0 uses hardware_concurrency() - 1.
+    int _record_threads{1};    // Threads recording geometry, clamped to the job system's thread count.
+    std::unique_ptr<util::JobSystem> _job_system;
+
+    // Async compute. The background effect of a frame is dispatched on the compute queue, where it overlaps the
+    // graphics work of the previous frame. Falls back to the graphics queue when the device has no separate compute
+    // family. Must be configured before init() is called.
+    bool _async_compute{false};
+
+    // Multi-draw indirect. Each run of draws sharing a material is recorded as one vkCmdDrawIndexedIndirect call,
+    // with the commands and per-draw data written to the transient ring, instead of one push and draw per object.
+    bool _indirect_draws{false};
+
+    // GPU culling. Opaque and masked surfaces skip CPU culling and are culled against the frustum by a compute pass,
+    // which writes the indirect draws of the survivors. Read by the game thread, so it may be changed at any time.
+    std::atomic<bool> _gpu_culling{false};
+
+    // Occlusion culling. With GPU culling, surfaces hidden behind the depth of those drawn last frame are culled too,
+    // in two phases around a depth pyramid. Read by the game thread, so it may be changed at any time.
+    std::atomic<bool> _occlusion_culling{false};
 
     static VulkanEngine& get();
 
@@ -194,6 +493,15 @@ class VulkanEngine
     VkSurfaceKHR _surface;                     // Main window surface.
     VkQueue _graphics_queue;                   // Main queue used to submit work.
     uint32_t _graphics_queue_family;           // Describes a set of queues with common properties.
+    std::string _gpu_name;                     // Name of the selected physical device.
+    float _timestamp_period{1.f};              // Nanoseconds per timestamp tick.
+    uint32_t _timestamp_valid_bits{0};         // Valid timestamp bits on the graphics queue.
+    VkQueue _compute_queue;                    // Async compute queue; the graphics queue if there is no other.
+    uint32_t _compute_queue_family;            // Equal to _graphics_queue_family when sharing the graphics queue.
+    uint32_t _compute_timestamp_valid_bits{0}; // Valid timestamp bits on the compute queue.
+    VkQueue _transfer_queue;                   // Upload queue; the graphics queue if there is no other.
+    uint32_t _transfer_queue_family;           // Equal to _graphics_queue_family when sharing the graphics queue.
+    VkDeviceSize _min_buffer_alignment{256};   // Largest of the uniform and storage buffer offset alignments.
 
     // Maximum number of samples supported by the current GPU.
     VkSampleCountFlagBits _msaa_samples{VK_SAMPLE_COUNT_1_BIT};
@@ -211,12 +519,26 @@ class VulkanEngine
 
     VkExtent2D _draw_extent;
     // Allows for dynamic resolution scaling.
-    // Do not exeed 1.0f.
+    // Must not exceed MAX_RENDER_SCALE.
     float _render_scale{1.0f};
 
+    // Drives _render_scale from the measured GPU frame time when enabled. Never reallocates the draw image.
+    bool _dynamic_resolution_enabled{false};
+    DynamicResolution _dynamic_resolution;
+
     // Allocates memory for all descriptors.
     DescriptorAllocatorGrowable global_descriptor_allocator;
 
+    // Update-after-bind pool holding the bindless texture set.
+    DescriptorAllocatorGrowable _bindless_descriptor_allocator;
+    // Long-lived scene set: scene/light data via dynamic offsets.
+    VkDescriptorSet _global_descriptor_set;
+    // Long-lived bindless texture array, updated after bind as textures load.
+    VkDescriptorSet _bindless_texture_set;
+    // Backs every frame's TransientRing.
+    AllocatedBuffer _transient_buffer;
+    VkDeviceAddress _transient_buffer_address;
+
     // Pipeline for the default gradient compute shader.
     VkPipeline _gradient_pipeline;
     VkPipelineLayout _gradient_pipeline_layout;
@@ -228,18 +550,47 @@ class VulkanEngine
     VkDescriptorSet _draw_image_descriptors;
     VkDescriptorSetLayout _draw_image_descriptor_layout;
 
+    // Pipeline for converting the HDR draw image into the LDR image (headless only).
+    VkPipeline _tonemap_pipeline;
+    VkPipelineLayout _tonemap_pipeline_layout;
+    VkDescriptorSet _tonemap_descriptors;
+    VkDescriptorSetLayout _tonemap_descriptor_layout;
+
     DeletionQueue _main_deletion_queue;
 
     VmaAllocator _allocator;
 
-    // immediate rendering submit structures
+    // Progress of every queue. Frames, uploads and async compute signal and wait on its points.
+    DeviceTimeline _timeline;
+    // Resources released while the GPU may still use them, destroyed once their timeline point is reached.
+    TimelineDeletionQueue _deferred_deletion;
+
+    // Holds the vertices and indices of every loaded mesh.
+    GeometryArena _geometry;
+
+    // Culls the snapshot's opaque and masked surfaces when it was produced with _gpu_culling set.
+    GpuCuller _gpu_culler;
+    std::vector<const RenderObject*> _gpu_cull_list; // Draws given to the culler this frame, in instance order.
+
+    // Hierarchical depth of the early geometry pass, which occlusion culling tests against. Sized with the targets.
+    DepthPyramid _depth_pyramid;
+    std::vector<VkDescriptorSet> _depth_pyramid_textures; // ImGui textures of each mip, registered on first display.
+    int _depth_pyramid_debug_mip{0};
+
+    // Batches mesh and texture uploads onto the transfer queue. Frames wait on its completion point on the GPU, so
+    // queued uploads never stall the CPU.
+    UploadManager _uploads;
+
+    double _last_graphics_start_ms{0.0}; // Device time span of the previous frame's graphics work.
+    double _last_graphics_end_ms{0.0};
 
-    VkFence _imm_fence;
-    VkCommandBuffer _imm_command_buffer;
-    VkCommandPool _imm_command_pool;
+    // Render targets. Sized to the swapchain times MAX_RENDER_SCALE and recreated when the swapchain changes size.
 
     AllocatedImage _draw_image;  // Main color image
     AllocatedImage _depth_image; // Main depth image
+    AllocatedImage _ldr_image;   // Tonemapped 8-bit color image (headless only)
+
+    VkDeviceSize _render_target_bytes{0}; // Device memory held by the render targets.
 
     // Sample images used for debugging. All but the checkerboard image are 1x1 pixels.
 
@@ -251,9 +602,14 @@ class VulkanEngine
     VkSampler _default_sampler_linear;  // linar filtering (blur).
     VkSampler _default_sampler_nearest; // nearest neighbor filtering.
 
-    // Scene resources
+    // Scene resources. The loaded scenes' nodes, the scene objects, scene data, light data and camera belong to
+    // whichever thread runs update_scene(): the game thread inside run(), otherwise the main thread.
+
+    SceneObjects _scene_objects; // Of the active scene.
+    DrawRefs _cull_refs;         // The objects the BVH left for the current tick's cull.
+    std::vector<uint32_t> _candidate_surfaces;
 
-    DrawContext _main_draw_context;
+    BoundsSoA _cull_bounds; // World-space bounds of the surfaces being culled, refilled for each cull.
     GPUSceneData _scene_data;
     MaterialInstance _default_data;
 
@@ -261,8 +617,11 @@ class VulkanEngine
 
     std::unordered_map<std::string, std::shared_ptr<LoadedGLTF>> _loaded_scenes;
 
+    std::unordered_map<std::string, std::string> _gltf_paths; // Scene names mapped to file paths.
+    std::string _scene_name{"MetalRoughSpheres"};              // Scene loaded by init().
+
     VkDescriptorSetLayout _gpu_scene_data_descriptor_layout;
-    VkDescriptorSetLayout _gpu_light_data_descriptor_layout;
+    VkDescriptorSetLayout _bindless_texture_descriptor_layout;
 
     std::vector<ComputeEffect> background_effects;
     int current_background_effect{0};
@@ -273,6 +632,33 @@ class VulkanEngine
 
     TextureCache _texture_cache; // Used for texture indexing.
 
+    // Game thread. While run() is active it ticks update_scene() one frame ahead of the main thread, which polls
+    // input and records and submits the latest snapshot.
+
+    std::thread _game_thread;
+    std::atomic<bool> _game_thread_stop{false};
+    std::atomic<uint64_t> _consumed_tick{0}; // Tick of the snapshot the renderer last took.
+    uint64_t _tick{0};                       // Game thread only.
+
+    util::TripleBuffer<SceneSnapshot> _scene_snapshots;
+
+    std::mutex _input_mutex;
+    InputState _pending_input{}; // Input gathered on the main thread since the last tick.
+
+    std::atomic<float> _scene_aspect{1.f}; // Aspect ratio of the draw extent, for the camera projection.
+
+    // Camera path recording (toggled with F5 in run()).
+
+    bool _recording_camera_path{false};
+    float _camera_path_time{0.f};
+    CameraPath _recorded_camera_path;
+    std::string _camera_path_file{"camera_path.txt"}; // Where recorded paths are saved.
+
+    // CPU trace export (F6 in run()).
+
+    std::string _trace_path{"trace.json"};
+    uint32_t _trace_frame_count{120}; // Number of recent frames written; 0 writes everything retained.
+
     // Initializes structures and objects required to run the engine.
     void init();
 
@@ -285,23 +671,71 @@ class VulkanEngine
 
     // Processes draw calls for background and geometry.
     void draw_main(VkCommandBuffer cmd);
-    // Draws a background using compute shaders.
-    void draw_background(VkCommandBuffer cmd);
-    // Draws scene geometry.
-    void draw_geometry(VkCommandBuffer cmd);
+    // Draws a background using compute shaders into the image bound by target_descriptors.
+    void draw_background(VkCommandBuffer cmd, VkDescriptorSet target_descriptors);
+    // Records and submits the frame's background effect on the compute queue. Returns the timeline semaphore wait
+    // the frame's graphics submission must include.
+    VkSemaphoreSubmitInfo submit_async_compute(FrameData& frame);
+    // Records the GPU culling pass of the snapshot's opaque and masked surfaces. Must precede the geometry pass. With
+    // occlusion culling only the early phase is recorded; the late one follows the depth pyramid build.
+    void cull_geometry(VkCommandBuffer cmd);
+    // Grows the frame's indirect draw storage to hold draw_count draws. Returns false, logging once per size, if it
+    // cannot; the passes then draw directly.
+    bool reserve_indirect_draws(FrameData& frame, uint32_t draw_count);
+    // Draws the scene geometry of one pass, returning what it recorded.
+    DrawCounts draw_geometry(VkCommandBuffer cmd, std::span<const uint32_t> dynamic_offsets, GeometryPass pass);
+    // Writes textures added to the cache since the last call into the bindless array.
+    void flush_texture_updates();
+    // Records draws into cmd, binding all state for the first draw so cmd may be a fresh secondary.
+    // With indirect buffers, draws[i] writes entry first_draw + i of them and is drawn from there. GPU-culled batches
+    // are drawn whole by the call which holds their first draw.
+    void record_draws(VkCommandBuffer cmd,
+                      std::span<const RenderObject* const> draws,
+                      std::span<const uint32_t> dynamic_offsets,
+                      const IndirectDrawBuffers* indirect,
+                      uint32_t first_draw,
+                      DrawCounts& counts);
+    // Returns a secondary command buffer from the context which continues the geometry rendering pass.
+    VkCommandBuffer begin_secondary_command_buffer(RecordingContext& context);
+    // Returns the number of threads which record geometry this frame.
+    uint32_t recording_thread_count() const;
     // Draws ImGui windows using immediate rendering.
     void draw_imgui(VkCommandBuffer cmd, VkImageView target_image_view);
-    // Updates the state of the current scene and its objects.
+    // Updates the camera and the scene, culls and sorts the draws, and publishes the result as a snapshot.
     void update_scene();
 
-    // A single-threaded loop which handles user input and draw calls.
+    // The main loop. Handles user input and draw calls on the calling thread while a game thread updates the scene.
     void run();
 
-    // Uses alternate command buffer for immediate submits.
-    void immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function);
+    // Renders a fixed number of frames offscreen. Requires _headless to be set before init().
+    void run_headless(int frame_count);
 
-    // Sends mesh data to the GPU.
-    GPUMeshBuffers upload_mesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
+    // Replays a camera path over the given scene with fixed time steps and writes a report.
+    // Works in both windowed and headless mode.
+    void run_benchmark(const BenchmarkSettings& settings);
+
+    // Loads a scene from _gltf_paths (or a file path) and makes it the active scene.
+    // Returns false if the scene could not be loaded.
+    bool load_scene(const std::string& name);
+
+    // Creates the ImGui windows for the current frame.
+    void update_imgui();
+
+    // Writes the last _trace_frame_count frames of CPU zones to _trace_path as a Chrome trace.
+    void write_trace();
+
+    // Renders a frame into the LDR image and schedules it for readback.
+    void draw_headless();
+    // Converts the HDR draw image into the LDR image.
+    void draw_tonemap(VkCommandBuffer cmd);
+
+    // Grows the geometry arena, if needed, so that vertex_count vertices and index_count indices fit in one range
+    // each. The copies of the old contents join the open upload batch without submitting it. Returns false if the
+    // arena cannot grow.
+    bool reserve_geometry(uint32_t vertex_count, uint32_t index_count);
+    // Places mesh data in the geometry arena, growing it if needed. The copy is queued on _uploads and completes
+    // asynchronously. Returns std::nullopt if the arena cannot grow to fit the mesh.
+    std::optional<GeometryAllocation> upload_mesh(std::span<uint32_t> indices, std::span<Vertex> vertices);
 
     AllocatedBuffer create_buffer(size_t alloc_size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage);
     void destroy_buffer(const AllocatedBuffer& buffer);
@@ -311,6 +745,7 @@ class VulkanEngine
                                 VkImageUsageFlags usage,
                                 bool mipmapped    = false,
                                 bool multisampled = false);
+    // Creates an image and queues the upload of its texels on _uploads.
     AllocatedImage create_image(void* data,
                                 VkExtent3D size,
                                 VkFormat format,
@@ -332,18 +767,53 @@ class VulkanEngine
     void destroy_swapchain();
     // Recreates the swapchain to suit the current window dimensions.
     void resize_swapchain();
+    // Creates the render targets for a swapchain of the given extent. Descriptor sets must be rewritten afterwards.
+    void create_render_targets(VkExtent2D swapchain_extent);
+    // Destroys the render targets. The GPU must not be using them.
+    void destroy_render_targets();
+    // Points the descriptor sets which access the render targets at their current image views.
+    void write_render_target_descriptors();
     // Initializes command pools and command buffers.
     void init_commands();
 
     void init_pipelines();
     // Initializes pipelines for the background compute shader.
     void init_background_pipelines();
+    // Initializes the pipeline used to tonemap the draw image (headless only).
+    void init_tonemap_pipeline();
     // Initializes descriptors and descriptor sets.
     void init_descriptors();
-    // Initializes fences and semaphores.
+    // Initializes the device timeline and the per-frame semaphores.
     void init_sync_structures();
 
     void init_imgui();
     // Initializes objects used for debugging.
     void init_default_data();
+
+    // Passes a finished headless frame to the callback and/or writes it to disk.
+    void deliver_headless_frame(FrameData& frame);
+
+    // Submits the uploads queued since the last frame. Returns the timeline wait a graphics submission needs to use
+    // everything uploaded so far.
+    VkSemaphoreSubmitInfo flush_uploads();
+    // Collects the GPU pass times of a finished frame into stats.
+    // Must only be called after the frame's timeline point has been waited on.
+    void read_gpu_timestamps(FrameData& frame);
+    // Feeds the latest GPU frame time to the dynamic resolution controller.
+    void update_render_scale();
+    // Resets the secondary command pools of a finished frame.
+    void reset_recording_contexts(FrameData& frame);
+    // Takes the latest published snapshot, if any, and lets the game thread start its next tick.
+    void acquire_snapshot();
+    // Copies the objects into draws, keeping only the surfaces inside the camera's frustum and sorting the opaque ones
+    // by material and mesh. If gpu_culling is set, every opaque and masked surface is kept.
+    void cull_and_sort(const DrawRefs& objects, DrawContext& draws, bool gpu_culling);
+    // Body of the game thread.
+    void game_thread_loop();
+    // Signals the game thread to finish its tick and waits for it. Does nothing if it is not running.
+    void stop_game_thread();
+    // Renders a frame in the current mode (windowed or headless).
+    void draw_frame();
+    // Starts recording the camera path, or stops and saves it to _camera_path_file.
+    void toggle_camera_path_recording();
 };
\ No newline at end of file
@@ -0,0 +1,106 @@
+/* vk_geometry.h
+ *
+ * Keeps the vertices and indices of every mesh in two device-wide buffers.
+ * Meshes are sub-allocated from them, so all draws share one index buffer binding and one vertex buffer address, and
+ * VMA sees two allocations instead of two per mesh. Vertices are pulled through the buffer's device address at
+ * gl_VertexIndex, which includes the draw's vertexOffset, so indices stay relative to their mesh's first vertex.
+ * The buffers start small and are replaced by larger ones as scenes need room; allocations keep their offsets, so
+ * the caller only has to copy the old contents across.
+ *
+ */
+#pragma once
+
+#include "vk_types.h"
+#include <map>
+#include <span>
+#include <vector>
+
+// Hands out ranges of a pool using a first-fit free list. Freed ranges merge with free neighbours.
+class RangeAllocator
+{
+  public:
+    void init(uint32_t capacity);
+    // Extends the pool to capacity, which must not be smaller than the current one.
+    void grow(uint32_t capacity);
+
+    // Returns the offset of count free elements, or std::nullopt if no free range is large enough.
+    std::optional<uint32_t> allocate(uint32_t count);
+    // Returns a range handed out by allocate().
+    void free(uint32_t offset, uint32_t count);
+    // Returns true if a single free range holds count elements.
+    bool fits(uint32_t count) const;
+
+    uint32_t capacity() const { return _capacity; }
+    uint32_t used() const { return _used; }
+
+  private:
+    std::map<uint32_t, uint32_t> _free_ranges; // Offset to count, ordered by offset so neighbours can be found.
+    uint32_t _capacity{0};
+    uint32_t _used{0};
+};
+
+// The ranges of one mesh within the arena, in elements.
+struct GeometryAllocation
+{
+    uint32_t first_vertex{0};
+    uint32_t vertex_count{0};
+    uint32_t first_index{0};
+    uint32_t index_count{0};
+};
+
+// Buffers replaced by GeometryArena::grow(). A null buffer was not replaced.
+struct RetiredGeometryBuffers
+{
+    AllocatedBuffer vertices{};
+    AllocatedBuffer indices{};
+    VkDeviceSize vertex_bytes{0}; // Size of the old contents to copy into the new buffer.
+    VkDeviceSize index_bytes{0};
+};
+
+class GeometryArena
+{
+  public:
+    // The buffers are shared between queue_families without ownership transfers.
+    void init(VkDevice device,
+              VmaAllocator allocator,
+              uint32_t vertex_capacity,
+              uint32_t index_capacity,
+              std::span<const uint32_t> queue_families);
+    // Must only be called once the device is idle.
+    void destroy();
+
+    // Reserves room for a mesh. Returns std::nullopt, reserving nothing, if the arena has no free range large enough.
+    std::optional<GeometryAllocation> allocate(uint32_t vertex_count, uint32_t index_count);
+    // Returns true if allocate() would succeed.
+    bool fits(uint32_t vertex_count, uint32_t index_count) const;
+    // Replaces the buffers lacking room for vertex_count vertices or index_count indices with ones at least twice as
+    // large which have it. The old buffers are handed to retired: their contents must be copied to the start of the
+    // new ones before those are used, and they must only be destroyed once the GPU is done with them. Returns false,
+    // changing nothing, if the new buffers cannot be created.
+    bool grow(uint32_t vertex_count, uint32_t index_count, RetiredGeometryBuffers& retired);
+    // Returns a mesh's ranges. The GPU must no longer use them.
+    void free(const GeometryAllocation& allocation);
+
+    VkBuffer vertex_buffer() const { return _vertex_buffer.buffer; }
+    VkDeviceAddress vertex_buffer_address() const { return _vertex_buffer_address; }
+    VkBuffer index_buffer() const { return _index_buffer.buffer; }
+
+    // Byte offsets of an allocation's data, for uploads.
+    static VkDeviceSize vertex_offset(const GeometryAllocation& allocation);
+    static VkDeviceSize index_offset(const GeometryAllocation& allocation);
+
+    const RangeAllocator& vertices() const { return _vertices; }
+    const RangeAllocator& indices() const { return _indices; }
+
+  private:
+    VkDevice _device{VK_NULL_HANDLE};
+    VmaAllocator _allocator{VK_NULL_HANDLE};
+    std::vector<uint32_t> _queue_families;
+
+    AllocatedBuffer _vertex_buffer;
+    AllocatedBuffer _index_buffer;
+    VkDeviceAddress _vertex_buffer_address{0};
+
+    RangeAllocator _vertices;
+    RangeAllocator _indices;
+};
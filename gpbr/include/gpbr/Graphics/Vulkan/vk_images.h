@@ -12,6 +12,17 @@ namespace vkutil
 // Performs a layout transition for a given image.
 void transition_image(VkCommandBuffer cmd, VkImage image, VkImageLayout currentLayout, VkImageLayout newLayout);
 
+// Records one half of a queue family ownership transfer which also changes the image's layout. The releasing queue
+// records it with release set, the acquiring queue records the same transfer after waiting on the release's
+// submission. Images whose contents are discarded (e.g. transitioned from VK_IMAGE_LAYOUT_UNDEFINED) need no transfer.
+void transfer_image_ownership(VkCommandBuffer cmd,
+                              VkImage image,
+                              VkImageLayout current_layout,
+                              VkImageLayout new_layout,
+                              uint32_t src_queue_family,
+                              uint32_t dst_queue_family,
+                              bool release);
+
 // Copies an image using VkCmdBlitImage.
 void copy_image_to_image(VkCommandBuffer cmd,
                          VkImage source,
@@ -8,10 +8,14 @@
 
 #include "vk_types.h"
 #include "vk_descriptors.h"
+#include "vk_geometry.h"
+#include "../scene_bvh.h"
+#include "../transform_hierarchy.h"
 #include <unordered_map>
 #include <filesystem>
 
 class VulkanEngine; // forward declaration
+struct MeshNode;    // forward declaration
 
 // Oriented bounding box (OBB).
 struct Bounds
@@ -43,7 +47,14 @@ struct MeshAsset
     std::string name;
 
     std::vector<GeoSurface> surfaces;
-    GPUMeshBuffers mesh_buffers;
+    GeometryAllocation geometry; // Surfaces' start indices are relative to geometry.first_index.
+};
+
+// A surface of a mesh node.
+struct SurfaceRef
+{
+    MeshNode* node; // Owned by the node tree.
+    uint32_t surface;
 };
 
 // A renderable object derived from a glTF file.
@@ -56,21 +67,64 @@ struct LoadedGLTF : public IRenderable
 
     std::vector<std::shared_ptr<Node>> top_nodes;
 
+    // The transforms of the nodes, flattened. The node tree remains for the IRenderable API; each node's
+    // world_transform is a copy of its entry, refreshed whenever the entry is.
+    TransformHierarchy transforms;
+
+    std::vector<SurfaceRef> surfaces; // Every surface of every mesh node, in hierarchy order. Items of bvh.
+    SceneBVH bvh;                     // Over the world-space bounds of surfaces.
+
+    // Changes whenever surfaces is rebuilt. Unique across scenes, so caches keyed by it also notice a new scene.
+    uint64_t structure_version{0};
+
     std::vector<VkSampler> samplers;
 
     DescriptorAllocatorGrowable descriptor_pool;
 
     AllocatedBuffer material_data_buffer; // Contains material constants.
 
-    VulkanEngine* creator;
+    VulkanEngine* creator{nullptr}; // Null for scenes assembled on the CPU only, which own no GPU resources.
 
     ~LoadedGLTF() { clear_all(); }
 
     // Recursively draws each node.
     virtual void draw(const glm::mat4& top_matrix, DrawContext& ctx);
+    // Appends the indices of the surfaces in the BVH leaves the frustum reaches, in drawing order, skipping the
+    // subtrees outside it without walking the nodes. The caller still culls the surfaces individually.
+    void query_visible(const FrustumPlanes& planes, std::vector<uint32_t>& visible) const;
+
+    // Editing the scene. update_scene() reads the nodes, transforms, surfaces and BVH every tick without locking, so
+    // these must only be called on the thread which runs it: the game thread while VulkanEngine::run() is active,
+    // otherwise the main thread. Edits made elsewhere have to be handed to that thread.
+
+    // Adds node and its subtree under parent, or as a top node if parent is null.
+    void add_node(const std::shared_ptr<Node>& node, const std::shared_ptr<Node>& parent);
+    // Removes node and its subtree from the scene.
+    void remove_node(const std::shared_ptr<Node>& node);
+    // Records that the local transform of node changed. Takes effect at the next update_transforms().
+    void mark_moved(const Node& node);
+    // Updates the world transforms of the subtrees of the nodes marked as moved, and the BVH above their surfaces.
+    // Appends the surfaces whose transforms changed to moved_surfaces. Does nothing if no node moved.
+    void update_transforms(std::vector<uint32_t>& moved_surfaces);
+
+    // Builds transforms from nodes, whose parents are given as indices into nodes (or NO_PARENT), and updates the
+    // world transforms of the nodes and the bounds of their surfaces.
+    void build_transforms(std::span<Node* const> nodes, std::span<const uint32_t> parents);
+    // Collects the surfaces of the mesh nodes and builds the BVH over them. Requires transforms to be built.
+    void build_bvh();
 
   private:
     void clear_all();
+    std::vector<WorldBounds> surface_bounds() const;
+    // Builds transforms from the node tree, after nodes were added or removed.
+    void rebuild_transforms();
+    // Copies the world transforms of the entries in [begin, end) into their nodes and updates the bounds of their
+    // surfaces, which are appended to moved_surfaces unless it is null.
+    void sync_nodes(uint32_t begin, uint32_t end, std::vector<uint32_t>* moved_surfaces);
+
+    std::vector<Node*> _transform_nodes;      // Node of each entry of transforms.
+    std::vector<MeshNode*> _transform_meshes; // The same nodes if they are mesh nodes, otherwise null.
+    std::vector<TransformRange> _updated_ranges;
 };
 
 // Loads mesh data from a glTF/glb file and creates a LoadedGLTF object if successful.
@@ -0,0 +1,69 @@
+/* vk_profiler.h
+ *
+ * Measures the GPU time of named scopes within a command buffer using timestamp queries.
+ * Results are read back once the frame's timeline point has been reached, so the CPU never stalls on them.
+ *
+ */
+#pragma once
+
+#include "vk_types.h"
+#include <vector>
+
+// The GPU time spent in a named scope.
+struct GpuScopeTiming
+{
+    const char* name; // Must point to a string with static storage duration.
+    float time_ms;
+    int depth; // Nesting level; 0 for outermost scopes.
+
+    // Device time at which the scope began. Comparable between the queues of a device, e.g. to measure overlap.
+    double start_ms;
+};
+
+// Records timestamp pairs around named scopes. Each frame in flight owns its own profiler.
+class GpuProfiler
+{
+  public:
+    // Creates the query pool. A zero valid_bits disables the profiler (e.g. the queue lacks timestamp support).
+    void init(VkDevice device, float timestamp_period, uint32_t valid_bits, uint32_t max_scopes = 32);
+    void destroy();
+
+    // Reads the results of the last recording into results() and resets the pool.
+    // Must only be called once the command buffer which recorded the scopes has finished executing.
+    void collect();
+
+    // Writes the starting timestamp of a scope. Scopes may be nested.
+    void begin_scope(VkCommandBuffer cmd, const char* name);
+    // Writes the ending timestamp of the innermost open scope.
+    void end_scope(VkCommandBuffer cmd);
+
+    // Returns the timings of the last collected frame, in the order the scopes began.
+    const std::vector<GpuScopeTiming>& results() const { return _results; }
+    // Returns the time of the first collected scope with the given name, or 0.
+    float find(const char* name) const;
+
+  private:
+    // A scope recorded in the current command buffer.
+    struct Scope
+    {
+        const char* name;
+        uint32_t begin_query;
+        uint32_t end_query;
+        int depth;
+    };
+
+    // Stands in _open_scopes for a scope which did not fit in the pool.
+    static constexpr uint32_t DROPPED_SCOPE = UINT32_MAX;
+
+    VkDevice _device{VK_NULL_HANDLE};
+    VkQueryPool _pool{VK_NULL_HANDLE};
+    float _timestamp_period{1.f};
+    uint64_t _valid_mask{0};
+    uint32_t _max_queries{0};
+    uint32_t _next_query{0};
+
+    std::vector<Scope> _scopes;
+    std::vector<uint32_t> _open_scopes; // Indices into _scopes, or DROPPED_SCOPE.
+    std::vector<uint64_t> _timestamps;
+    std::vector<GpuScopeTiming> _results;
+};
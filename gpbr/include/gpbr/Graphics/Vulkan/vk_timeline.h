@@ -0,0 +1,87 @@
+/* vk_timeline.h
+ *
+ * Tracks GPU progress with timeline semaphores instead of per-submission fences.
+ * Every submission signals the next value of its queue's semaphore, so a (queue, value) pair names the point at which
+ * it has finished. Submissions to any queue can wait on the points of any other, and the CPU can poll or block on
+ * them, e.g. to pace frames or to release resources once the GPU no longer uses them.
+ * A semaphore's values must be signalled in increasing order, which only holds for the submissions of a single
+ * queue, so each queue advances a semaphore of its own.
+ *
+ */
+#pragma once
+
+#include "vk_types.h"
+#include <array>
+#include <deque>
+#include <functional>
+
+enum class QueueType : uint8_t
+{
+    Graphics,
+    Compute,
+    Transfer
+};
+
+constexpr size_t QUEUE_TYPE_COUNT = 3;
+
+// A value on the timeline of a queue. The default point (value 0) is always complete.
+struct TimelinePoint
+{
+    QueueType queue{QueueType::Graphics};
+    uint64_t value{0};
+};
+
+class DeviceTimeline
+{
+  public:
+    void init(VkDevice device);
+    void destroy();
+
+    // Reserves the point signalled by the next submission to the queue. Points of a queue must be signalled in the
+    // order they were reserved.
+    TimelinePoint next(QueueType queue);
+    // Returns the point most recently reserved on the queue.
+    TimelinePoint last(QueueType queue) const;
+
+    // Returns the submit info which signals the point once the submission's work up to stage_mask has finished.
+    VkSemaphoreSubmitInfo signal_info(TimelinePoint point,
+                                      VkPipelineStageFlags2 stage_mask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) const;
+    // Returns the submit info which holds the submission's work from stage_mask onwards until the point is reached.
+    VkSemaphoreSubmitInfo wait_info(TimelinePoint point,
+                                    VkPipelineStageFlags2 stage_mask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT) const;
+
+    // Returns true once the point has been signalled.
+    bool is_complete(TimelinePoint point);
+    // Blocks until the point has been signalled or the timeout expires (VK_TIMEOUT).
+    VkResult wait(TimelinePoint point, uint64_t timeout_ns = UINT64_MAX);
+
+  private:
+    VkDevice _device{VK_NULL_HANDLE};
+
+    std::array<VkSemaphore, QUEUE_TYPE_COUNT> _semaphores{};
+    std::array<uint64_t, QUEUE_TYPE_COUNT> _reserved{};  // Last value handed out per queue.
+    std::array<uint64_t, QUEUE_TYPE_COUNT> _completed{}; // Last value known to be signalled, to skip queries.
+};
+
+// Destroys resources once the GPU work which may still use them has finished.
+class TimelineDeletionQueue
+{
+  public:
+    // Runs function once the point has been reached.
+    void push(TimelinePoint point, std::function<void()>&& function);
+
+    // Runs the functions whose points have been reached, in the order they were pushed.
+    void collect(DeviceTimeline& timeline);
+
+    // Runs every function. The device must be idle.
+    void flush();
+
+  private:
+    struct Entry
+    {
+        TimelinePoint point;
+        std::function<void()> function;
+    };
+
+    std::deque<Entry> _entries;
+};
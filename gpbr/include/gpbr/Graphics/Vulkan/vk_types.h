@@ -90,23 +90,23 @@ struct Vertex
     glm::vec4 color;
 };
 
-// Contains mesh-specific index and vertex buffers to be sent to the GPU.
-struct GPUMeshBuffers
-{
-    AllocatedBuffer index_buffer;
-    AllocatedBuffer vertex_buffer;
-    VkDeviceAddress vertex_buffer_address;
-};
-
 // Contains mesh-specific data to be used in a draw-call. Intended to be sent
 // to the GPU as a push constant.
 struct GPUDrawPushConstants
 {
-    glm::mat4 world_matrix;
+    glm::mat4 world_matrix; // Direct draws only.
     VkDeviceAddress vertex_buffer_address;
+    VkDeviceAddress draw_data_address; // Indirect draws only. Points to a GPUDrawData per draw.
+    uint32_t indirect;                 // Non-zero if the draw data is read from draw_data_address.
 };
 static_assert(sizeof(GPUDrawPushConstants) <= 128);
 
+// Per-draw data of indirect draws, which the vertex shader finds at gl_InstanceIndex.
+struct GPUDrawData
+{
+    glm::mat4 world_matrix;
+};
+
 struct DrawContext; // forward decl.
 
 // Base class for a renderable object
@@ -124,11 +124,14 @@ struct Node : public IRenderable
 
     glm::mat4 local_transform;
     glm::mat4 world_transform;
+    uint32_t transform_index{0}; // Entry of the node in its scene's TransformHierarchy.
+    uint64_t world_version{0};   // TransformHierarchy::world_version() of world_transform; 0 if it is not tracked.
 
     // Recursively updates the world transform for each node.
-    void refresh_transform(const glm::mat4& parent_matrix)
+    virtual void refresh_transform(const glm::mat4& parent_matrix)
     {
         world_transform = parent_matrix * local_transform;
+        world_version   = 0;
         for (auto c : children)
         {
             c->refresh_transform(world_transform);
@@ -0,0 +1,149 @@
+/* vk_upload.h
+ *
+ * Streams buffer and image data to the GPU without blocking the CPU.
+ * Data is copied into a persistently mapped staging ring, and the copies queued until flush() are submitted as one
+ * batch on the transfer queue. Ownership of the destinations is then handed to the graphics queue, which also
+ * generates mipmaps, since blits are not available on transfer queues.
+ * Completion is tracked on the device timeline: each batch signals a point on the graphics queue's timeline, which
+ * callers can poll through their handles and which frames wait on before using the data.
+ *
+ */
+#pragma once
+
+#include "vk_timeline.h"
+#include "vk_types.h"
+#include <deque>
+#include <utility>
+#include <vector>
+
+// Identifies the batch of an upload. Batches are numbered from 1 in the order they are opened.
+struct UploadHandle
+{
+    uint64_t batch{0};
+};
+
+// Queues uploads from a single thread. The destinations must not be used before their batch has completed, either
+// by waiting on the handle or by having the graphics submission wait on completion_point().
+class UploadManager
+{
+  public:
+    // Uses transfer_queue for the copies. If it belongs to the graphics family, each batch is a single submission to
+    // the graphics queue and no ownership transfers are recorded.
+    void init(VkDevice device,
+              VmaAllocator allocator,
+              DeviceTimeline& timeline,
+              VkQueue transfer_queue,
+              uint32_t transfer_queue_family,
+              VkQueue graphics_queue,
+              uint32_t graphics_queue_family,
+              VkDeviceSize staging_size);
+    // Must only be called once the device is idle.
+    void destroy();
+
+    // Queues a copy of size bytes from data into dst at dst_offset. The data is copied before returning.
+    // Buffers created with VK_SHARING_MODE_CONCURRENT skip the ownership transfer, so other ranges of them may be in
+    // use on the graphics queue meanwhile.
+    UploadHandle upload_buffer(VkBuffer dst,
+                               VkDeviceSize dst_offset,
+                               const void* data,
+                               VkDeviceSize size,
+                               VkSharingMode dst_sharing_mode = VK_SHARING_MODE_EXCLUSIVE);
+
+    // Queues a copy of the first size bytes of src into dst, ordered after every upload queued before it and before
+    // every upload queued after it. Both buffers must have been created with VK_SHARING_MODE_CONCURRENT.
+    UploadHandle copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+
+    // Destroys buffer once the batch collecting uploads has completed, opening one if necessary. For buffers which
+    // that batch's copies read from, such as the source of a copy_buffer(). The batch completes after every graphics
+    // submission made before it, so buffers those still use may be passed as well. Null buffers are ignored.
+    void destroy_after_batch(const AllocatedBuffer& buffer);
+
+    // Queues a copy of tightly packed texels into mip 0 of image, which must have been created with TRANSFER_DST
+    // usage (and TRANSFER_SRC if mipmapped). The image ends in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL with its
+    // remaining mips generated if mipmapped is set.
+    UploadHandle upload_image(const AllocatedImage& image, const void* data, VkDeviceSize size, bool mipmapped);
+
+    // Sets aside staging memory for the next upload_count uploads, totalling size bytes, so that they all join the
+    // open batch without waiting for ring space. Takes the space from the ring if it is free, otherwise allocates a
+    // staging buffer for it.
+    void reserve(VkDeviceSize size, uint32_t upload_count);
+
+    // Submits the queued uploads as one batch. Does nothing if none are queued.
+    void flush();
+
+    // Returns true once every upload of the batch has completed. Batches still open are never complete.
+    bool is_complete(UploadHandle handle);
+    // Blocks until the batch has completed, submitting it first if it is still open.
+    void wait(UploadHandle handle);
+
+    // Returns the point at which every batch submitted so far is usable on the graphics queue.
+    TimelinePoint completion_point() const { return _completion_point; }
+
+    // Bytes and batches submitted since init().
+    uint64_t uploaded_bytes() const { return _uploaded_bytes; }
+    uint32_t submitted_batches() const { return _submitted_batches; }
+
+  private:
+    // The command buffers and staging memory of one submission.
+    struct Batch
+    {
+        VkCommandBuffer transfer_cmd{VK_NULL_HANDLE};
+        VkCommandBuffer graphics_cmd{VK_NULL_HANDLE}; // Same as transfer_cmd when sharing the graphics queue.
+
+        uint64_t number{0};         // The batch's UploadHandle.
+        TimelinePoint completion;   // Graphics queue point signalled once the batch is usable.
+        VkDeviceSize ring_bytes{0}; // Ring space consumed, including alignment and wrap-around padding.
+
+        // Staging buffers of uploads too large for the ring, freed with the batch.
+        std::vector<AllocatedBuffer> dedicated_staging;
+        // Buffers passed to destroy_after_batch(), also freed with the batch.
+        std::vector<AllocatedBuffer> released;
+
+        // Space set aside by reserve(), consumed from reserved_head up to reserved_end.
+        VkBuffer reserved_buffer{VK_NULL_HANDLE};
+        void* reserved_mapped{nullptr};
+        VkDeviceSize reserved_head{0};
+        VkDeviceSize reserved_end{0};
+    };
+
+    // Returns the batch collecting uploads, beginning it if necessary.
+    Batch& open_batch();
+
+    // Reserves size bytes of staging memory and copies data into it. Returns the buffer and offset to copy from.
+    std::pair<VkBuffer, VkDeviceSize> stage(const void* data, VkDeviceSize size);
+    // Takes size bytes at the head of the ring for the open batch. Returns false if they are not free.
+    bool try_allocate_ring(VkDeviceSize size, VkDeviceSize& offset);
+
+    // Recycles the batches which have completed.
+    void retire();
+
+    bool separate_transfer_queue() const { return _transfer_queue_family != _graphics_queue_family; }
+
+    VkDevice _device{VK_NULL_HANDLE};
+    VmaAllocator _allocator{VK_NULL_HANDLE};
+    DeviceTimeline* _timeline{nullptr};
+
+    VkQueue _transfer_queue{VK_NULL_HANDLE};
+    uint32_t _transfer_queue_family{0};
+    VkQueue _graphics_queue{VK_NULL_HANDLE};
+    uint32_t _graphics_queue_family{0};
+
+    VkCommandPool _transfer_pool{VK_NULL_HANDLE};
+    VkCommandPool _graphics_pool{VK_NULL_HANDLE};
+
+    uint64_t _opened_batches{0};
+    TimelinePoint _completion_point;
+
+    // Staging ring. Bytes between _head and the oldest in-flight batch's data are free.
+    AllocatedBuffer _ring;
+    VkDeviceSize _ring_size{0};
+    VkDeviceSize _head{0};
+    VkDeviceSize _used{0};
+
+    std::optional<Batch> _open;
+    std::deque<Batch> _in_flight; // Oldest first.
+    std::vector<Batch> _free;     // Completed batches whose command buffers can be reused.
+
+    uint64_t _uploaded_bytes{0};
+    uint32_t _submitted_batches{0};
+};
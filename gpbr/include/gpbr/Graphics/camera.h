@@ -79,4 +79,7 @@ class Camera
     void process_SDL_event(SDL_Event& e);
 
     void update(); // Updates the current state of the camera.
-};
\ No newline at end of file
+};
+
+// Applies keyboard and mouse events to an input state. Mouse motion accumulates until the state is consumed.
+void process_SDL_event(InputState& input, const SDL_Event& e, float mouse_sensitivity);
\ No newline at end of file
@@ -0,0 +1,21 @@
+/* cull_benchmark.h
+ *
+ * Microbenchmarks CPU frustum culling on a synthetic scene, without a window or a GPU.
+ * Times the engine's per-object in_frustum() test against gathering world-space bounds into a BoundsSoA and culling
+ * them with each kernel the CPU supports, and checks every kernel against a reference implementation. Also times
+ * building a SceneBVH over the bounds and querying it, checking that its frustum query reaches every visible object
+ * and that its box and ray queries return what searching every object does. Then moves some of the objects through a
+ * TransformHierarchy and checks the world transforms, a BVH refit over the moved objects and the instances GpuCuller
+ * stages against recomputing everything, and that a frame without moves updates and stages nothing. Lastly adds,
+ * removes and moves nodes of a scene through the LoadedGLTF API and checks the render objects SceneObjects keeps
+ * against rebuilding them.
+ *
+ */
+#pragma once
+
+#include <string>
+
+// Runs the benchmark for several object counts and writes a report of the timings (see BenchmarkRecorder).
+// Returns false if a kernel, the BVH, a moved object or an edited scene disagreed with the reference or the report
+// could not be written.
+bool run_cull_benchmark(const std::string& report_path);
@@ -0,0 +1,56 @@
+/* dynamic_resolution.h
+ *
+ * Adjusts the render scale from measured GPU frame times to hold a target frame time.
+ * GPU time is assumed to grow with the number of shaded pixels, i.e. with the square of the scale.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Tuning of the dynamic resolution controller.
+struct DynamicResolutionSettings
+{
+    float target_ms{16.6f}; // GPU frame time to hold.
+    float min_scale{0.5f};
+    float max_scale{1.f};
+
+    // Hysteresis. The scale drops as soon as the smoothed time exceeds the target, but only rises once it has stayed
+    // below target * (1 - headroom) for upscale_delay frames, and then by at most max_step_up per change.
+    float headroom{0.15f};
+    uint32_t upscale_delay{30};
+    float max_step_up{0.05f};
+
+    float smoothing{0.2f};   // Weight of the newest sample in the moving average.
+    uint32_t settle_frames{3}; // Frames ignored after a change, covering frames already in flight at the old scale.
+};
+
+class DynamicResolution
+{
+  public:
+    DynamicResolutionSettings settings;
+
+    // Feeds the GPU time of a finished frame and returns the scale to render the next frame at.
+    // A gpu_ms of zero (no timestamp support) leaves the scale unchanged.
+    float update(float gpu_ms, float current_scale);
+
+    // Clears the measurements, e.g. after the controller is enabled or the resolution changes.
+    void reset();
+
+    // The most recent scales, oldest first.
+    const std::vector<float>& history() const { return _history; }
+
+    float smoothed_gpu_ms() const { return _smoothed_ms; }
+
+    static constexpr uint32_t HISTORY_LENGTH = 240;
+
+  private:
+    void push_history(float scale);
+
+    float _smoothed_ms{0.f};
+    uint32_t _settle_counter{0};
+    uint32_t _under_budget_frames{0};
+
+    std::vector<float> _history;
+};
@@ -0,0 +1,86 @@
+/* frustum_culling.h
+ *
+ * Tests the world-space bounds of many objects against a view frustum at once.
+ * Bounds are stored as a structure of arrays, so the SIMD kernels load one component of 4 (SSE) or 8 (AVX2) objects
+ * with a single instruction. An object is culled when its bounding sphere or its bounding box lies entirely behind one
+ * of the frustum planes. The kernel is chosen at runtime from what the CPU supports, and every kernel performs the
+ * same floating point operations in the same order, so all of them give identical results.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Planes pointing into the frustum, normalized so that distances compare against radii: left, right, bottom, top,
+// then the planes at depth 0 and 1.
+using FrustumPlanes = std::array<glm::vec4, 6>;
+
+// Extracts the frustum planes of a view projection matrix with a depth range of 0 to 1, reversed or not.
+FrustumPlanes frustum_planes(const glm::mat4& view_proj);
+
+// World-space bounds of an object.
+struct WorldBounds
+{
+    glm::vec3 center;
+    float radius;      // Of the bounding sphere.
+    glm::vec3 extents; // Half the size of the axis-aligned bounding box.
+};
+
+// Returns the world-space bounds of a box and sphere centered on origin, under transform. The box is the
+// axis-aligned box enclosing the transformed one, and the sphere grows with the largest axis scale.
+WorldBounds transform_bounds(const glm::vec3& origin,
+                             const glm::vec3& extents,
+                             float sphere_radius,
+                             const glm::mat4& transform);
+
+// The world-space bounds of many objects, one array per component.
+struct BoundsSoA
+{
+    std::vector<float> center_x;
+    std::vector<float> center_y;
+    std::vector<float> center_z;
+    std::vector<float> extent_x;
+    std::vector<float> extent_y;
+    std::vector<float> extent_z;
+    std::vector<float> radius;
+
+    size_t size() const { return center_x.size(); }
+    void resize(size_t count);
+    void clear() { resize(0); }
+
+    void set(size_t i, const WorldBounds& bounds)
+    {
+        center_x[i] = bounds.center.x;
+        center_y[i] = bounds.center.y;
+        center_z[i] = bounds.center.z;
+        extent_x[i] = bounds.extents.x;
+        extent_y[i] = bounds.extents.y;
+        extent_z[i] = bounds.extents.z;
+        radius[i]   = bounds.radius;
+    }
+};
+
+enum class CullKernel
+{
+    Scalar,
+    SSE,  // 4 objects per iteration.
+    AVX2, // 8 objects per iteration.
+};
+
+// Returns the widest kernel the CPU supports. Detected once.
+CullKernel best_cull_kernel();
+const char* cull_kernel_name(CullKernel kernel);
+
+// Sets visible[i] to 1 for each object in [begin, end) whose bounds may intersect the frustum, and to 0 for the rest.
+// The kernel must be supported by the CPU, i.e. no wider than best_cull_kernel().
+void cull_bounds(const BoundsSoA& bounds,
+                 const FrustumPlanes& planes,
+                 uint32_t begin,
+                 uint32_t end,
+                 uint8_t* visible,
+                 CullKernel kernel = best_cull_kernel());
@@ -0,0 +1,72 @@
+/* scene_bvh.h
+ *
+ * A bounding volume hierarchy over the world-space boxes of a scene's items, for frustum, box and ray queries.
+ * The tree is built once with the surface area heuristic (SAH), and refit when items move: the boxes are recomputed
+ * bottom-up while the structure is kept, so a tree over mostly static items stays efficient. Items are identified by
+ * their index in the bounds passed to build().
+ *
+ */
+#pragma once
+
+#include "frustum_culling.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/vec3.hpp>
+
+// An item whose box a ray hits, and the distance along the ray at which it enters the box.
+struct BvhRayHit
+{
+    uint32_t item;
+    float distance;
+};
+
+class SceneBVH
+{
+  public:
+    // Builds the tree over the boxes of bounds, replacing any previous one.
+    void build(std::span<const WorldBounds> bounds);
+    // Updates the boxes of the items to bounds, which must hold as many items as the tree was built with.
+    void refit(std::span<const WorldBounds> bounds);
+    // Updates the boxes of the given items only, to bounds, which holds one per entry of items, and refits the nodes
+    // above them.
+    void refit(std::span<const uint32_t> items, std::span<const WorldBounds> bounds);
+    void clear();
+
+    // Appends the items in the leaves the frustum reaches. Conservative: leaves crossing a plane are appended whole,
+    // so the caller should still test their items individually.
+    void query_frustum(const FrustumPlanes& planes, std::vector<uint32_t>& items) const;
+    // Appends the items whose boxes overlap the box from min to max.
+    void query_box(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& items) const;
+    // Appends the items whose boxes the ray hits within max_distance, nearest first. direction need not be normalized;
+    // distances are in multiples of it.
+    void query_ray(const glm::vec3& origin,
+                   const glm::vec3& direction,
+                   float max_distance,
+                   std::vector<BvhRayHit>& hits) const;
+
+    uint32_t item_count() const { return (uint32_t)_item_min.size(); }
+    uint32_t node_count() const { return (uint32_t)_nodes.size(); }
+
+  private:
+    struct Node
+    {
+        glm::vec3 min;
+        uint32_t first_item{0}; // Into _items. A node's items are contiguous, so interior nodes cover their subtree.
+        glm::vec3 max;
+        uint32_t item_count{0};
+        uint32_t left_child{0}; // 0 for leaves; the right child follows the left one.
+        uint32_t parent{0};
+    };
+
+    void fit_items(Node& node) const; // Fits the node's box to its items.
+    void mark_leaf(uint32_t index);   // Records the node as the leaf of its items.
+
+    std::vector<Node> _nodes; // Root first; children always come after their parent.
+    std::vector<uint32_t> _items;
+    std::vector<uint32_t> _item_leaves; // Leaf holding each item.
+
+    // Boxes of the items, by item.
+    std::vector<glm::vec3> _item_min;
+    std::vector<glm::vec3> _item_max;
+};
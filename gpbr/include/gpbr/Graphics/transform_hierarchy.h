@@ -0,0 +1,66 @@
+/* transform_hierarchy.h
+ *
+ * A scene's transform hierarchy stored as flat arrays of local and world matrices and parent indices.
+ * Nodes are kept in depth-first order: every parent precedes its children, and every subtree is a contiguous range.
+ * Updating the world transforms of the whole hierarchy, or of one subtree, is then a single linear pass in which each
+ * node reads the already updated world transform of its parent.
+ * Setting a local transform marks the node dirty, and update() only recomputes the subtrees of dirty nodes, so an
+ * update with nothing moved does no matrix multiplications. Each world transform carries a version, which tells
+ * consumers of copies of it whether their copy is current.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/mat4x4.hpp>
+
+// The subtree entries [begin, end) of a hierarchy.
+struct TransformRange
+{
+    uint32_t begin;
+    uint32_t end;
+};
+
+class TransformHierarchy
+{
+  public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    // Replaces the hierarchy with the given nodes, in any order, and computes their world transforms. parents holds
+    // the index of each node's parent within the same arrays, or NO_PARENT, and must describe a forest. Returns the
+    // index in the hierarchy of each node.
+    std::vector<uint32_t> build(std::span<const glm::mat4> locals, std::span<const uint32_t> parents);
+    void clear();
+
+    // Recomputes the world transforms of the subtrees of the nodes set since the last update, and no others. Appends
+    // the ranges it recomputed to updated, in order and without overlaps. Returns false if nothing was set.
+    bool update(std::vector<TransformRange>& updated);
+
+    uint32_t size() const { return (uint32_t)_parents.size(); }
+    uint32_t parent(uint32_t node) const { return _parents[node]; }
+    // One past the last node of node's subtree.
+    uint32_t subtree_end(uint32_t node) const { return _subtree_ends[node]; }
+
+    const glm::mat4& local(uint32_t node) const { return _locals[node]; }
+    // Marks node dirty; its subtree is recomputed by the next update().
+    void set_local(uint32_t node, const glm::mat4& local);
+    const glm::mat4& world(uint32_t node) const { return _worlds[node]; }
+    // Replaced whenever the world transform of node is recomputed. Never 0, and unique across all hierarchies, so two
+    // equal versions always stand for the same transform.
+    uint64_t world_version(uint32_t node) const { return _world_versions[node]; }
+
+  private:
+    // Recomputes the world transforms of node and its descendants. The world transform of its parent must be current.
+    void update_subtree(uint32_t node);
+
+    std::vector<glm::mat4> _locals;
+    std::vector<glm::mat4> _worlds;
+    std::vector<uint64_t> _world_versions;
+    std::vector<uint32_t> _parents;
+    std::vector<uint32_t> _subtree_ends;
+
+    std::vector<uint32_t> _dirty_nodes; // Set since the last update, each once.
+    std::vector<uint8_t> _dirty;        // By node.
+};
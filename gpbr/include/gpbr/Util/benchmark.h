@@ -0,0 +1,98 @@
+/* benchmark.h
+ *
+ * Provides deterministic camera paths and statistics for benchmark runs.
+ * Reports can be written as JSON or CSV so builds can be compared.
+ *
+ */
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <glm/vec3.hpp>
+
+// Settings for a benchmark run.
+struct BenchmarkSettings
+{
+    std::string scene{"MetalRoughSpheres"}; // Key in the engine's glTF map, or a path to a glTF file.
+    int warmup_frames{60};                  // Frames rendered before measuring begins.
+    int measured_frames{600};               // Frames which contribute to the report.
+    float fixed_dt{1.f / 60.f};             // Simulated seconds per frame; independent of wall time.
+    std::string camera_path_file{};         // Recorded camera path. An orbit is used when empty.
+    std::string report_path{"benchmark.json"}; // A ".csv" extension selects CSV output; JSON otherwise.
+    std::string label{};                    // Free-form tag (e.g. a commit hash) stored in the report.
+};
+
+// A camera pose at a given time (seconds).
+struct CameraKeyframe
+{
+    float time;
+    glm::vec3 position;
+    float pitch;
+    float yaw;
+};
+
+// A sequence of camera poses which can be sampled at fixed time steps.
+class CameraPath
+{
+  public:
+    std::vector<CameraKeyframe> keyframes;
+
+    // Builds a path circling the center at the given radius and height, looking at the center.
+    static CameraPath orbit(glm::vec3 center, float radius, float height, float duration, int steps = 64);
+
+    // Loads a path from a text file with one "time x y z pitch yaw" keyframe per line.
+    // Returns false if the file could not be read or contains no keyframes.
+    bool load(const std::string& file_path);
+    // Saves the path using the same format as load().
+    bool save(const std::string& file_path) const;
+
+    // Appends a keyframe. Keyframes must be added in increasing time order.
+    void add_keyframe(const CameraKeyframe& keyframe) { keyframes.push_back(keyframe); }
+
+    // Returns the duration of the path in seconds.
+    float duration() const { return keyframes.empty() ? 0.f : keyframes.back().time; }
+
+    // Returns the linearly interpolated pose at the given time. Wraps around when time exceeds the duration.
+    CameraKeyframe sample(float time) const;
+};
+
+// Summary statistics of a single metric.
+struct MetricSummary
+{
+    float mean;
+    float p50;
+    float p95;
+    float p99;
+    float max;
+};
+
+// Returns summary statistics for the given samples (nearest-rank percentiles).
+MetricSummary summarize(std::vector<float> samples);
+
+// Collects per-frame samples of named metrics and writes a report.
+class BenchmarkRecorder
+{
+  public:
+    // Adds a key-value pair to the report header (e.g. scene name, GPU).
+    void set_info(const std::string& key, const std::string& value);
+    // Appends a sample to the named metric. Metrics are reported in the order they are first recorded.
+    void record(const std::string& metric, float value);
+    // Includes every sample of the named metric in JSON reports, in recording order, besides its summary.
+    void keep_history(const std::string& metric);
+
+    // Writes a JSON report.
+    bool write_json(const std::string& file_path) const;
+    // Writes a CSV report with one row per metric.
+    bool write_csv(const std::string& file_path) const;
+    // Writes a CSV report if the file path ends in ".csv", JSON otherwise.
+    bool write(const std::string& file_path) const;
+
+    // Prints a summary table to stdout.
+    void print_summary() const;
+
+  private:
+    std::vector<std::pair<std::string, std::string>> info;
+    std::vector<std::pair<std::string, std::vector<float>>> metrics;
+    std::vector<std::string> history_metrics;
+};
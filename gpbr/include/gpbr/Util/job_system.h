@@ -0,0 +1,123 @@
+/* job_system.h
+ *
+ * A work-stealing job scheduler shared by the whole engine.
+ * Each thread owns a deque of jobs. It pushes and pops at the back, so recently queued (cache-warm) jobs run first,
+ * while threads which run out of work steal the oldest jobs from the front of the other deques.
+ * Dependencies are expressed with a JobCounter: jobs decrement it when they finish, and waiting on it runs other
+ * queued jobs instead of blocking.
+ *
+ */
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace util
+{
+// Number of jobs still outstanding. Must outlive every job it was passed to.
+class JobCounter
+{
+  public:
+    bool done() const { return _pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class JobSystem;
+    std::atomic<uint32_t> _pending{0};
+};
+
+// Time a thread spent running jobs between two calls to JobSystem::collect_stats().
+struct WorkerStats
+{
+    uint64_t busy_ns;
+    uint64_t elapsed_ns;
+    uint32_t jobs_run;
+    uint32_t jobs_stolen; // Jobs taken from another thread's deque.
+
+    float utilization() const { return (elapsed_ns == 0) ? 0.f : (float)busy_ns / (float)elapsed_ns; }
+};
+
+class JobSystem
+{
+  public:
+    // A single job. thread_index is 0 for the thread which created the system and 1..worker_count for workers.
+    using Job = std::function<void(uint32_t thread_index)>;
+
+    // A batch of parallel_for indices in [begin, end).
+    using RangeJob = std::function<void(uint32_t begin, uint32_t end, uint32_t thread_index)>;
+
+    explicit JobSystem(uint32_t worker_count);
+    ~JobSystem();
+
+    JobSystem(const JobSystem&)            = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Returns the number of threads which can run jobs, including the thread which created the system.
+    uint32_t thread_count() const { return (uint32_t)_queues.size(); }
+
+    // Queues a job. If a counter is given it is incremented now and decremented once the job has run.
+    void run(Job job, JobCounter* counter = nullptr);
+
+    // Returns once the counter reaches zero. Threads of the system run queued jobs while they wait, so a job which
+    // waits may have other jobs run on its thread before it resumes; state indexed by thread_index must not be held
+    // across a wait. Threads outside the system simply block.
+    void wait(JobCounter& counter);
+
+    // Runs job over [0, count) in batches of batch_size indices across all threads and waits for them to finish.
+    // Small ranges run inline on the calling thread.
+    void parallel_for(uint32_t count, uint32_t batch_size, const RangeJob& job);
+
+    // Returns the stats of every thread since the previous call and starts a new measurement.
+    std::vector<WorkerStats> collect_stats();
+
+    // Returns the calling thread's index, or UINT32_MAX for threads outside the system.
+    static uint32_t current_thread_index();
+
+  private:
+    struct QueuedJob
+    {
+        Job job;
+        JobCounter* counter;
+    };
+
+    struct alignas(64) WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<QueuedJob> jobs;
+
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint32_t> jobs_run{0};
+        std::atomic<uint32_t> jobs_stolen{0};
+    };
+
+    // Pushes a job without waking anyone.
+    void push(uint32_t queue_index, Job job, JobCounter* counter);
+    void wake(uint32_t job_count);
+
+    // Pops from the thread's own deque, or steals from another. Returns false if every deque is empty.
+    bool try_run_job(uint32_t thread_index);
+    void worker_loop(uint32_t thread_index);
+
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::vector<std::thread> _workers;
+
+    std::atomic<uint32_t> _queued_jobs{0};
+    std::atomic<uint32_t> _next_external_queue{0};
+
+    std::mutex _sleep_mutex;
+    std::condition_variable _work_available;
+    bool _stopping{false};
+
+    // Wakes threads outside the system waiting on a counter.
+    std::mutex _wait_mutex;
+    std::condition_variable _counter_done;
+
+    uint64_t _stats_start_ns{0};
+};
+} // namespace util
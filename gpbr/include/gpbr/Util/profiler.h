@@ -0,0 +1,62 @@
+/* profiler.h
+ *
+ * A low-overhead CPU profiler built from scoped zones.
+ * Each thread records completed zones into its own ring buffer, so recording never takes a lock.
+ * The most recent frames can be exported as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Records a zone covering the rest of the enclosing scope. The name must be a string literal.
+#define GPBR_PROFILE_SCOPE(name) util::ProfileZone GPBR_PROFILE_CONCAT(_profile_zone_, __LINE__){name}
+
+#define GPBR_PROFILE_CONCAT_IMPL(a, b) a##b
+#define GPBR_PROFILE_CONCAT(a, b)      GPBR_PROFILE_CONCAT_IMPL(a, b)
+
+namespace util
+{
+// A completed zone.
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint32_t frame; // Frame during which the zone began.
+};
+
+// Records the time between construction and destruction into the calling thread's ring buffer.
+class ProfileZone
+{
+  public:
+    explicit ProfileZone(const char* name);
+    ~ProfileZone();
+
+    // Ends the current zone and begins a new one, for consecutive phases of a single function.
+    void next(const char* name);
+
+    ProfileZone(const ProfileZone&)            = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+  private:
+    const char* _name;
+    uint64_t _start_ns;
+    uint32_t _frame;
+};
+
+// Returns nanoseconds elapsed on a monotonic clock since the profiler was first used.
+uint64_t profiler_now_ns();
+
+// Marks the start of a new frame. Called once per frame by the thread driving the main loop.
+void profiler_begin_frame();
+
+// Names the calling thread in exported traces.
+void profiler_set_thread_name(const std::string& name);
+
+// Writes the zones of the last frame_count frames as Chrome trace_event JSON.
+// A frame_count of 0 writes every zone still held in the ring buffers, including startup.
+// Other threads may keep recording meanwhile; zones they overwrite while the trace is written are left out.
+bool profiler_write_chrome_trace(const std::string& file_path, uint32_t frame_count);
+} // namespace util
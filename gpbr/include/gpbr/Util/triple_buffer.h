@@ -0,0 +1,51 @@
+/* triple_buffer.h
+ *
+ * A lock-free single-producer, single-consumer handoff of the latest value.
+ * The producer fills one slot while the consumer reads another; the third holds the most recently published value.
+ * Neither side ever waits for the other, and a value which is never consumed is simply overwritten.
+ *
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace util
+{
+template <typename T> class TripleBuffer
+{
+  public:
+    // Returns the slot to fill next. Only the producer may access it.
+    T& write_buffer() { return _slots[_write]; }
+
+    // Hands the write buffer to the consumer and takes the unused slot as the new write buffer.
+    void publish() { _write = _latest.exchange(_write | FRESH_BIT, std::memory_order_acq_rel) & INDEX_MASK; }
+
+    // Takes the most recently published slot as the read buffer. Returns false, keeping the current read buffer,
+    // if nothing has been published since the previous call.
+    bool consume()
+    {
+        if ((_latest.load(std::memory_order_relaxed) & FRESH_BIT) == 0)
+        {
+            return false;
+        }
+
+        _read = _latest.exchange(_read, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // Returns the slot taken by the last successful consume(). Only the consumer may access it.
+    const T& read_buffer() const { return _slots[_read]; }
+
+  private:
+    static constexpr uint32_t INDEX_MASK = 0x3;
+    static constexpr uint32_t FRESH_BIT  = 0x4; // Set while the latest slot has not been consumed.
+
+    std::array<T, 3> _slots{};
+
+    uint32_t _write{0}; // Producer only.
+    uint32_t _read{1};  // Consumer only.
+    std::atomic<uint32_t> _latest{2};
+};
+} // namespace util
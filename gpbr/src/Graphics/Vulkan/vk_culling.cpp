@@ -0,0 +1,497 @@
+#include "Volk/volk.h"
+#include "gpbr/Graphics/Vulkan/vk_culling.h"
+#include "gpbr/Graphics/Vulkan/vk_engine.h"
+#include "gpbr/Graphics/Vulkan/vk_initializers.h"
+#include "gpbr/Graphics/Vulkan/vk_pipelines.h"
+#include "gpbr/Graphics/frustum_culling.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+constexpr uint32_t CULL_GROUP_SIZE       = 64;                   // local_size_x of cull.comp.
+constexpr uint32_t MIN_CULL_CAPACITY     = 1024;                 // Instances the device buffers are first sized for.
+constexpr uint32_t COUNT_HEADER_ELEMENTS = 4;                    // Counters preceding the batches' draw counts.
+constexpr VkDeviceSize VIEW_BYTES        = sizeof(GPUCullView);
+constexpr VkDeviceSize READBACK_BYTES    = 3 * sizeof(uint32_t); // Visible instances and triangles, occluded ones.
+
+static AllocatedBuffer create_cull_buffer(VmaAllocator allocator,
+                                          VkDeviceSize size,
+                                          VkBufferUsageFlags usage,
+                                          VmaMemoryUsage memory_usage)
+{
+    VkBufferCreateInfo buffer_info = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size               = size;
+    buffer_info.usage              = usage;
+
+    VmaAllocationCreateInfo vma_alloc_info = {};
+    vma_alloc_info.usage                   = memory_usage;
+    if (memory_usage != VMA_MEMORY_USAGE_GPU_ONLY)
+    {
+        vma_alloc_info.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+    }
+
+    AllocatedBuffer buffer;
+    VK_CHECK(
+        vmaCreateBuffer(allocator, &buffer_info, &vma_alloc_info, &buffer.buffer, &buffer.allocation, &buffer.info));
+    return buffer;
+}
+
+static VkDeviceAddress buffer_address(VkDevice device, VkBuffer buffer)
+{
+    VkBufferDeviceAddressInfo device_address_info{.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                                                  .buffer = buffer};
+    return vkGetBufferDeviceAddress(device, &device_address_info);
+}
+
+static void memory_barrier(VkCommandBuffer cmd,
+                           VkPipelineStageFlags2 src_stage,
+                           VkAccessFlags2 src_access,
+                           VkPipelineStageFlags2 dst_stage,
+                           VkAccessFlags2 dst_access)
+{
+    VkMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    barrier.srcStageMask  = src_stage;
+    barrier.srcAccessMask = src_access;
+    barrier.dstStageMask  = dst_stage;
+    barrier.dstAccessMask = dst_access;
+
+    VkDependencyInfo dependency{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency.memoryBarrierCount = 1;
+    dependency.pMemoryBarriers    = &barrier;
+
+    vkCmdPipelineBarrier2(cmd, &dependency);
+}
+
+void GpuCuller::init(VkDevice device,
+                     VmaAllocator allocator,
+                     DeviceTimeline& timeline,
+                     TimelineDeletionQueue& deletion_queue,
+                     VkDescriptorSetLayout pyramid_layout,
+                     uint32_t frame_count)
+{
+    _device         = device;
+    _allocator      = allocator;
+    _timeline       = &timeline;
+    _deletion_queue = &deletion_queue;
+
+    /* 1 Create the culling pipeline */
+
+    VkPushConstantRange push_constant{};
+    push_constant.offset     = 0;
+    push_constant.size       = sizeof(GPUCullPushConstants);
+    push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
+    layout_info.setLayoutCount             = 1;
+    layout_info.pSetLayouts                = &pyramid_layout;
+    layout_info.pushConstantRangeCount     = 1;
+    layout_info.pPushConstantRanges        = &push_constant;
+
+    VK_CHECK(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_layout));
+
+    VkShaderModule cull_shader;
+    if (!vkutil::load_shader_module("./Shaders/cull.comp.spv", _device, &cull_shader))
+    {
+        fmt::print("Error when building the culling compute shader\n");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipeline_info.layout = _layout;
+    pipeline_info.stage  = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, cull_shader);
+
+    VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_pipeline));
+
+    vkDestroyShaderModule(_device, cull_shader, nullptr);
+
+    /* 2 Create the readback buffers; the rest is created on first use */
+
+    _frames.resize(frame_count);
+    for (FrameResources& frame : _frames)
+    {
+        frame.readback = create_cull_buffer(
+            _allocator, READBACK_BYTES, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+    }
+}
+
+void GpuCuller::destroy()
+{
+    for (FrameResources& frame : _frames)
+    {
+        vmaDestroyBuffer(_allocator, frame.readback.buffer, frame.readback.allocation);
+        if (frame.staging.buffer != VK_NULL_HANDLE)
+        {
+            vmaDestroyBuffer(_allocator, frame.staging.buffer, frame.staging.allocation);
+        }
+    }
+    _frames.clear();
+
+    if (_capacity > 0)
+    {
+        vmaDestroyBuffer(_allocator, _instance_buffer.buffer, _instance_buffer.allocation);
+        vmaDestroyBuffer(_allocator, _draw_data_buffer.buffer, _draw_data_buffer.allocation);
+        vmaDestroyBuffer(_allocator, _commands.buffer, _commands.allocation);
+        vmaDestroyBuffer(_allocator, _counts.buffer, _counts.allocation);
+        vmaDestroyBuffer(_allocator, _visibility.buffer, _visibility.allocation);
+        _capacity = 0;
+    }
+
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _layout, nullptr);
+}
+
+VkDeviceSize GpuCuller::commands_offset(CullPhase phase) const
+{
+    return (VkDeviceSize)(uint32_t)phase * _capacity * sizeof(VkDrawIndexedIndirectCommand);
+}
+
+VkDeviceSize GpuCuller::counts_offset(CullPhase phase) const
+{
+    return (VkDeviceSize)(COUNT_HEADER_ELEMENTS + (uint32_t)phase * _capacity) * sizeof(uint32_t);
+}
+
+void GpuCuller::grow(uint32_t instance_count)
+{
+    // the previous frame may still read the old buffers
+    if (_capacity > 0)
+    {
+        std::array<AllocatedBuffer, 5> old_buffers = {
+            _instance_buffer, _draw_data_buffer, _commands, _counts, _visibility};
+        VmaAllocator allocator = _allocator;
+
+        _deletion_queue->push(_timeline->last(QueueType::Graphics),
+                              [=]()
+                              {
+                                  for (const AllocatedBuffer& buffer : old_buffers)
+                                  {
+                                      vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+                                  }
+                              });
+    }
+
+    _capacity = std::max({instance_count, _capacity * 2, MIN_CULL_CAPACITY});
+
+    constexpr VkBufferUsageFlags usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+    constexpr VmaMemoryUsage device    = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    VkBufferUsageFlags copied_usage   = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    VkBufferUsageFlags indirect_usage = usage | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    VkBufferUsageFlags counts_usage =
+        indirect_usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    _instance_buffer  = create_cull_buffer(_allocator, _capacity * sizeof(GPUCullInstance), copied_usage, device);
+    _draw_data_buffer = create_cull_buffer(_allocator, _capacity * sizeof(GPUDrawData), copied_usage, device);
+    _commands =
+        create_cull_buffer(_allocator, 2 * _capacity * sizeof(VkDrawIndexedIndirectCommand), indirect_usage, device);
+    // a batch holds at least one instance, so there are never more batches than instances
+    VkDeviceSize counts_size = counts_offset(CullPhase::Late) + _capacity * sizeof(uint32_t);
+
+    _counts     = create_cull_buffer(_allocator, counts_size, counts_usage, device);
+    _visibility = create_cull_buffer(_allocator, _capacity * sizeof(uint32_t), copied_usage, device);
+
+    _instance_address   = buffer_address(_device, _instance_buffer.buffer);
+    _draw_data_address  = buffer_address(_device, _draw_data_buffer.buffer);
+    _commands_address   = buffer_address(_device, _commands.buffer);
+    _counts_address     = buffer_address(_device, _counts.buffer);
+    _visibility_address = buffer_address(_device, _visibility.buffer);
+
+    // the new buffers hold nothing yet
+    _instances.clear();
+    _draw_data.clear();
+    _draw_versions.clear();
+}
+
+uint8_t* GpuCuller::staging_memory(FrameResources& frame, VkDeviceSize size)
+{
+    if (frame.staging.buffer == VK_NULL_HANDLE || frame.staging.info.size < size)
+    {
+        // the frame's previous commands have finished, so its buffer can go immediately
+        if (frame.staging.buffer != VK_NULL_HANDLE)
+        {
+            vmaDestroyBuffer(_allocator, frame.staging.buffer, frame.staging.allocation);
+        }
+
+        VkDeviceSize capacity = std::max<VkDeviceSize>(size, frame.staging.info.size * 2);
+
+        frame.staging = create_cull_buffer(_allocator,
+                                           capacity,
+                                           VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+                                           VMA_MEMORY_USAGE_CPU_TO_GPU);
+        frame.staging_address = buffer_address(_device, frame.staging.buffer);
+    }
+
+    return (uint8_t*)frame.staging.info.pMappedData;
+}
+
+void GpuCuller::find_changed_instances(std::span<const RenderObject* const> draws, std::vector<uint32_t>& changed)
+{
+    uint32_t instance_count = (uint32_t)draws.size();
+
+    _batches.clear();
+    _draw_batches.resize(instance_count);
+
+    size_t resident = _instances.size();
+    _instances.resize(instance_count);
+    _draw_data.resize(instance_count);
+    _draw_versions.resize(instance_count);
+
+    for (uint32_t i = 0; i < instance_count; i++)
+    {
+        const RenderObject& r = *draws[i];
+
+        if (i == 0 || r.material != draws[i - 1]->material)
+        {
+            _batches.push_back({i, 0});
+        }
+        _batches.back().count++;
+        _draw_batches[i] = (uint32_t)_batches.size() - 1;
+
+        GPUCullInstance instance{};
+        instance.sphere        = glm::vec4(r.bounds.origin, r.bounds.sphere_radius);
+        instance.first_index   = r.first_index;
+        instance.index_count   = r.index_count;
+        instance.vertex_offset = r.vertex_offset;
+        instance.batch         = _draw_batches[i];
+        instance.batch_first   = _batches.back().first;
+
+        // a matching transform version spares comparing the matrices
+        bool same_instance = i < resident && memcmp(&instance, &_instances[i], sizeof(GPUCullInstance)) == 0;
+        bool same_version  = r.transform_version != 0 && r.transform_version == _draw_versions[i];
+
+        if (same_instance && same_version)
+        {
+            continue;
+        }
+
+        GPUDrawData draw_data{};
+        draw_data.world_matrix = r.transform;
+
+        if (!same_instance || memcmp(&draw_data, &_draw_data[i], sizeof(GPUDrawData)) != 0)
+        {
+            _instances[i] = instance;
+            _draw_data[i] = draw_data;
+            changed.push_back(i);
+        }
+        _draw_versions[i] = r.transform_version;
+    }
+}
+
+void GpuCuller::update_instances(VkCommandBuffer cmd,
+                                 std::span<const RenderObject* const> draws,
+                                 FrameResources& frame)
+{
+    uint32_t instance_count = (uint32_t)draws.size();
+
+    // nothing has been drawn from the new buffers, so every instance starts out hidden
+    if (instance_count > _capacity)
+    {
+        grow(instance_count);
+        vkCmdFillBuffer(cmd, _visibility.buffer, 0, VK_WHOLE_SIZE, 0);
+    }
+
+    /* 1 Find the instances which differ from what the buffers hold */
+
+    std::vector<uint32_t> changed;
+    find_changed_instances(draws, changed);
+
+    /* 2 Stage the changed instances after the view, and copy each run of them with one region */
+
+    VkDeviceSize instances_offset = VIEW_BYTES;
+    VkDeviceSize draw_data_offset = instances_offset + changed.size() * sizeof(GPUCullInstance);
+    VkDeviceSize staging_size     = draw_data_offset + changed.size() * sizeof(GPUDrawData);
+
+    uint8_t* staging = staging_memory(frame, staging_size);
+
+    if (changed.empty())
+    {
+        return;
+    }
+
+    std::vector<VkBufferCopy> instance_regions;
+    std::vector<VkBufferCopy> draw_data_regions;
+
+    for (size_t k = 0; k < changed.size(); k++)
+    {
+        uint32_t i = changed[k];
+
+        memcpy(staging + instances_offset + k * sizeof(GPUCullInstance), &_instances[i], sizeof(GPUCullInstance));
+        memcpy(staging + draw_data_offset + k * sizeof(GPUDrawData), &_draw_data[i], sizeof(GPUDrawData));
+
+        if (k > 0 && changed[k - 1] + 1 == i)
+        {
+            instance_regions.back().size += sizeof(GPUCullInstance);
+            draw_data_regions.back().size += sizeof(GPUDrawData);
+            continue;
+        }
+
+        instance_regions.push_back({instances_offset + k * sizeof(GPUCullInstance),
+                                    (VkDeviceSize)i * sizeof(GPUCullInstance),
+                                    sizeof(GPUCullInstance)});
+        draw_data_regions.push_back({draw_data_offset + k * sizeof(GPUDrawData),
+                                     (VkDeviceSize)i * sizeof(GPUDrawData),
+                                     sizeof(GPUDrawData)});
+    }
+
+    vkCmdCopyBuffer(cmd,
+                    frame.staging.buffer,
+                    _instance_buffer.buffer,
+                    (uint32_t)instance_regions.size(),
+                    instance_regions.data());
+    vkCmdCopyBuffer(cmd,
+                    frame.staging.buffer,
+                    _draw_data_buffer.buffer,
+                    (uint32_t)draw_data_regions.size(),
+                    draw_data_regions.data());
+}
+
+void GpuCuller::cull(VkCommandBuffer cmd,
+                     std::span<const RenderObject* const> draws,
+                     const CullView& view,
+                     VkDescriptorSet pyramid_set,
+                     uint32_t frame_index)
+{
+    FrameResources& frame = _frames[frame_index];
+
+    frame.readback_instances = (uint32_t)draws.size();
+    _instance_count          = (uint32_t)draws.size();
+    _pyramid_set             = pyramid_set;
+
+    if (draws.empty())
+    {
+        _batches.clear();
+        _draw_batches.clear();
+        return;
+    }
+
+    /* 1 Wait for the previous frame to finish reading what this one overwrites */
+
+    memory_barrier(cmd,
+                   VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT |
+                       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
+                   VK_ACCESS_2_NONE,
+                   VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT |
+                       VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_NONE);
+
+    /* 2 Copy in the changed instances and the view, and zero the counters of both phases */
+
+    update_instances(cmd, draws, frame);
+
+    FrustumPlanes planes = frustum_planes(view.projection * view.view);
+
+    GPUCullView gpu_view{};
+    std::copy(planes.begin(), planes.end(), gpu_view.planes);
+    gpu_view.view         = view.view;
+    gpu_view.projection   = glm::vec4(
+        view.projection[0][0], view.projection[1][1], view.projection[2][2], view.projection[3][2]);
+    gpu_view.pyramid_size = glm::vec2(view.pyramid_extent.width, view.pyramid_extent.height);
+    gpu_view.znear        = view.znear;
+    gpu_view.occlusion    = view.occlusion ? 1 : 0;
+
+    memcpy(frame.staging.info.pMappedData, &gpu_view, VIEW_BYTES);
+
+    vkCmdFillBuffer(cmd, _counts.buffer, 0, VK_WHOLE_SIZE, 0);
+
+    memory_barrier(cmd,
+                   VK_PIPELINE_STAGE_2_COPY_BIT | VK_PIPELINE_STAGE_2_CLEAR_BIT,
+                   VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    /* 3 Cull, one invocation per instance */
+
+    dispatch(cmd, frame, CullPhase::Early);
+
+    memory_barrier(cmd,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
+                   VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT);
+
+    /* 4 Copy the totals out for collect(), unless the late phase adds to them */
+
+    if (!view.occlusion)
+    {
+        read_back(cmd, frame);
+    }
+}
+
+void GpuCuller::cull_late(VkCommandBuffer cmd, uint32_t frame_index)
+{
+    if (_instance_count == 0)
+    {
+        return;
+    }
+
+    FrameResources& frame = _frames[frame_index];
+
+    // the early phase's visibility reads and counter updates come first
+    memory_barrier(cmd,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+
+    dispatch(cmd, frame, CullPhase::Late);
+
+    memory_barrier(cmd,
+                   VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT,
+                   VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_2_COPY_BIT,
+                   VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_2_TRANSFER_READ_BIT);
+
+    read_back(cmd, frame);
+}
+
+void GpuCuller::dispatch(VkCommandBuffer cmd, FrameResources& frame, CullPhase phase)
+{
+    GPUCullPushConstants push_constants{};
+    push_constants.instances      = _instance_address;
+    push_constants.draw_data      = _draw_data_address;
+    push_constants.commands       = _commands_address + commands_offset(phase);
+    push_constants.counts         = _counts_address;
+    push_constants.batch_counts   = _counts_address + counts_offset(phase);
+    push_constants.view           = frame.staging_address;
+    push_constants.visibility     = _visibility_address;
+    push_constants.instance_count = _instance_count;
+    push_constants.phase          = (uint32_t)phase;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _layout, 0, 1, &_pyramid_set, 0, nullptr);
+    vkCmdPushConstants(cmd, _layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(GPUCullPushConstants), &push_constants);
+    vkCmdDispatch(cmd, (_instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+}
+
+void GpuCuller::read_back(VkCommandBuffer cmd, FrameResources& frame)
+{
+    VkBufferCopy readback_region{0, 0, READBACK_BYTES};
+    vkCmdCopyBuffer(cmd, _counts.buffer, frame.readback.buffer, 1, &readback_region);
+
+    memory_barrier(cmd,
+                   VK_PIPELINE_STAGE_2_COPY_BIT,
+                   VK_ACCESS_2_TRANSFER_WRITE_BIT,
+                   VK_PIPELINE_STAGE_2_HOST_BIT,
+                   VK_ACCESS_2_HOST_READ_BIT);
+}
+
+CullStats GpuCuller::collect(uint32_t frame_index)
+{
+    FrameResources& frame = _frames[frame_index];
+
+    CullStats stats;
+    if (frame.readback_instances == 0)
+    {
+        return stats;
+    }
+
+    vmaInvalidateAllocation(_allocator, frame.readback.allocation, 0, READBACK_BYTES);
+
+    const uint32_t* counters = (const uint32_t*)frame.readback.info.pMappedData;
+
+    stats.instances         = frame.readback_instances;
+    stats.visible           = counters[0];
+    stats.visible_triangles = counters[1];
+    stats.occluded          = counters[2];
+
+    frame.readback_instances = 0;
+    return stats;
+}
@@ -0,0 +1,297 @@
+#include "Volk/volk.h"
+#include "gpbr/Graphics/Vulkan/vk_depth_pyramid.h"
+#include "gpbr/Graphics/Vulkan/vk_initializers.h"
+#include "gpbr/Graphics/Vulkan/vk_pipelines.h"
+#include <algorithm>
+#include <cmath>
+
+constexpr uint32_t REDUCE_GROUP_SIZE = 32; // local_size_x and local_size_y of depth_reduce.comp.
+
+// Push constants of depth_reduce.comp.
+struct DepthReducePushConstants
+{
+    glm::vec2 dst_size;
+    glm::vec2 src_scale; // Fraction of the source covered by the destination.
+};
+
+// Returns the largest power of two not above value.
+static uint32_t previous_pow2(uint32_t value)
+{
+    uint32_t result = 1;
+    while (result * 2 <= value)
+    {
+        result *= 2;
+    }
+    return result;
+}
+
+void DepthPyramid::init(VkDevice device, VmaAllocator allocator)
+{
+    _device    = device;
+    _allocator = allocator;
+
+    /* 1 Create the min-filtering sampler */
+
+    VkSamplerReductionModeCreateInfo reduction_info{.sType = VK_STRUCTURE_TYPE_SAMPLER_REDUCTION_MODE_CREATE_INFO};
+    reduction_info.reductionMode = VK_SAMPLER_REDUCTION_MODE_MIN;
+
+    VkSamplerCreateInfo sampler_info{.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
+    sampler_info.pNext        = &reduction_info;
+    sampler_info.magFilter    = VK_FILTER_LINEAR;
+    sampler_info.minFilter    = VK_FILTER_LINEAR;
+    sampler_info.mipmapMode   = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    sampler_info.minLod       = 0.f;
+    sampler_info.maxLod       = VK_LOD_CLAMP_NONE;
+
+    VK_CHECK(vkCreateSampler(_device, &sampler_info, nullptr, &_min_sampler));
+
+    /* 2 Create the descriptor layouts and the pool the targets' sets come from */
+
+    {
+        DescriptorLayoutBuilder builder;
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        builder.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        _reduce_layout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+    {
+        DescriptorLayoutBuilder builder;
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        _read_layout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+    }
+
+    std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+        {         VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1},
+    };
+    _descriptor_allocator.init(_device, 16, sizes);
+
+    /* 3 Create the reduction pipeline */
+
+    VkPushConstantRange push_constant{};
+    push_constant.offset     = 0;
+    push_constant.size       = sizeof(DepthReducePushConstants);
+    push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
+    layout_info.setLayoutCount             = 1;
+    layout_info.pSetLayouts                = &_reduce_layout;
+    layout_info.pushConstantRangeCount     = 1;
+    layout_info.pPushConstantRanges        = &push_constant;
+
+    VK_CHECK(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_pipeline_layout));
+
+    VkShaderModule reduce_shader;
+    if (!vkutil::load_shader_module("./Shaders/depth_reduce.comp.spv", _device, &reduce_shader))
+    {
+        fmt::print("Error when building the depth reduction compute shader\n");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipeline_info.layout = _pipeline_layout;
+    pipeline_info.stage  = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, reduce_shader);
+
+    VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_pipeline));
+
+    vkDestroyShaderModule(_device, reduce_shader, nullptr);
+}
+
+void DepthPyramid::destroy()
+{
+    destroy_targets();
+
+    _descriptor_allocator.destroy_pools(_device);
+
+    vkDestroyPipeline(_device, _pipeline, nullptr);
+    vkDestroyPipelineLayout(_device, _pipeline_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _reduce_layout, nullptr);
+    vkDestroyDescriptorSetLayout(_device, _read_layout, nullptr);
+    vkDestroySampler(_device, _min_sampler, nullptr);
+}
+
+void DepthPyramid::create_targets(VkImageView depth_view, VkExtent2D depth_extent)
+{
+    _depth_extent = depth_extent;
+    _extent       = {previous_pow2(depth_extent.width), previous_pow2(depth_extent.height)};
+    _built        = false;
+
+    uint32_t mip_count = (uint32_t)std::floor(std::log2(std::max(_extent.width, _extent.height))) + 1;
+
+    /* 1 Create the image with a view of every mip */
+
+    _image.image_format = VK_FORMAT_R32_SFLOAT;
+    _image.image_extent = {_extent.width, _extent.height, 1};
+
+    VkImageCreateInfo image_info = vkinit::image_create_info(
+        _image.image_format, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, _image.image_extent);
+    image_info.mipLevels = mip_count;
+
+    VmaAllocationCreateInfo alloc_info = {};
+    alloc_info.usage                   = VMA_MEMORY_USAGE_GPU_ONLY;
+    alloc_info.requiredFlags           = VkMemoryPropertyFlags(VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VK_CHECK(vmaCreateImage(_allocator, &image_info, &alloc_info, &_image.image, &_image.allocation, nullptr));
+
+    VkImageViewCreateInfo view_info =
+        vkinit::imageview_create_info(_image.image_format, _image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+    view_info.subresourceRange.levelCount = mip_count;
+
+    VK_CHECK(vkCreateImageView(_device, &view_info, nullptr, &_image.image_view));
+
+    _mip_views.resize(mip_count);
+    _debug_views.resize(mip_count);
+
+    for (uint32_t mip = 0; mip < mip_count; mip++)
+    {
+        VkImageViewCreateInfo mip_info =
+            vkinit::imageview_create_info(_image.image_format, _image.image, VK_IMAGE_ASPECT_COLOR_BIT);
+        mip_info.subresourceRange.baseMipLevel = mip;
+        mip_info.subresourceRange.levelCount   = 1;
+
+        VK_CHECK(vkCreateImageView(_device, &mip_info, nullptr, &_mip_views[mip]));
+
+        // storage views must not swizzle, so the debug display gets views of its own
+        mip_info.components = {VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R, VK_COMPONENT_SWIZZLE_R,
+                               VK_COMPONENT_SWIZZLE_ONE};
+
+        VK_CHECK(vkCreateImageView(_device, &mip_info, nullptr, &_debug_views[mip]));
+    }
+
+    /* 2 Write the descriptor sets; mip 0 is reduced from the depth image, every other mip from the one above */
+
+    _reduce_sets.resize(mip_count);
+
+    for (uint32_t mip = 0; mip < mip_count; mip++)
+    {
+        _reduce_sets[mip] = _descriptor_allocator.allocate(_device, _reduce_layout);
+
+        DescriptorWriter writer;
+        if (mip == 0)
+        {
+            writer.write_image(0,
+                               depth_view,
+                               _min_sampler,
+                               VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL,
+                               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        }
+        else
+        {
+            writer.write_image(0,
+                               _mip_views[mip - 1],
+                               _min_sampler,
+                               VK_IMAGE_LAYOUT_GENERAL,
+                               VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        }
+        writer.write_image(
+            1, _mip_views[mip], VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        writer.update_set(_device, _reduce_sets[mip]);
+    }
+
+    _read_set = _descriptor_allocator.allocate(_device, _read_layout);
+
+    DescriptorWriter writer;
+    writer.write_image(
+        0, _image.image_view, _min_sampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    writer.update_set(_device, _read_set);
+}
+
+void DepthPyramid::destroy_targets()
+{
+    if (_image.image == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    for (size_t mip = 0; mip < _mip_views.size(); mip++)
+    {
+        vkDestroyImageView(_device, _mip_views[mip], nullptr);
+        vkDestroyImageView(_device, _debug_views[mip], nullptr);
+    }
+    _mip_views.clear();
+    _debug_views.clear();
+
+    vkDestroyImageView(_device, _image.image_view, nullptr);
+    vmaDestroyImage(_allocator, _image.image, _image.allocation);
+    _image = {};
+
+    _descriptor_allocator.clear_pools(_device);
+    _reduce_sets.clear();
+    _read_set = VK_NULL_HANDLE;
+}
+
+void DepthPyramid::build(VkCommandBuffer cmd, VkExtent2D draw_extent)
+{
+    /* 1 Discard the previous contents once earlier readers of the pyramid are done */
+
+    VkImageMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+    barrier.srcStageMask     = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+    barrier.srcAccessMask    = VK_ACCESS_2_NONE;
+    barrier.dstStageMask     = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+    barrier.dstAccessMask    = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+    barrier.oldLayout        = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout        = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.image            = _image.image;
+    barrier.subresourceRange = vkinit::image_subresource_range(VK_IMAGE_ASPECT_COLOR_BIT);
+
+    VkDependencyInfo dependency{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency.imageMemoryBarrierCount = 1;
+    dependency.pImageMemoryBarriers    = &barrier;
+
+    vkCmdPipelineBarrier2(cmd, &dependency);
+
+    /* 2 Reduce each mip from the one above, waiting for its writes in between */
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline);
+
+    for (uint32_t mip = 0; mip < mip_count(); mip++)
+    {
+        uint32_t width  = std::max(1u, _extent.width >> mip);
+        uint32_t height = std::max(1u, _extent.height >> mip);
+
+        DepthReducePushConstants push_constants;
+        push_constants.dst_size  = glm::vec2(width, height);
+        push_constants.src_scale = glm::vec2(1.f);
+
+        if (mip == 0)
+        {
+            push_constants.src_scale = glm::vec2((float)draw_extent.width / _depth_extent.width,
+                                                 (float)draw_extent.height / _depth_extent.height);
+        }
+
+        vkCmdBindDescriptorSets(
+            cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _pipeline_layout, 0, 1, &_reduce_sets[mip], 0, nullptr);
+        vkCmdPushConstants(cmd,
+                           _pipeline_layout,
+                           VK_SHADER_STAGE_COMPUTE_BIT,
+                           0,
+                           sizeof(DepthReducePushConstants),
+                           &push_constants);
+        vkCmdDispatch(cmd,
+                      (width + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+                      (height + REDUCE_GROUP_SIZE - 1) / REDUCE_GROUP_SIZE,
+                      1);
+
+        // the last barrier also covers the culling pass and debug displays which sample the finished pyramid
+        bool last = mip + 1 == mip_count();
+
+        barrier.srcStageMask                  = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        barrier.srcAccessMask                 = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT;
+        barrier.dstStageMask                  = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+        barrier.dstAccessMask                 = VK_ACCESS_2_SHADER_SAMPLED_READ_BIT;
+        barrier.oldLayout                     = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout                     = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.subresourceRange.baseMipLevel = last ? 0 : mip;
+        barrier.subresourceRange.levelCount   = last ? VK_REMAINING_MIP_LEVELS : 1;
+
+        if (last)
+        {
+            barrier.dstStageMask |= VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT;
+        }
+
+        vkCmdPipelineBarrier2(cmd, &dependency);
+    }
+
+    _built = true;
+}
@@ -135,9 +135,13 @@ void DescriptorWriter::update_set(VkDevice device, VkDescriptorSet set)
     vkUpdateDescriptorSets(device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
 }
 
-void DescriptorAllocatorGrowable::init(VkDevice device, uint32_t max_sets, std::span<PoolSizeRatio> pool_ratios)
+void DescriptorAllocatorGrowable::init(VkDevice device,
+                                       uint32_t max_sets,
+                                       std::span<PoolSizeRatio> pool_ratios,
+                                       VkDescriptorPoolCreateFlags flags)
 {
     ratios.clear();
+    pool_flags = flags;
 
     for (auto r : pool_ratios)
     {
@@ -214,7 +218,7 @@ VkDescriptorPool DescriptorAllocatorGrowable::create_pool(VkDevice device,
 
     VkDescriptorPoolCreateInfo pool_info = {};
     pool_info.sType                      = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-    pool_info.flags                      = 0;
+    pool_info.flags                      = pool_flags;
     pool_info.maxSets                    = set_count;
     pool_info.poolSizeCount              = (uint32_t)pool_sizes.size();
     pool_info.pPoolSizes                 = pool_sizes.data();
@@ -20,6 +20,7 @@
 #include "imgui_impl_sdl3.h"
 #include "imgui_impl_vulkan.h"
 #include "gpbr/Util/imgui_util.h"
+#include "gpbr/Util/profiler.h"
 
 #define VMA_IMPLEMENTATION
 #define VMA_STATIC_VULKAN_FUNCTIONS 0
@@ -29,6 +30,11 @@
 #include <gpbr/Graphics/Vulkan/vk_pipelines.h>
 #include <gpbr/Graphics/Vulkan/vk_descriptors.h>
 #include <glm/gtx/transform.hpp>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include <filesystem>
+
 constexpr bool use_validation_layers = true;
 
 VulkanEngine* loaded_engine = nullptr;
@@ -58,50 +64,73 @@ void VulkanEngine::init()
     assert(loaded_engine == nullptr);
     loaded_engine = this;
 
-    /* 1 Initialize SDL & create the SDL window */
-    if (!SDL_Init(SDL_INIT_VIDEO))
+    util::profiler_set_thread_name("main");
+    GPBR_PROFILE_SCOPE("init");
+
+    /* 1 Initialize SDL & create the SDL window (skipped in headless mode) */
+    if (!_headless)
     {
-        fmt::println("Could not initialize SDL: {}", SDL_GetError());
-        return;
+        if (!SDL_Init(SDL_INIT_VIDEO))
+        {
+            fmt::println("Could not initialize SDL: {}", SDL_GetError());
+            return;
+        }
+
+        SDL_WindowFlags window_flags =
+            (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_MAXIMIZED | SDL_WINDOW_RESIZABLE);
+
+        _window = SDL_CreateWindow(_window_title.c_str(), _window_extent.width, _window_extent.height, window_flags);
+        SDL_SetWindowRelativeMouseMode(_window, true);
     }
 
-    SDL_WindowFlags window_flags = (SDL_WindowFlags)(SDL_WINDOW_VULKAN | SDL_WINDOW_MAXIMIZED | SDL_WINDOW_RESIZABLE);
+    /* 2 Start the worker threads */
 
-    _window = SDL_CreateWindow(_window_title.c_str(), _window_extent.width, _window_extent.height, window_flags);
-    SDL_SetWindowRelativeMouseMode(_window, true);
+    uint32_t worker_count = _worker_count;
+    if (worker_count == 0)
+    {
+        worker_count = std::max(std::thread::hardware_concurrency(), 1u) - 1;
+    }
+    _job_system = std::make_unique<util::JobSystem>(worker_count);
 
-    /* 2 Call each initialization method */
+    // GPU times arrive FRAME_OVERLAP frames late, so scale changes take that long to show up
+    _dynamic_resolution.settings.settle_frames = FRAME_OVERLAP + 1;
+
+    /* 3 Call each initialization method */
 
     init_vulkan();
 
     init_swapchain();
 
-    init_commands();
-
+    // the upload manager created with the command pools signals the device timeline
     init_sync_structures();
 
+    init_commands();
+
     init_descriptors();
 
     init_pipelines();
 
-    init_imgui();
+    if (!_headless)
+    {
+        init_imgui();
+    }
 
     init_default_data();
 
     _is_initialized = true;
 
-    /* 3 Initialize the camera */
+    /* 4 Initialize the camera */
 
     _main_camera.velocity = glm::vec3(0.f);
     _main_camera.position = glm::vec3(0.f, 1.76f, 10.f);
     _main_camera.pitch    = 0.f;
     _main_camera.yaw      = 0.f;
 
-    /* 4 Load a scene to explore */
+    /* 5 Load a scene to explore */
 
-    std::string prefix{".\\Assets\\"};
+    std::string prefix{"./Assets/"};
 
-    std::unordered_map<std::string, std::string> glTF_map{
+    _gltf_paths = {
         {"AlphaBlendModeTest",                prefix + "AlphaBlendModeTest.glb"},
         {              "Cube",                              prefix + "Cube.glb"},
         {    "Deccer Colored",           prefix + "SM_Deccer_Cubes_Colored.glb"},
@@ -112,11 +141,25 @@ void VulkanEngine::init()
         { "MetalRoughSpheres",                 prefix + "MetalRoughSpheres.glb"}
     };
 
-    std::string gltf_path{glTF_map["MetalRoughSpheres"]};
-    auto gltf_file = load_gltf(this, gltf_path);
-    assert(gltf_file.has_value());
+    bool scene_loaded = load_scene(_scene_name);
+    assert(scene_loaded);
+}
+
+bool VulkanEngine::load_scene(const std::string& name)
+{
+    // unknown names are treated as file paths
+    auto it               = _gltf_paths.find(name);
+    std::string gltf_path = (it != _gltf_paths.end()) ? it->second : name;
+    auto gltf_file        = load_gltf(this, gltf_path);
+
+    if (!gltf_file.has_value())
+    {
+        return false;
+    }
 
     _loaded_scenes["debug"] = *gltf_file;
+    _scene_name             = name;
+    return true;
 }
 
 void VulkanEngine::init_vulkan()
@@ -129,15 +172,20 @@ void VulkanEngine::init_vulkan()
                         .request_validation_layers(use_validation_layers) //
                         .use_default_debug_messenger()                    //
                         .require_api_version(1, 3, 0)                     //
+                        .set_headless(_headless)                          // no surface extensions
                         .build();
 
     vkb::Instance vkb_inst = inst_ret.value();
     _instance              = vkb_inst.instance;
     _debug_messenger       = vkb_inst.debug_messenger;
 
-    /* 2 Create a Vulkan rendering surface */
+    /* 2 Create a Vulkan rendering surface (skipped in headless mode) */
 
-    SDL_Vulkan_CreateSurface(_window, _instance, nullptr, &_surface);
+    _surface = VK_NULL_HANDLE;
+    if (!_headless)
+    {
+        SDL_Vulkan_CreateSurface(_window, _instance, nullptr, &_surface);
+    }
 
     /* 3 Specify features and extensions required of the physical device  */
 
@@ -153,12 +201,23 @@ void VulkanEngine::init_vulkan()
     features12.descriptorBindingVariableDescriptorCount = true;
     features12.runtimeDescriptorArray                   = true;
     features12.hostQueryReset                           = true;
+    features12.timelineSemaphore                        = true; // frame, upload and async compute synchronization
+    features12.drawIndirectCount                        = true; // GPU culling reads the draw counts from a buffer
+    features12.samplerFilterMinmax                      = true; // the depth pyramid is reduced by a min sampler
+
+    // new bindless slots are written while earlier frames using the set are still in flight
+    features12.descriptorBindingSampledImageUpdateAfterBind = true;
+    features12.descriptorBindingUpdateUnusedWhilePending    = true;
 
     VkPhysicalDeviceFeatures features{}; // 1.0 features
     features.fillModeNonSolid  = true;
     features.sampleRateShading = true;
     features.geometryShader    = true;
 
+    // indirect draws pack a whole material batch into one call and index their data with the first instance
+    features.multiDrawIndirect         = true;
+    features.drawIndirectFirstInstance = true;
+
     vkb::PhysicalDeviceSelector selector{vkb_inst};
 
     selector.add_required_extension("VK_KHR_dynamic_rendering");
@@ -167,14 +226,18 @@ void VulkanEngine::init_vulkan()
 
     /* 3.1 Create handles for a physical device and a logical device */
 
-    vkb::PhysicalDevice physical_device = selector                                  //
-                                              .set_minimum_version(1, 3)            //
-                                              .set_required_features_13(features13) //
-                                              .set_required_features_12(features12) //
-                                              .set_required_features(features)      //
-                                              .set_surface(_surface)                //
-                                              .select()                             //
-                                              .value();
+    selector.set_minimum_version(1, 3)            //
+        .set_required_features_13(features13)     //
+        .set_required_features_12(features12)     //
+        .set_required_features(features);
+
+    // a headless instance does not require presentation support
+    if (!_headless)
+    {
+        selector.set_surface(_surface);
+    }
+
+    vkb::PhysicalDevice physical_device = selector.select().value();
 
     vkb::DeviceBuilder device_builder{physical_device};
 
@@ -185,6 +248,16 @@ void VulkanEngine::init_vulkan()
 
     fmt::println("{}", physical_device.name);
 
+    _gpu_name             = physical_device.name;
+    _timestamp_period     = physical_device.properties.limits.timestampPeriod;
+    _min_buffer_alignment = std::max(physical_device.properties.limits.minUniformBufferOffsetAlignment,
+                                     physical_device.properties.limits.minStorageBufferOffsetAlignment);
+
+    if (!physical_device.properties.limits.timestampComputeAndGraphics)
+    {
+        fmt::println("Timestamp queries are not supported; GPU times will read as zero.");
+    }
+
     /* 4 Use Volk to dynamically load function entrypoints */
 
     volkInitialize();
@@ -225,6 +298,45 @@ void VulkanEngine::init_vulkan()
     _graphics_queue        = vkb_device.get_queue(vkb::QueueType::graphics).value();
     _graphics_queue_family = vkb_device.get_queue_index(vkb::QueueType::graphics).value();
 
+    _timestamp_valid_bits = physical_device.get_queue_families()[_graphics_queue_family].timestampValidBits;
+
+    /* 6.1 Obtain a compute queue from a separate family, or share the graphics queue */
+
+    // vk-bootstrap creates one queue of every family, so a separate compute queue is always available if it exists
+    auto compute_queue = vkb_device.get_queue(vkb::QueueType::compute);
+
+    if (_async_compute && compute_queue.has_value())
+    {
+        _compute_queue        = compute_queue.value();
+        _compute_queue_family = vkb_device.get_queue_index(vkb::QueueType::compute).value();
+    }
+    else
+    {
+        if (_async_compute)
+        {
+            fmt::println("No separate compute queue family; async compute work is submitted to the graphics queue.");
+        }
+        _compute_queue        = _graphics_queue;
+        _compute_queue_family = _graphics_queue_family;
+    }
+
+    _compute_timestamp_valid_bits = physical_device.get_queue_families()[_compute_queue_family].timestampValidBits;
+
+    /* 6.2 Obtain a transfer queue for uploads, or share the graphics queue */
+
+    auto transfer_queue = vkb_device.get_queue(vkb::QueueType::transfer);
+
+    if (transfer_queue.has_value())
+    {
+        _transfer_queue        = transfer_queue.value();
+        _transfer_queue_family = vkb_device.get_queue_index(vkb::QueueType::transfer).value();
+    }
+    else
+    {
+        _transfer_queue        = _graphics_queue;
+        _transfer_queue_family = _graphics_queue_family;
+    }
+
     /* 7 Bind Vulkan functions for VMA */
 
     // TODO: Find a more elegant solution
@@ -373,6 +485,22 @@ void VulkanEngine::resize_swapchain()
 
     create_swapchain(_window_extent.width, _window_extent.height);
 
+    // the GPU is idle, so the render targets can be replaced in place
+    if ((uint32_t)(_swapchain_extent.width * MAX_RENDER_SCALE) != _draw_image.image_extent.width ||
+        (uint32_t)(_swapchain_extent.height * MAX_RENDER_SCALE) != _draw_image.image_extent.height)
+    {
+        // the ImGui textures of the old depth pyramid are registered again when next displayed
+        for (VkDescriptorSet texture : _depth_pyramid_textures)
+        {
+            ImGui_ImplVulkan_RemoveTexture(texture);
+        }
+        _depth_pyramid_textures.clear();
+
+        destroy_render_targets();
+        create_render_targets(_swapchain_extent);
+        write_render_target_descriptors();
+    }
+
     _resize_requested = false;
 }
 
@@ -380,22 +508,28 @@ void VulkanEngine::cleanup()
 {
     if (_is_initialized)
     {
+        stop_game_thread();
+
         vkDeviceWaitIdle(_device);
 
+        _job_system.reset();
+
+        _cull_refs.clear();
+        _scene_objects.clear();
         _loaded_scenes.clear();
 
         _metal_rough_material.clear_resources(_device);
 
-        for (auto& frame : _frames)
-        {
-            frame._deletion_queue.flush();
-        }
+        _deferred_deletion.flush();
 
         _main_deletion_queue.flush();
 
-        destroy_swapchain();
+        if (!_headless)
+        {
+            destroy_swapchain();
 
-        vkDestroySurfaceKHR(_instance, _surface, nullptr);
+            vkDestroySurfaceKHR(_instance, _surface, nullptr);
+        }
 
         vmaDestroyAllocator(_allocator);
 
@@ -403,7 +537,10 @@ void VulkanEngine::cleanup()
         vkb::destroy_debug_utils_messenger(_instance, _debug_messenger, nullptr);
         vkDestroyInstance(_instance, nullptr);
 
-        SDL_DestroyWindow(_window);
+        if (!_headless)
+        {
+            SDL_DestroyWindow(_window);
+        }
     }
 
     loaded_engine = nullptr;
@@ -411,7 +548,68 @@ void VulkanEngine::cleanup()
 
 void VulkanEngine::draw_main(VkCommandBuffer cmd)
 {
-    draw_background(cmd);
+    GpuProfiler& profiler = get_current_frame()._gpu_profiler;
+
+    if (_async_compute)
+    {
+        // the compute queue rendered the background into this frame's background image
+        FrameData& frame = get_current_frame();
+
+        profiler.begin_scope(cmd, "background_copy");
+        if (_compute_queue_family != _graphics_queue_family)
+        {
+            vkutil::transfer_image_ownership(cmd,
+                                             frame._background_image.image,
+                                             VK_IMAGE_LAYOUT_GENERAL,
+                                             VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                             _compute_queue_family,
+                                             _graphics_queue_family,
+                                             false);
+        }
+        vkutil::transition_image(cmd, _draw_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+        vkutil::copy_image_to_image(cmd, frame._background_image.image, _draw_image.image, _draw_extent, _draw_extent);
+        vkutil::transition_image(cmd, _draw_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_GENERAL);
+        profiler.end_scope(cmd);
+    }
+    else
+    {
+        profiler.begin_scope(cmd, "background");
+        draw_background(cmd, _draw_image_descriptors);
+        profiler.end_scope(cmd);
+    }
+
+    const SceneSnapshot& snapshot = _scene_snapshots.read_buffer();
+
+    bool occlusion_culling = snapshot.gpu_culling && snapshot.occlusion_culling;
+
+    // the culling pass writes the indirect draws the geometry pass reads
+    _gpu_cull_list.clear();
+    if (snapshot.gpu_culling)
+    {
+        profiler.begin_scope(cmd, "cull");
+        cull_geometry(cmd);
+        profiler.end_scope(cmd);
+    }
+
+    auto start = std::chrono::system_clock::now();
+
+    // copy the scene data into this frame's transient ring
+    TransientRing& ring = get_current_frame()._transient_ring;
+
+    std::array<uint32_t, 2> dynamic_offsets = {ring.push(snapshot.scene_data), ring.push(snapshot.light_data)};
+
+    // the passes together draw each surface at most once, so this covers every indirect draw of the frame
+    if (_indirect_draws)
+    {
+        const DrawContext& draw_context = snapshot.draw_context;
+        reserve_indirect_draws(get_current_frame(),
+                               (uint32_t)(draw_context.opaque_surfaces.size() +
+                                          draw_context.transparent_surfaces.size() +
+                                          draw_context.mask_surfaces.size()));
+    }
+
+    // only textures registered since the last frame are written
+    flush_texture_updates();
 
     // setup to draw geometry
 
@@ -422,30 +620,76 @@ void VulkanEngine::draw_main(VkCommandBuffer cmd)
 
     VkRenderingInfo render_info = vkinit::rendering_info(_draw_extent, &color_attachment, &depth_attachment);
 
+    // the pass may then only contain vkCmdExecuteCommands
+    if (recording_thread_count() > 1)
+    {
+        render_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+    }
+
+    profiler.begin_scope(cmd, "geometry");
     vkCmdBeginRendering(cmd, &render_info);
 
-    auto start = std::chrono::system_clock::now();
+    GeometryPass pass = occlusion_culling ? GeometryPass::Early : GeometryPass::All;
+    DrawCounts counts = draw_geometry(cmd, dynamic_offsets, pass);
+
+    vkCmdEndRendering(cmd);
+    profiler.end_scope(cmd);
+
+    // with occlusion culling, the depth of the early pass is reduced into the pyramid, the remaining surfaces are
+    // culled against it, and the late pass draws those found visible on top of the early pass
+    if (occlusion_culling)
+    {
+        profiler.begin_scope(cmd, "occlusion");
+        vkutil::transition_image(
+            cmd, _depth_image.image, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL);
+        _depth_pyramid.build(cmd, _draw_extent);
+        _gpu_culler.cull_late(cmd, _frame_number % FRAME_OVERLAP);
+        vkutil::transition_image(
+            cmd, _depth_image.image, VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+        profiler.end_scope(cmd);
+
+        depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+
+        profiler.begin_scope(cmd, "geometry_late");
+        vkCmdBeginRendering(cmd, &render_info);
+
+        DrawCounts late_counts = draw_geometry(cmd, dynamic_offsets, GeometryPass::Late);
 
-    draw_geometry(cmd);
+        counts.draws += late_counts.draws;
+        counts.api_calls += late_counts.api_calls;
+        counts.triangles += late_counts.triangles;
+
+        vkCmdEndRendering(cmd);
+        profiler.end_scope(cmd);
+    }
 
     auto end     = std::chrono::system_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 
     stats.mesh_draw_time = elapsed.count() / 1000.f;
 
-    vkCmdEndRendering(cmd);
+    stats.drawcall_count = counts.draws;
+    stats.draw_api_calls = counts.api_calls;
+    stats.triangle_count = counts.triangles;
+
+    // what survives GPU culling is only known once a frame has finished, so the last totals read back stand in
+    if (snapshot.gpu_culling)
+    {
+        stats.drawcall_count += stats.gpu_cull.visible;
+        stats.triangle_count += stats.gpu_cull.visible_triangles;
+    }
 }
 
-void VulkanEngine::draw_background(VkCommandBuffer cmd)
+void VulkanEngine::draw_background(VkCommandBuffer cmd, VkDescriptorSet target_descriptors)
 {
     ComputeEffect& effect = background_effects[current_background_effect];
 
     // bind the background compute pipeline
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, effect.pipeline);
 
-    // bind the descriptor set containing the draw image for the compute pipeline
+    // bind the descriptor set containing the target image for the compute pipeline
     vkCmdBindDescriptorSets(
-        cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _gradient_pipeline_layout, 0, 1, &_draw_image_descriptors, 0, nullptr);
+        cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _gradient_pipeline_layout, 0, 1, &target_descriptors, 0, nullptr);
 
     vkCmdPushConstants(
         cmd, _gradient_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ComputePushConstants), &effect.data);
@@ -454,6 +698,63 @@ void VulkanEngine::draw_background(VkCommandBuffer cmd)
     vkCmdDispatch(cmd, std::ceil(_draw_extent.width / 16.0), std::ceil(_draw_extent.height / 16.0), 1);
 }
 
+VkSemaphoreSubmitInfo VulkanEngine::submit_async_compute(FrameData& frame)
+{
+    /* 1 Record the background effect into the frame's background image */
+
+    VK_CHECK(vkResetCommandBuffer(frame._compute_command_buffer, 0));
+
+    VkCommandBuffer cmd = frame._compute_command_buffer;
+
+    VkCommandBufferBeginInfo cmd_begin_info =
+        vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+
+    frame._compute_profiler.begin_scope(cmd, "background");
+
+    // the previous contents are discarded, so the image needs no ownership transfer back from the graphics queue
+    vkutil::transition_image(cmd, frame._background_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+    draw_background(cmd, frame._background_descriptors);
+
+    /* 2 Hand the image to the graphics queue in the layout its copy reads */
+
+    if (_compute_queue_family != _graphics_queue_family)
+    {
+        vkutil::transfer_image_ownership(cmd,
+                                         frame._background_image.image,
+                                         VK_IMAGE_LAYOUT_GENERAL,
+                                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                         _compute_queue_family,
+                                         _graphics_queue_family,
+                                         true);
+    }
+    else
+    {
+        vkutil::transition_image(
+            cmd, frame._background_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+    }
+
+    frame._compute_profiler.end_scope(cmd);
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    /* 3 Submit, signalling the next point on the compute queue's timeline */
+
+    // the frame's timeline point covers reuse of the command buffer and image: its graphics submission waited on this
+    TimelinePoint background_done = _timeline.next(QueueType::Compute);
+
+    VkCommandBufferSubmitInfo cmd_info = vkinit::command_buffer_submit_info(cmd);
+    VkSemaphoreSubmitInfo signal_info  = _timeline.signal_info(background_done);
+
+    VkSubmitInfo2 submit = vkinit::submit_info(&cmd_info, &signal_info, nullptr);
+
+    VK_CHECK(vkQueueSubmit2(_compute_queue, 1, &submit, VK_NULL_HANDLE));
+
+    // the whole graphics frame depends on the background, while the previous frame's graphics work is unaffected
+    return _timeline.wait_info(background_done);
+}
+
 // Culling algorithm from vkguide.dev tutorial; deprecated
 bool is_visible(const RenderObject& obj, const glm::mat4& viewproj)
 {
@@ -498,7 +799,8 @@ bool is_visible(const RenderObject& obj, const glm::mat4& viewproj)
     }
 }
 
-// TODO: Ensure objects are not pre-maturely truncated when close to the camera or near the edge of the screen.
+// Tests the corners of the object-space box against the world-space planes of camera.frustum after projecting them,
+// which culls objects close to the camera or near the edge of the screen too early. Superseded by cull_bounds().
 
 // Returns true if object is partially/totally in the frustum. Otherwise returns false.
 bool in_frustum(const RenderObject& obj, const glm::mat4& viewproj, const Camera& camera)
@@ -562,29 +864,87 @@ bool in_frustum(const RenderObject& obj, const glm::mat4& viewproj, const Camera
     return true;
 }
 
-void VulkanEngine::draw_geometry(VkCommandBuffer cmd)
+void VulkanEngine::cull_and_sort(const DrawRefs& objects, DrawContext& draws, bool gpu_culling)
 {
+    util::ProfileZone phase{"cull"};
+
+    const std::vector<const RenderObject*>& opaque_surfaces      = objects.opaque_surfaces;
+    const std::vector<const RenderObject*>& mask_surfaces        = objects.mask_surfaces;
+    const std::vector<const RenderObject*>& transparent_surfaces = objects.transparent_surfaces;
+
+    // the lists are culled as one range: opaque, then masked, then transparent surfaces. With GPU culling only the
+    // transparent ones are; the culling pass discards the invisible opaque and masked surfaces each frame instead
+    uint32_t opaque_count = (uint32_t)opaque_surfaces.size();
+    uint32_t mask_end     = opaque_count + (uint32_t)mask_surfaces.size();
+    uint32_t total_count  = mask_end + (uint32_t)transparent_surfaces.size();
+    uint32_t cull_begin   = gpu_culling ? mask_end : 0;
+
+    auto surface = [&](uint32_t i) -> const RenderObject&
+    {
+        if (i < opaque_count)
+        {
+            return *opaque_surfaces[i];
+        }
+        return (i < mask_end) ? *mask_surfaces[i - opaque_count] : *transparent_surfaces[i - mask_end];
+    };
+
+    std::vector<uint8_t> visible(total_count, 1);
+
+    // each batch gathers its surfaces' cached world-space bounds into the arrays, then culls them several at a time
+    FrustumPlanes planes = frustum_planes(_scene_data.view_proj);
+    _cull_bounds.resize(total_count);
+
+    _job_system->parallel_for(total_count - cull_begin,
+                              CULL_BATCH_SIZE,
+                              [&](uint32_t begin, uint32_t end, uint32_t thread_index)
+                              {
+                                  GPBR_PROFILE_SCOPE("cull batch");
+                                  begin += cull_begin;
+                                  end += cull_begin;
+
+                                  for (uint32_t i = begin; i < end; i++)
+                                  {
+                                      _cull_bounds.set(i, surface(i).world_bounds);
+                                  }
+                                  cull_bounds(_cull_bounds, planes, begin, end, visible.data());
+                              });
+
     std::vector<uint32_t> opaque_draws;
-    opaque_draws.reserve(_main_draw_context.opaque_surfaces.size());
+    opaque_draws.reserve(opaque_count);
 
-    for (uint32_t i = 0; i < _main_draw_context.opaque_surfaces.size(); i++)
+    for (uint32_t i = 0; i < opaque_count; i++)
     {
-        if (in_frustum(_main_draw_context.opaque_surfaces[i], _scene_data.view_proj, _main_camera))
+        if (visible[i])
         {
             opaque_draws.push_back(i);
         }
     }
 
-    // sort the opaque surfaces by material and mesh
-    std::sort(opaque_draws.begin(),
-              opaque_draws.end(),
-              [&](const auto& iA, const auto& iB)
+    // sort the opaque surfaces by material and mesh. The keys are gathered up front so the sort compares
+    // contiguous values instead of chasing each render object.
+    phase.next("sort");
+
+    std::vector<DrawSortKey> sort_keys(opaque_draws.size());
+
+    _job_system->parallel_for((uint32_t)opaque_draws.size(),
+                              CULL_BATCH_SIZE,
+                              [&](uint32_t begin, uint32_t end, uint32_t thread_index)
+                              {
+                                  for (uint32_t i = begin; i < end; i++)
+                                  {
+                                      const RenderObject& r = *opaque_surfaces[opaque_draws[i]];
+                                      sort_keys[i]          = {(uintptr_t)r.material, r.first_index, i};
+                                  }
+                              });
+
+    std::sort(sort_keys.begin(),
+              sort_keys.end(),
+              [](const DrawSortKey& A, const DrawSortKey& B)
               {
-                  const RenderObject& A = _main_draw_context.opaque_surfaces[iA];
-                  const RenderObject& B = _main_draw_context.opaque_surfaces[iB];
+                  // ties keep their scene order, so an unchanged scene sorts the same way every tick
                   if (A.material == B.material)
                   {
-                      return A.index_buffer < B.index_buffer;
+                      return A.mesh == B.mesh ? A.draw < B.draw : A.mesh < B.mesh;
                   }
                   else
                   {
@@ -592,64 +952,281 @@ void VulkanEngine::draw_geometry(VkCommandBuffer cmd)
                   }
               });
 
-    // allocate a new uniform buffer for the scene data
-    AllocatedBuffer gpuSceneDataBuffer =
-        create_buffer(sizeof(GPUSceneData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
+    phase.next("copy draws");
 
-    // add it to the deletion queue of this frame so it gets deleted once its been used
-    get_current_frame()._deletion_queue.push_function([=, this]() { destroy_buffer(gpuSceneDataBuffer); });
+    draws.opaque_surfaces.clear();
+    draws.opaque_surfaces.reserve(sort_keys.size());
 
-    // write the buffer
-    GPUSceneData* sceneUniformData = (GPUSceneData*)gpuSceneDataBuffer.allocation->GetMappedData();
-    *sceneUniformData              = _scene_data;
+    for (const DrawSortKey& key : sort_keys)
+    {
+        draws.opaque_surfaces.push_back(*opaque_surfaces[opaque_draws[key.draw]]);
+    }
 
-    VkDescriptorSetVariableDescriptorCountAllocateInfo alloc_array_info{
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO, .pNext = nullptr};
+    // the remaining lists keep their scene order
+    draws.mask_surfaces.clear();
+    draws.transparent_surfaces.clear();
 
-    uint32_t descriptor_counts          = _texture_cache.cache.size();
-    alloc_array_info.pDescriptorCounts  = &descriptor_counts;
-    alloc_array_info.descriptorSetCount = 1;
+    for (uint32_t i = opaque_count; i < total_count; i++)
+    {
+        if (visible[i])
+        {
+            std::vector<RenderObject>& list = (i < mask_end) ? draws.mask_surfaces : draws.transparent_surfaces;
+            list.push_back(surface(i));
+        }
+    }
+}
 
-    // create a descriptor set that binds that buffer and update it
-    VkDescriptorSet globalDescriptor =
-        get_current_frame()._frame_descriptors.allocate(_device, _gpu_scene_data_descriptor_layout, &alloc_array_info);
+void VulkanEngine::cull_geometry(VkCommandBuffer cmd)
+{
+    const SceneSnapshot& snapshot   = _scene_snapshots.read_buffer();
+    const DrawContext& draw_context = snapshot.draw_context;
 
-    DescriptorWriter writer;
-    writer.write_buffer(0, gpuSceneDataBuffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    // opaque surfaces in sorted order, followed by masked surfaces
+    _gpu_cull_list.reserve(draw_context.opaque_surfaces.size() + draw_context.mask_surfaces.size());
+
+    for (const RenderObject& r : draw_context.opaque_surfaces)
+    {
+        _gpu_cull_list.push_back(&r);
+    }
+    for (const RenderObject& r : draw_context.mask_surfaces)
+    {
+        _gpu_cull_list.push_back(&r);
+    }
+
+    CullView view;
+    view.view           = snapshot.scene_data.view;
+    view.projection     = snapshot.scene_data.proj;
+    view.znear          = snapshot.camera.near;
+    view.occlusion      = snapshot.occlusion_culling;
+    view.pyramid_extent = _depth_pyramid.extent();
+
+    _gpu_culler.cull(cmd, _gpu_cull_list, view, _depth_pyramid.read_set(), _frame_number % FRAME_OVERLAP);
+}
+
+DrawCounts VulkanEngine::draw_geometry(VkCommandBuffer cmd,
+                                       std::span<const uint32_t> dynamic_offsets,
+                                       GeometryPass pass)
+{
+    const SceneSnapshot& snapshot   = _scene_snapshots.read_buffer();
+    const DrawContext& draw_context = snapshot.draw_context;
+
+    util::ProfileZone phase{"build draw list"};
+
+    // opaque surfaces in sorted order, followed by transparent and masked surfaces. The GPU-culled surfaces are
+    // drawn before all of them, and transparent surfaces wait for the late pass
+    bool gpu_culling = snapshot.gpu_culling;
+
+    std::vector<const RenderObject*> draw_list;
+    draw_list.reserve(draw_context.opaque_surfaces.size() + draw_context.transparent_surfaces.size() +
+                      draw_context.mask_surfaces.size());
+
+    if (!gpu_culling)
+    {
+        for (const RenderObject& r : draw_context.opaque_surfaces)
+        {
+            draw_list.push_back(&r);
+        }
+    }
+    if (pass != GeometryPass::Early)
+    {
+        for (const RenderObject& r : draw_context.transparent_surfaces)
+        {
+            draw_list.push_back(&r);
+        }
+    }
+    if (!gpu_culling)
+    {
+        for (const RenderObject& r : draw_context.mask_surfaces)
+        {
+            draw_list.push_back(&r);
+        }
+    }
+
+    // the culling pass has written the commands of its survivors and the per-draw data of all of its instances. Each
+    // phase has its own commands and counts
+    CullPhase cull_phase = (pass == GeometryPass::Late) ? CullPhase::Late : CullPhase::Early;
+
+    IndirectDrawBuffers culled_buffers{};
+    culled_buffers.command_buffer    = _gpu_culler.command_buffer();
+    culled_buffers.commands_offset   = _gpu_culler.commands_offset(cull_phase);
+    culled_buffers.draw_data_address = _gpu_culler.draw_data_address();
+    culled_buffers.count_buffer      = _gpu_culler.count_buffer();
+    culled_buffers.counts_offset     = _gpu_culler.counts_offset(cull_phase);
+    culled_buffers.batches           = _gpu_culler.batches().data();
+    culled_buffers.draw_batches      = _gpu_culler.draw_batches().data();
+
+    // indirect commands and per-draw data are written into the frame's storage while recording, one entry per draw.
+    // Without room for them, the pass draws directly
+    IndirectDrawStorage& storage = get_current_frame()._indirect_storage;
+    IndirectDrawBuffers indirect_buffers{};
+    const IndirectDrawBuffers* indirect = nullptr;
+
+    if (_indirect_draws && !draw_list.empty() && storage.used + draw_list.size() <= storage.capacity)
+    {
+        uint32_t first = storage.used;
+        storage.used += (uint32_t)draw_list.size();
 
-    // Create a buffer for the light data
-    AllocatedBuffer gpu_light_data_buffer =
-        create_buffer(sizeof(GPULightData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-    get_current_frame()._deletion_queue.push_function([=, this]() { destroy_buffer(gpu_light_data_buffer); });
+        uint8_t* mapped = (uint8_t*)storage.buffer.info.pMappedData;
 
-    // Write the buffer
-    GPULightData* light_uniform_data = (GPULightData*)gpu_light_data_buffer.allocation->GetMappedData();
-    *light_uniform_data              = _light_data;
+        indirect_buffers.commands          = (VkDrawIndexedIndirectCommand*)mapped + first;
+        indirect_buffers.command_buffer    = storage.buffer.buffer;
+        indirect_buffers.commands_offset   = (VkDeviceSize)first * sizeof(VkDrawIndexedIndirectCommand);
+        indirect_buffers.draw_data         = (GPUDrawData*)(mapped + storage.draw_data_offset()) + first;
+        indirect_buffers.draw_data_address = storage.address + storage.draw_data_offset() + first * sizeof(GPUDrawData);
 
-    writer.write_buffer(1, gpu_light_data_buffer.buffer, sizeof(GPULightData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        indirect = &indirect_buffers;
+    }
+
+    phase.next("record draws");
+
+    uint32_t thread_count = recording_thread_count();
+
+    DrawCounts counts;
+
+    if (thread_count <= 1)
+    {
+        if (!_gpu_cull_list.empty())
+        {
+            record_draws(cmd, _gpu_cull_list, dynamic_offsets, &culled_buffers, 0, counts);
+        }
+        record_draws(cmd, draw_list, dynamic_offsets, indirect, 0, counts);
+    }
+    else
+    {
+        // every chunk rebinds its state, so tiny chunks cost more than they save
+        uint32_t chunk_count = (uint32_t)std::clamp<size_t>(draw_list.size() / MIN_DRAWS_PER_CHUNK, 1, thread_count);
+        size_t chunk_size    = (draw_list.size() + chunk_count - 1) / chunk_count;
+
+        std::vector<VkCommandBuffer> secondaries(chunk_count);
+        std::vector<DrawCounts> chunk_counts(chunk_count);
+
+        FrameData& frame = get_current_frame();
+
+        // the GPU-culled draws take one call per batch, so they are recorded on this thread ahead of the chunks.
+        // Thread 0 is this thread, whose jobs have not started yet
+        if (!_gpu_cull_list.empty())
+        {
+            VkCommandBuffer secondary = begin_secondary_command_buffer(frame._recording_contexts[0]);
+
+            record_draws(secondary, _gpu_cull_list, dynamic_offsets, &culled_buffers, 0, chunk_counts.emplace_back());
+
+            VK_CHECK(vkEndCommandBuffer(secondary));
+            secondaries.insert(secondaries.begin(), secondary);
+        }
+
+        // one job per chunk, so no more than chunk_count threads record at once
+        _job_system->parallel_for(
+            chunk_count,
+            1,
+            [&](uint32_t chunk, uint32_t, uint32_t thread_index)
+            {
+                GPBR_PROFILE_SCOPE("record chunk");
+
+                size_t first = std::min(chunk * chunk_size, draw_list.size());
+                size_t last  = std::min(first + chunk_size, draw_list.size());
+
+                VkCommandBuffer secondary = begin_secondary_command_buffer(frame._recording_contexts[thread_index]);
+
+                record_draws(secondary,
+                             std::span(draw_list).subspan(first, last - first),
+                             dynamic_offsets,
+                             indirect,
+                             (uint32_t)first,
+                             chunk_counts[chunk]);
+
+                VK_CHECK(vkEndCommandBuffer(secondary));
+                secondaries[secondaries.size() - chunk_count + chunk] = secondary;
+            });
+
+        // chunks execute in submission order, preserving the sorted draw order
+        vkCmdExecuteCommands(cmd, (uint32_t)secondaries.size(), secondaries.data());
+
+        for (const DrawCounts& chunk : chunk_counts)
+        {
+            counts.draws += chunk.draws;
+            counts.api_calls += chunk.api_calls;
+            counts.triangles += chunk.triangles;
+        }
+    }
+
+    return counts;
+}
 
-    if (_texture_cache.cache.size() > 0)
+bool VulkanEngine::reserve_indirect_draws(FrameData& frame, uint32_t draw_count)
+{
+    IndirectDrawStorage& storage = frame._indirect_storage;
+
+    if (draw_count <= storage.capacity)
+    {
+        return true;
+    }
+    if (storage.failed_count != 0 && draw_count >= storage.failed_count)
+    {
+        return false;
+    }
+
+    /* 1 Create a buffer with room to spare, so a growing scene does not replace it every frame */
+
+    IndirectDrawStorage grown;
+    grown.capacity = std::max(draw_count, storage.capacity * 2);
+
+    VkBufferCreateInfo buffer_info = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size               = grown.draw_data_offset() + (VkDeviceSize)grown.capacity * sizeof(GPUDrawData);
+    buffer_info.usage              = VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                     VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+    VmaAllocationCreateInfo vma_alloc_info = {};
+    vma_alloc_info.usage                   = VMA_MEMORY_USAGE_CPU_TO_GPU;
+    vma_alloc_info.flags                   = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    VkResult result = vmaCreateBuffer(_allocator,
+                                      &buffer_info,
+                                      &vma_alloc_info,
+                                      &grown.buffer.buffer,
+                                      &grown.buffer.allocation,
+                                      &grown.buffer.info);
+    if (result != VK_SUCCESS)
     {
-        VkWriteDescriptorSet array_set{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-        array_set.descriptorCount = _texture_cache.cache.size();
-        array_set.dstArrayElement = 0;
-        array_set.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        array_set.dstBinding      = 2;
-        array_set.pImageInfo      = _texture_cache.cache.data();
-        writer.writes.push_back(array_set);
+        fmt::println("Failed to allocate indirect draws for {} surfaces; drawing them directly", draw_count);
+        storage.failed_count = draw_count;
+        return false;
     }
 
-    writer.update_set(_device, globalDescriptor);
+    /* 2 Replace the old buffer, which the frame's previous submission has finished with */
+
+    VkBufferDeviceAddressInfo address_info{.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                                           .buffer = grown.buffer.buffer};
+    grown.address = vkGetBufferDeviceAddress(_device, &address_info);
+    grown.used    = storage.used;
+
+    destroy_buffer(storage.buffer);
+    storage = grown;
+
+    return true;
+}
 
+void VulkanEngine::record_draws(VkCommandBuffer cmd,
+                                std::span<const RenderObject* const> draws,
+                                std::span<const uint32_t> dynamic_offsets,
+                                const IndirectDrawBuffers* indirect,
+                                uint32_t first_draw,
+                                DrawCounts& counts)
+{
     MaterialPipeline* lastPipeline = nullptr;
     MaterialInstance* lastMaterial = nullptr;
-    VkBuffer lastIndexBuffer       = VK_NULL_HANDLE;
+    size_t batch_start             = 0; // First draw sharing the current material.
+
+    // every mesh lives in the geometry arena, so its buffers are bound once
+    vkCmdBindIndexBuffer(cmd, _geometry.index_buffer(), 0, VK_INDEX_TYPE_UINT32);
 
-    auto draw = [&](const RenderObject& r)
+    for (size_t i = 0; i < draws.size(); i++)
     {
+        const RenderObject& r = *draws[i];
+
         if (r.material != lastMaterial)
         {
             lastMaterial = r.material;
+            batch_start  = i;
             if (r.material->pipeline != lastPipeline)
             {
                 lastPipeline = r.material->pipeline;
@@ -660,7 +1237,16 @@ void VulkanEngine::draw_geometry(VkCommandBuffer cmd)
                                         r.material->pipeline->layout,
                                         0,
                                         1,
-                                        &globalDescriptor,
+                                        &_global_descriptor_set,
+                                        (uint32_t)dynamic_offsets.size(),
+                                        dynamic_offsets.data());
+                // Descriptor Set #2 bindless textures
+                vkCmdBindDescriptorSets(cmd,
+                                        VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                        r.material->pipeline->layout,
+                                        2,
+                                        1,
+                                        &_bindless_texture_set,
                                         0,
                                         nullptr);
 
@@ -681,6 +1267,22 @@ void VulkanEngine::draw_geometry(VkCommandBuffer cmd)
                 scissor.extent.height = _draw_extent.height;
 
                 vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+                // indirect draws find their matrices through the push constants, which stay the same for every draw
+                if (indirect != nullptr)
+                {
+                    GPUDrawPushConstants push_constants{};
+                    push_constants.vertex_buffer_address = _geometry.vertex_buffer_address();
+                    push_constants.draw_data_address     = indirect->draw_data_address;
+                    push_constants.indirect              = 1;
+
+                    vkCmdPushConstants(cmd,
+                                       r.material->pipeline->layout,
+                                       VK_SHADER_STAGE_VERTEX_BIT,
+                                       0,
+                                       sizeof(GPUDrawPushConstants),
+                                       &push_constants);
+                }
             }
 
             // Descriptor set #1 containing material data (GLTFMaterialData)
@@ -693,51 +1295,153 @@ void VulkanEngine::draw_geometry(VkCommandBuffer cmd)
                                     0,
                                     nullptr);
         }
-        if (r.index_buffer != lastIndexBuffer)
+
+        // the culling pass has counted and written the batch's visible draws
+        if (indirect != nullptr && indirect->count_buffer != VK_NULL_HANDLE)
+        {
+            uint32_t draw          = first_draw + (uint32_t)i;
+            uint32_t batch_index   = indirect->draw_batches[draw];
+            const CullBatch& batch = indirect->batches[batch_index];
+
+            if (batch.first == draw)
+            {
+                vkCmdDrawIndexedIndirectCount(cmd,
+                                              indirect->command_buffer,
+                                              indirect->commands_offset +
+                                                  batch.first * sizeof(VkDrawIndexedIndirectCommand),
+                                              indirect->count_buffer,
+                                              indirect->counts_offset + batch_index * sizeof(uint32_t),
+                                              batch.count,
+                                              sizeof(VkDrawIndexedIndirectCommand));
+                counts.api_calls++;
+            }
+            continue;
+        }
+
+        counts.draws++;
+        counts.triangles += r.index_count / 3;
+
+        if (indirect == nullptr)
         {
-            lastIndexBuffer = r.index_buffer;
-            vkCmdBindIndexBuffer(cmd, r.index_buffer, 0, VK_INDEX_TYPE_UINT32);
+            // calculate final mesh matrix
+            GPUDrawPushConstants push_constants{};
+            push_constants.world_matrix          = r.transform;
+            push_constants.vertex_buffer_address = _geometry.vertex_buffer_address();
+
+            vkCmdPushConstants(cmd,
+                               r.material->pipeline->layout,
+                               VK_SHADER_STAGE_VERTEX_BIT,
+                               0,
+                               sizeof(GPUDrawPushConstants),
+                               &push_constants);
+
+            vkCmdDrawIndexed(cmd, r.index_count, 1, r.first_index, r.vertex_offset, 0);
+            counts.api_calls++;
+            continue;
         }
 
-        // calculate final mesh matrix
-        GPUDrawPushConstants push_constants;
-        push_constants.world_matrix          = r.transform;
-        push_constants.vertex_buffer_address = r.vertex_buffer_address;
+        // the draw's index doubles as its instance index, which the vertex shader reads its data at
+        uint32_t draw = first_draw + (uint32_t)i;
 
-        vkCmdPushConstants(cmd,
-                           r.material->pipeline->layout,
-                           VK_SHADER_STAGE_VERTEX_BIT,
-                           0,
-                           sizeof(GPUDrawPushConstants),
-                           &push_constants);
+        indirect->draw_data[draw].world_matrix = r.transform;
 
-        stats.drawcall_count++;
-        stats.triangle_count += r.index_count / 3;
+        VkDrawIndexedIndirectCommand& command = indirect->commands[draw];
+        command.indexCount                    = r.index_count;
+        command.instanceCount                 = 1;
+        command.firstIndex                    = r.first_index;
+        command.vertexOffset                  = r.vertex_offset;
+        command.firstInstance                 = draw;
 
-        vkCmdDrawIndexed(cmd, r.index_count, 1, r.first_index, 0, 0);
-    };
+        // one call per run of draws sharing a material
+        if (i + 1 == draws.size() || draws[i + 1]->material != r.material)
+        {
+            vkCmdDrawIndexedIndirect(cmd,
+                                     indirect->command_buffer,
+                                     indirect->commands_offset +
+                                         (first_draw + batch_start) * sizeof(VkDrawIndexedIndirectCommand),
+                                     (uint32_t)(i + 1 - batch_start),
+                                     sizeof(VkDrawIndexedIndirectCommand));
+            counts.api_calls++;
+        }
+    }
+}
+
+VkCommandBuffer VulkanEngine::begin_secondary_command_buffer(RecordingContext& context)
+{
+    if (context.used == context.buffers.size())
+    {
+        VkCommandBufferAllocateInfo alloc_info =
+            vkinit::command_buffer_allocate_info(context.pool, 1, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+        VK_CHECK(vkAllocateCommandBuffers(_device, &alloc_info, &context.buffers.emplace_back()));
+    }
+
+    VkCommandBuffer cmd = context.buffers[context.used++];
 
-    stats.drawcall_count = 0;
-    stats.triangle_count = 0;
+    // must match the attachments of the rendering pass begun in draw_main()
+    VkCommandBufferInheritanceRenderingInfo inheritance_rendering{
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+    inheritance_rendering.colorAttachmentCount    = 1;
+    inheritance_rendering.pColorAttachmentFormats = &_draw_image.image_format;
+    inheritance_rendering.depthAttachmentFormat   = _depth_image.image_format;
+    inheritance_rendering.rasterizationSamples    = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritance{.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+                                               .pNext = &inheritance_rendering};
+
+    VkCommandBufferBeginInfo begin_info = vkinit::command_buffer_begin_info(
+        VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT);
+    begin_info.pInheritanceInfo = &inheritance;
+
+    VK_CHECK(vkBeginCommandBuffer(cmd, &begin_info));
+
+    return cmd;
+}
+
+uint32_t VulkanEngine::recording_thread_count() const
+{
+    return std::clamp<uint32_t>(_record_threads, 1, _job_system->thread_count());
+}
 
-    for (auto& r : opaque_draws)
+void VulkanEngine::reset_recording_contexts(FrameData& frame)
+{
+    for (RecordingContext& context : frame._recording_contexts)
     {
-        draw(_main_draw_context.opaque_surfaces[r]);
+        if (context.used > 0)
+        {
+            VK_CHECK(vkResetCommandPool(_device, context.pool, 0));
+            context.used = 0;
+        }
     }
+}
+
+void VulkanEngine::flush_texture_updates()
+{
+    std::vector<uint32_t>& pending = _texture_cache.pending;
 
-    for (auto& r : _main_draw_context.transparent_surfaces)
+    if (pending.empty())
     {
-        draw(r);
+        return;
     }
 
-    for (auto& r : _main_draw_context.mask_surfaces)
+    std::vector<VkWriteDescriptorSet> writes;
+    writes.reserve(pending.size());
+
+    for (uint32_t index : pending)
     {
-        draw(r);
+        VkWriteDescriptorSet write{.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+        write.dstSet          = _bindless_texture_set;
+        write.dstBinding      = 0;
+        write.dstArrayElement = index;
+        write.descriptorCount = 1;
+        write.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        write.pImageInfo      = &_texture_cache.cache[index];
+        writes.push_back(write);
     }
 
-    _main_draw_context.opaque_surfaces.clear();
-    _main_draw_context.transparent_surfaces.clear();
-    _main_draw_context.mask_surfaces.clear();
+    vkUpdateDescriptorSets(_device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+    pending.clear();
 }
 
 void VulkanEngine::draw_imgui(VkCommandBuffer cmd, VkImageView target_image_view)
@@ -755,9 +1459,22 @@ void VulkanEngine::draw_imgui(VkCommandBuffer cmd, VkImageView target_image_view
 
 void VulkanEngine::update_scene()
 {
+    GPBR_PROFILE_SCOPE("update_scene");
+
     auto start = std::chrono::system_clock::now();
 
-    _main_camera.aspect = (float)_draw_extent.width / (float)_draw_extent.height;
+    // take the input gathered on the main thread since the last tick
+    {
+        std::lock_guard<std::mutex> lock(_input_mutex);
+        _main_camera.input = _pending_input;
+
+        _pending_input.yaw_target   = 0.f;
+        _pending_input.pitch_target = 0.f;
+    }
+
+    float aspect = _scene_aspect.load(std::memory_order_relaxed);
+
+    _main_camera.aspect = aspect;
     _main_camera.update();
 
     _light_data.position  = glm::vec3(0.f, 25.f, 25.f);
@@ -766,8 +1483,7 @@ void VulkanEngine::update_scene()
     _light_data.type      = (uint32_t)LightType::Point;
 
     glm::mat4 view       = _main_camera.view_mat;
-    glm::mat4 projection = glm::perspective(
-        _main_camera.fovy, (float)_draw_extent.width / (float)_draw_extent.height, _main_camera.far, _main_camera.near);
+    glm::mat4 projection = glm::perspective(_main_camera.fovy, aspect, _main_camera.far, _main_camera.near);
 
     // invert the Y direction on projection matrix to match glTF axis
     projection[1][1] *= -1;
@@ -782,30 +1498,128 @@ void VulkanEngine::update_scene()
     _scene_data.sunlight_color     = glm::vec4(1.f, 1.f, 1.f, 1.0f);
     _scene_data.sunlight_direction = glm::vec4(1.5f, 1.f, 0.5f, 1.f);
 
-    glm::mat4 transf{1.f};
+    // the render objects persist between ticks; only those of moved surfaces are updated
+    LoadedGLTF& scene = *_loaded_scenes["debug"];
+    _scene_objects.update(scene);
+
+    bool gpu_culling = _gpu_culling.load(std::memory_order_relaxed);
+
+    // the GPU culls from the full list of instances; without it, the scene's BVH skips the subtrees outside the frustum
+    const DrawRefs* objects = &_scene_objects.refs;
+
+    if (!gpu_culling)
+    {
+        _candidate_surfaces.clear();
+        scene.query_visible(frustum_planes(_scene_data.view_proj), _candidate_surfaces);
+
+        _cull_refs.clear();
+        for (uint32_t i : _candidate_surfaces)
+        {
+            _cull_refs.add(_scene_objects.objects[i]);
+        }
+        objects = &_cull_refs;
+    }
+
+    /* Fill and publish the snapshot */
 
-    transf = glm::scale(transf, glm::vec3(1.f));
+    SceneSnapshot& snapshot = _scene_snapshots.write_buffer();
 
-    _loaded_scenes["debug"]->draw(transf, _main_draw_context);
+    cull_and_sort(*objects, snapshot.draw_context, gpu_culling);
+
+    snapshot.gpu_culling       = gpu_culling;
+    snapshot.occlusion_culling = _occlusion_culling.load(std::memory_order_relaxed);
+
+    snapshot.scene_data = _scene_data;
+    snapshot.light_data = _light_data;
+    snapshot.camera     = _main_camera;
+    snapshot.tick       = ++_tick;
 
     auto end     = std::chrono::system_clock::now();
     auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 
-    stats.scene_update_time = elapsed.count() / 1000.f;
+    snapshot.scene_update_time = elapsed.count() / 1000.f;
+
+    _scene_snapshots.publish();
+}
+
+void VulkanEngine::acquire_snapshot()
+{
+    if (!_scene_snapshots.consume())
+    {
+        // the game thread has not finished its tick; draw the previous snapshot again
+        return;
+    }
+
+    const SceneSnapshot& snapshot = _scene_snapshots.read_buffer();
+
+    stats.scene_update_time = snapshot.scene_update_time;
+
+    _consumed_tick.store(snapshot.tick, std::memory_order_release);
+    _consumed_tick.notify_one();
+}
+
+void VulkanEngine::game_thread_loop()
+{
+    util::profiler_set_thread_name("game");
+
+    while (!_game_thread_stop.load(std::memory_order_acquire))
+    {
+        update_scene();
+
+        // stay at most one tick ahead of the renderer, so the snapshot being drawn is never more than a frame old
+        GPBR_PROFILE_SCOPE("wait for renderer");
+
+        uint64_t consumed;
+        while ((consumed = _consumed_tick.load(std::memory_order_acquire)) < _tick &&
+               !_game_thread_stop.load(std::memory_order_acquire))
+        {
+            _consumed_tick.wait(consumed, std::memory_order_acquire);
+        }
+    }
+}
+
+void VulkanEngine::stop_game_thread()
+{
+    if (!_game_thread.joinable())
+    {
+        return;
+    }
+
+    _game_thread_stop.store(true, std::memory_order_release);
+
+    // wake the game thread if it is waiting for the renderer
+    _consumed_tick.store(UINT64_MAX, std::memory_order_release);
+    _consumed_tick.notify_one();
+
+    _game_thread.join();
+
+    _game_thread_stop.store(false, std::memory_order_relaxed);
+    _consumed_tick.store(_tick, std::memory_order_relaxed);
 }
 
 void VulkanEngine::draw()
 {
     /* 1 Wait until the gpu has finished rendering the last frame.Timeout of 1 second */
 
-    VK_CHECK(vkWaitForFences(_device, 1, &get_current_frame()._render_fence, true, 1000000000));
+    util::ProfileZone phase{"wait for frame"};
+    VK_CHECK(_timeline.wait(get_current_frame()._submitted, 1000000000));
+
+    read_gpu_timestamps(get_current_frame());
+    stats.gpu_cull = _gpu_culler.collect(_frame_number % FRAME_OVERLAP);
+    update_render_scale();
 
     /* 2 Clear descriptor sets for the current frame */
 
-    get_current_frame()._deletion_queue.flush();
+    _deferred_deletion.collect(_timeline);
     get_current_frame()._frame_descriptors.clear_pools(_device);
+    get_current_frame()._transient_ring.reset();
+    get_current_frame()._indirect_storage.used = 0;
+    reset_recording_contexts(get_current_frame());
+
+    acquire_snapshot();
 
     /* 3 Request an image from the swapchain */
+    phase.next("acquire");
     uint32_t swapchain_image_index;
 
     VkResult e = vkAcquireNextImageKHR(
@@ -826,9 +1640,17 @@ void VulkanEngine::draw()
     _draw_extent.width  = std::min(_swapchain_extent.width, _draw_image.image_extent.width) * _render_scale;
     _draw_extent.height = std::min(_swapchain_extent.height, _draw_image.image_extent.height) * _render_scale;
 
-    /* 5 Reset fences and command buffer */
+    _scene_aspect.store((float)_draw_extent.width / (float)_draw_extent.height, std::memory_order_relaxed);
 
-    VK_CHECK(vkResetFences(_device, 1, &get_current_frame()._render_fence));
+    /* 5 Reset command buffer */
+
+    // the background starts on the compute queue while the previous frame may still be rendering
+    VkSemaphoreSubmitInfo compute_wait_info{};
+    if (_async_compute)
+    {
+        phase.next("submit compute");
+        compute_wait_info = submit_async_compute(get_current_frame());
+    }
 
     // reset command buffer to begin recording again
     VK_CHECK(vkResetCommandBuffer(get_current_frame()._main_command_buffer, 0));
@@ -841,8 +1663,12 @@ void VulkanEngine::draw()
 
     /* 6 Begin command buffer and process draw commands */
 
+    phase.next("record commands");
     VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
 
+    GpuProfiler& profiler = get_current_frame()._gpu_profiler;
+    profiler.begin_scope(cmd, "frame");
+
     // transition the main draw image into general layout so it can be written to
     vkutil::transition_image(cmd, _draw_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
     vkutil::transition_image(
@@ -859,8 +1685,10 @@ void VulkanEngine::draw()
     extent.width  = _window_extent.width;
 
     // execute a copy from the draw image into the swapchain
+    profiler.begin_scope(cmd, "blit");
     vkutil::copy_image_to_image(
         cmd, _draw_image.image, _swapchain_images[swapchain_image_index], _draw_extent, _swapchain_extent);
+    profiler.end_scope(cmd);
 
     // set swapchain image layout to Attachment Optimal so we can draw it
     vkutil::transition_image(cmd,
@@ -869,7 +1697,9 @@ void VulkanEngine::draw()
                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
 
     // draw imgui into the swapchain image
+    profiler.begin_scope(cmd, "imgui");
     draw_imgui(cmd, _swapchain_image_views[swapchain_image_index]);
+    profiler.end_scope(cmd);
 
     // set swapchain image layout to Present so we can draw it
     vkutil::transition_image(cmd,
@@ -877,28 +1707,46 @@ void VulkanEngine::draw()
                              VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
                              VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
 
+    profiler.end_scope(cmd);
+
     // finalize the command buffer (we can no longer add commands, but it can now be executed)
     VK_CHECK(vkEndCommandBuffer(cmd));
 
     /* 7 Submit command buffer to the graphics queue */
 
+    phase.next("submit");
+
     // prepare the submission to the queue.
     // wait on the _present_semaphore, as that semaphore is signalled when the swapchain is ready
     // signal the _render_semaphore, to signal that rendering has finished
     VkCommandBufferSubmitInfo cmd_info = vkinit::command_buffer_submit_info(cmd);
 
-    VkSemaphoreSubmitInfo wait_info = vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
-                                                                    get_current_frame()._swapchain_semaphore);
-    VkSemaphoreSubmitInfo signal_info =
-        vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, get_current_frame()._render_semaphore);
+    VkSemaphoreSubmitInfo wait_infos[3] = {
+        vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR,
+                                      get_current_frame()._swapchain_semaphore),
+        flush_uploads(),
+        compute_wait_info,
+    };
+
+    // reserved after the uploads' submission, as the graphics queue's points are signalled in submission order
+    get_current_frame()._submitted = _timeline.next(QueueType::Graphics);
+
+    VkSemaphoreSubmitInfo signal_infos[2] = {
+        vkinit::semaphore_submit_info(VK_PIPELINE_STAGE_2_ALL_GRAPHICS_BIT, get_current_frame()._render_semaphore),
+        _timeline.signal_info(get_current_frame()._submitted),
+    };
 
-    VkSubmitInfo2 submit = vkinit::submit_info(&cmd_info, &signal_info, &wait_info);
+    VkSubmitInfo2 submit            = vkinit::submit_info(&cmd_info, signal_infos, wait_infos);
+    submit.waitSemaphoreInfoCount   = _async_compute ? 3 : 2;
+    submit.signalSemaphoreInfoCount = 2;
 
-    //  _render_fence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit2(_graphics_queue, 1, &submit, get_current_frame()._render_fence));
+    // the frame's timeline point will now be reached once the graphic commands finish execution
+    VK_CHECK(vkQueueSubmit2(_graphics_queue, 1, &submit, VK_NULL_HANDLE));
 
     /* 8 Present rendered image to the window */
 
+    phase.next("present");
+
     // wait on _render_semaphore to ensure the drawing is finished before it is displayed.
     VkPresentInfoKHR present_info = {};
     present_info.sType            = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -933,11 +1781,17 @@ void VulkanEngine::run()
     SDL_Event e;
     bool quit = false;
 
+    _game_thread = std::thread(&VulkanEngine::game_thread_loop, this);
+
     while (!quit)
     {
+        util::profiler_begin_frame();
+        util::ProfileZone frame_zone{"frame"};
+
         auto start = std::chrono::system_clock::now();
 
         // Poll until all events are handled
+        util::ProfileZone phase{"poll events"};
         while (SDL_PollEvent(&e))
         {
             if (e.type == SDL_EVENT_QUIT)
@@ -966,8 +1820,21 @@ void VulkanEngine::run()
                 {
                     SDL_SetWindowRelativeMouseMode(_window, !SDL_GetWindowRelativeMouseMode(_window));
                 }
+                // toggle camera path recording for benchmark runs
+                if (e.key.key == SDLK_F5 && !e.key.repeat)
+                {
+                    toggle_camera_path_recording();
+                }
+                // dump the most recent frames as a Chrome trace
+                if (e.key.key == SDLK_F6 && !e.key.repeat)
+                {
+                    write_trace();
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(_input_mutex);
+                process_SDL_event(_pending_input, e, _main_camera.mouse_sensitivity);
             }
-            _main_camera.process_SDL_event(e);
             ImGui_ImplSDL3_ProcessEvent(&e);
             //<== INPUT EVENTS
         }
@@ -981,64 +1848,652 @@ void VulkanEngine::run()
 
         if (_resize_requested)
         {
+            phase.next("resize swapchain");
             resize_swapchain();
         }
 
-        // Create and update ImGui windows
+        phase.next("main loop");
 
-        ImGui_ImplVulkan_NewFrame();
-        ImGui_ImplSDL3_NewFrame();
-        ImGui::NewFrame();
+        update_imgui();
 
-        ImGui::Begin("Stats");
-        ImGui::SetWindowSize(ImVec2(200, 150));
-        ImGui::SetWindowPos(ImVec2(0, 0));
-        ImGui::Text("frame time %f ms", stats.frame_time);
-        ImGui::Text("draw time %f ms", stats.mesh_draw_time);
-        ImGui::Text("update time %f ms", stats.scene_update_time);
-        ImGui::Text("triangles %i", stats.triangle_count);
-        ImGui::Text("draws %i", stats.drawcall_count);
-        ImGui::End();
+        if (_recording_camera_path)
+        {
+            // the camera belongs to the game thread; record the pose being drawn
+            const Camera& camera = _scene_snapshots.read_buffer().camera;
 
-        ImGui::Begin("Camera");
-        ImGui::SetWindowSize(ImVec2(200, 150));
-        ImGui::SetWindowPos(ImVec2(200, 0));
-        ImGui::Text("Pos: %.2f, %.2f, %.2f", _main_camera.position.x, _main_camera.position.y, _main_camera.position.z);
-        ImGui::Text("Vel: %.2f, %.2f, %.2f", _main_camera.velocity.x, _main_camera.velocity.y, _main_camera.velocity.z);
-        ImGui::Text("For: %.2f, %.2f, %.2f", _main_camera.forward.x, _main_camera.forward.y, _main_camera.forward.z);
-        ImGui::Text("Rig: %.2f, %.2f, %.2f", _main_camera.right.x, _main_camera.right.y, _main_camera.right.z);
-        ImGui::Text("Up : %.2f, %.2f, %.2f", _main_camera.up.x, _main_camera.up.y, _main_camera.up.z);
-        ImGui::End();
+            _camera_path_time += stats.frame_time / 1000.f;
+            _recorded_camera_path.add_keyframe({_camera_path_time, camera.position, camera.pitch, camera.yaw});
+        }
+
+        draw();
+
+        auto end     = std::chrono::system_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+        stats.frame_time  = elapsed.count() / 1000.f;
+        stats.job_workers = _job_system->collect_stats();
+    }
+
+    stop_game_thread();
+}
 
-        if (ImGui::Begin("background"))
+void VulkanEngine::update_imgui()
+{
+    GPBR_PROFILE_SCOPE("imgui");
+
+    ImGui_ImplVulkan_NewFrame();
+    ImGui_ImplSDL3_NewFrame();
+    ImGui::NewFrame();
+
+    ImGui::Begin("Stats");
+    ImGui::SetWindowSize(ImVec2(200, 400));
+    ImGui::SetWindowPos(ImVec2(0, 0));
+    ImGui::Text("frame time %f ms", stats.frame_time);
+    ImGui::Text("draw time %f ms", stats.mesh_draw_time);
+    ImGui::Text("update time %f ms", stats.scene_update_time);
+    ImGui::Text("triangles %i", stats.triangle_count);
+    ImGui::Text("draws %i in %i calls", stats.drawcall_count, stats.draw_api_calls);
+    if (stats.gpu_cull.instances > 0)
+    {
+        ImGui::Text("gpu culled %u of %u", stats.gpu_cull.instances - stats.gpu_cull.visible, stats.gpu_cull.instances);
+        ImGui::Text("  %u occluded", stats.gpu_cull.occluded);
+    }
+    ImGui::Text("render targets %.1f MiB", _render_target_bytes / (1024.f * 1024.f));
+    ImGui::Text(
+        "uploads %.1f MiB in %u batches", _uploads.uploaded_bytes() / (1024.f * 1024.f), _uploads.submitted_batches());
+    ImGui::Text("geometry %.2f/%.2f M vertices, %.2f/%.2f M indices",
+                _geometry.vertices().used() / 1e6f,
+                _geometry.vertices().capacity() / 1e6f,
+                _geometry.indices().used() / 1e6f,
+                _geometry.indices().capacity() / 1e6f);
+    ImGui::Text("render scale %.2f%s", _render_scale, _dynamic_resolution_enabled ? " (auto)" : "");
+    if (_dynamic_resolution_enabled)
+    {
+        const std::vector<float>& history = _dynamic_resolution.history();
+        ImGui::PlotLines("##scale", history.data(), (int)history.size(), 0, nullptr, 0.f, 1.f, ImVec2(180, 30));
+    }
+    ImGui::Separator();
+    for (const GpuScopeTiming& scope : stats.gpu_scopes)
+    {
+        ImGui::Text("%*sgpu %s %.3f ms", scope.depth * 2, "", scope.name, scope.time_ms);
+    }
+    if (_async_compute)
+    {
+        ImGui::Text("compute %.3f ms (%.3f ms overlapped)", stats.gpu_compute_time, stats.gpu_compute_overlap_time);
+    }
+    ImGui::Separator();
+    for (size_t i = 0; i < stats.job_workers.size(); i++)
+    {
+        const util::WorkerStats& worker = stats.job_workers[i];
+        // thread 0 is the main thread, whose time outside of jobs is not counted
+        ImGui::Text(
+            "job %zu %3.0f%% %u (%u stolen)", i, worker.utilization() * 100.f, worker.jobs_run, worker.jobs_stolen);
+    }
+    if (_recording_camera_path)
+    {
+        ImGui::Text("recording path (F5)");
+    }
+    ImGui::End();
+
+    // the camera of the snapshot being drawn, as _main_camera may be mid-update on the game thread
+    const Camera& camera = _scene_snapshots.read_buffer().camera;
+
+    ImGui::Begin("Camera");
+    ImGui::SetWindowSize(ImVec2(200, 150));
+    ImGui::SetWindowPos(ImVec2(200, 0));
+    ImGui::Text("Pos: %.2f, %.2f, %.2f", camera.position.x, camera.position.y, camera.position.z);
+    ImGui::Text("Vel: %.2f, %.2f, %.2f", camera.velocity.x, camera.velocity.y, camera.velocity.z);
+    ImGui::Text("For: %.2f, %.2f, %.2f", camera.forward.x, camera.forward.y, camera.forward.z);
+    ImGui::Text("Rig: %.2f, %.2f, %.2f", camera.right.x, camera.right.y, camera.right.z);
+    ImGui::Text("Up : %.2f, %.2f, %.2f", camera.up.x, camera.up.y, camera.up.z);
+    ImGui::End();
+
+    if (ImGui::Begin("background"))
+    {
+        ImGui::SetWindowPos(ImVec2(400, 0));
+        ImGui::SliderFloat("Render Scale", &_render_scale, 0.3f, MAX_RENDER_SCALE);
+        if (ImGui::Checkbox("Dynamic Resolution", &_dynamic_resolution_enabled))
+        {
+            _dynamic_resolution.reset();
+        }
+        ImGui::SliderFloat("Target GPU ms", &_dynamic_resolution.settings.target_ms, 4.f, 50.f);
+        ImGui::SliderInt("Record Threads", &_record_threads, 1, (int)_job_system->thread_count());
+        ImGui::Checkbox("Indirect Draws", &_indirect_draws);
+        bool gpu_culling = _gpu_culling.load(std::memory_order_relaxed);
+        if (ImGui::Checkbox("GPU Culling", &gpu_culling))
         {
-            ImGui::SetWindowPos(ImVec2(400, 0));
-            ImGui::SliderFloat("Render Scale", &_render_scale, 0.3f, 1.0f);
+            _gpu_culling.store(gpu_culling, std::memory_order_relaxed);
+        }
+        bool occlusion_culling = _occlusion_culling.load(std::memory_order_relaxed);
+        if (ImGui::Checkbox("Occlusion Culling", &occlusion_culling))
+        {
+            _occlusion_culling.store(occlusion_culling, std::memory_order_relaxed);
+        }
+
+        ComputeEffect& selected = background_effects[current_background_effect];
 
-            ComputeEffect& selected = background_effects[current_background_effect];
+        ImGui::Text("Selected effect: ", selected.name);
 
-            ImGui::Text("Selected effect: ", selected.name);
+        ImGui::SliderInt("Effect Index", &current_background_effect, 0, background_effects.size() - 1);
 
-            ImGui::SliderInt("Effect Index", &current_background_effect, 0, background_effects.size() - 1);
+        ImGui::InputFloat4("data1", (float*)&selected.data.data1);
+        ImGui::InputFloat4("data2", (float*)&selected.data.data2);
+        ImGui::InputFloat4("data3", (float*)&selected.data.data3);
+        ImGui::InputFloat4("data4", (float*)&selected.data.data4);
+    }
+    ImGui::End();
+
+    // the pyramid of the last occlusion-culled frame, farthest depth in black
+    if (_depth_pyramid.built())
+    {
+        if (ImGui::Begin("depth pyramid"))
+        {
+            if (_depth_pyramid_textures.empty())
+            {
+                for (uint32_t mip = 0; mip < _depth_pyramid.mip_count(); mip++)
+                {
+                    _depth_pyramid_textures.push_back(ImGui_ImplVulkan_AddTexture(
+                        _default_sampler_nearest, _depth_pyramid.debug_view(mip), VK_IMAGE_LAYOUT_GENERAL));
+                }
+            }
+
+            ImGui::SliderInt("Mip", &_depth_pyramid_debug_mip, 0, (int)_depth_pyramid.mip_count() - 1);
+            _depth_pyramid_debug_mip = std::clamp(_depth_pyramid_debug_mip, 0, (int)_depth_pyramid.mip_count() - 1);
 
-            ImGui::InputFloat4("data1", (float*)&selected.data.data1);
-            ImGui::InputFloat4("data2", (float*)&selected.data.data2);
-            ImGui::InputFloat4("data3", (float*)&selected.data.data3);
-            ImGui::InputFloat4("data4", (float*)&selected.data.data4);
+            uint32_t mip      = (uint32_t)_depth_pyramid_debug_mip;
+            VkExtent2D extent = _depth_pyramid.extent();
+            ImGui::Text("%ux%u", std::max(1u, extent.width >> mip), std::max(1u, extent.height >> mip));
+
+            float width = 256.f;
+            ImGui::Image((ImTextureID)_depth_pyramid_textures[mip],
+                         ImVec2(width, width * extent.height / extent.width));
         }
         ImGui::End();
+    }
 
-        ImGui::Render();
+    ImGui::Render();
+}
 
-        update_scene();
+void VulkanEngine::toggle_camera_path_recording()
+{
+    if (!_recording_camera_path)
+    {
+        _recorded_camera_path  = CameraPath{};
+        _camera_path_time      = 0.f;
+        _recording_camera_path = true;
+        fmt::println("Recording camera path...");
+        return;
+    }
+
+    _recording_camera_path = false;
+
+    if (_recorded_camera_path.save(_camera_path_file))
+    {
+        fmt::println("Saved {} keyframes to {}", _recorded_camera_path.keyframes.size(), _camera_path_file);
+    }
+    else
+    {
+        fmt::println("Failed to save camera path: {}", _camera_path_file);
+    }
+}
+
+void VulkanEngine::write_trace()
+{
+    if (util::profiler_write_chrome_trace(_trace_path, _trace_frame_count))
+    {
+        fmt::println("Wrote CPU trace to {}", _trace_path);
+    }
+    else
+    {
+        fmt::println("Failed to write CPU trace: {}", _trace_path);
+    }
+}
+
+VkSemaphoreSubmitInfo VulkanEngine::flush_uploads()
+{
+    _uploads.flush();
+
+    // waiting on a point the timeline has already reached costs nothing
+    return _timeline.wait_info(_uploads.completion_point());
+}
+
+void VulkanEngine::read_gpu_timestamps(FrameData& frame)
+{
+    frame._gpu_profiler.collect();
+
+    stats.gpu_scopes     = frame._gpu_profiler.results();
+    stats.gpu_frame_time = frame._gpu_profiler.find("frame");
+
+    stats.gpu_compute_time         = 0.f;
+    stats.gpu_compute_overlap_time = 0.f;
+
+    // the frame's compute submission finished before its graphics submission could reach the frame's point
+    if (_async_compute)
+    {
+        frame._compute_profiler.collect();
+
+        const GpuScopeTiming* graphics = nullptr;
+        for (const GpuScopeTiming& scope : stats.gpu_scopes)
+        {
+            if (scope.depth == 0)
+            {
+                graphics = &scope;
+            }
+        }
+
+        double graphics_start = graphics ? graphics->start_ms : 0.0;
+        double graphics_end   = graphics ? graphics->start_ms + graphics->time_ms : 0.0;
+
+        // the compute work of a frame can run alongside the graphics work of the previous frame and, before the
+        // graphics queue reaches its semaphore wait, of its own
+        for (const GpuScopeTiming& scope : frame._compute_profiler.results())
+        {
+            if (scope.depth != 0)
+            {
+                continue;
+            }
+
+            double compute_start = scope.start_ms;
+            double compute_end   = scope.start_ms + scope.time_ms;
+
+            auto overlap = [&](double start, double end)
+            { return std::max(0.0, std::min(compute_end, end) - std::max(compute_start, start)); };
+
+            stats.gpu_compute_time += scope.time_ms;
+            stats.gpu_compute_overlap_time += (float)(overlap(_last_graphics_start_ms, _last_graphics_end_ms) +
+                                                      overlap(graphics_start, graphics_end));
+        }
+
+        _last_graphics_start_ms = graphics_start;
+        _last_graphics_end_ms   = graphics_end;
+    }
+}
+
+void VulkanEngine::update_render_scale()
+{
+    if (_dynamic_resolution_enabled)
+    {
+        _render_scale = _dynamic_resolution.update(stats.gpu_frame_time, _render_scale);
+    }
+}
 
+void VulkanEngine::draw_frame()
+{
+    if (_headless)
+    {
+        draw_headless();
+    }
+    else
+    {
         draw();
+    }
+}
+
+void VulkanEngine::run_benchmark(const BenchmarkSettings& settings)
+{
+    /* 1 Load the scene and the camera path */
+
+    if (settings.scene != _scene_name && !load_scene(settings.scene))
+    {
+        fmt::println("Failed to load benchmark scene: {}", settings.scene);
+        return;
+    }
+
+    int total_frames = settings.warmup_frames + settings.measured_frames;
+
+    CameraPath path;
+    if (settings.camera_path_file.empty() || !path.load(settings.camera_path_file))
+    {
+        if (!settings.camera_path_file.empty())
+        {
+            fmt::println("Failed to load camera path {}, using an orbit instead", settings.camera_path_file);
+        }
+        path = CameraPath::orbit(glm::vec3(0.f), 10.f, 2.f, settings.measured_frames * settings.fixed_dt);
+    }
+
+    BenchmarkRecorder recorder;
+    recorder.set_info("scene", _scene_name);
+    recorder.set_info("gpu", _gpu_name);
+    recorder.set_info("label", settings.label);
+    recorder.set_info("resolution", fmt::format("{}x{}", _draw_extent.width, _draw_extent.height));
+    recorder.set_info("warmup_frames", std::to_string(settings.warmup_frames));
+    recorder.set_info("measured_frames", std::to_string(settings.measured_frames));
+    recorder.set_info("record_threads", std::to_string(recording_thread_count()));
+    recorder.set_info("dynamic_resolution",
+                      _dynamic_resolution_enabled
+                          ? fmt::format("{:.1f} ms target", _dynamic_resolution.settings.target_ms)
+                          : "off");
+    recorder.set_info("render_target_mib", fmt::format("{:.1f}", _render_target_bytes / (1024.f * 1024.f)));
+
+    std::string async_compute = "off";
+    if (_async_compute)
+    {
+        async_compute = (_compute_queue_family != _graphics_queue_family) ? "compute queue" : "graphics queue";
+    }
+    recorder.set_info("async_compute", async_compute);
+    recorder.keep_history("render_scale");
+
+    /* 2 Render each frame with a fixed time step */
+
+    for (int i = 0; i < total_frames; i++)
+    {
+        util::profiler_begin_frame();
+        GPBR_PROFILE_SCOPE("frame");
+
+        auto start = std::chrono::system_clock::now();
+
+        if (!_headless)
+        {
+            SDL_Event e;
+            while (SDL_PollEvent(&e))
+            {
+                if (e.type == SDL_EVENT_QUIT)
+                {
+                    fmt::println("Benchmark aborted after {} frames", i);
+                    return;
+                }
+                if (e.type == SDL_EVENT_WINDOW_RESIZED)
+                {
+                    _resize_requested = true;
+                }
+            }
+
+            if (_resize_requested)
+            {
+                resize_swapchain();
+            }
+        }
+
+        // the warmup frames replay the start of the path so the measured frames begin at time 0
+        float time = (i < settings.warmup_frames) ? i * settings.fixed_dt
+                                                  : (i - settings.warmup_frames) * settings.fixed_dt;
+
+        CameraKeyframe pose   = path.sample(time);
+        _main_camera.position = pose.position;
+        _main_camera.pitch    = pose.pitch;
+        _main_camera.yaw      = pose.yaw;
+        _main_camera.input    = InputState{};
+
+        if (!_headless)
+        {
+            update_imgui();
+        }
+
+        update_scene();
+
+        draw_frame();
+
+        auto end     = std::chrono::system_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
+
+        stats.frame_time  = elapsed.count() / 1000.f;
+        stats.job_workers = _job_system->collect_stats();
+
+        if (i >= settings.warmup_frames)
+        {
+            recorder.record("frame_time_ms", stats.frame_time);
+            recorder.record("gpu_frame_ms", stats.gpu_frame_time);
+            recorder.record("scene_update_ms", stats.scene_update_time);
+            recorder.record("mesh_draw_ms", stats.mesh_draw_time);
+            recorder.record("render_scale", _render_scale);
+
+            for (const GpuScopeTiming& scope : stats.gpu_scopes)
+            {
+                if (scope.depth > 0)
+                {
+                    recorder.record(fmt::format("gpu_{}_ms", scope.name), scope.time_ms);
+                }
+            }
+
+            if (_async_compute)
+            {
+                recorder.record("gpu_compute_ms", stats.gpu_compute_time);
+                recorder.record("gpu_compute_overlap_ms", stats.gpu_compute_overlap_time);
+            }
+
+            // mean over the worker threads; the main thread is busy outside of jobs
+            float worker_utilization = 0.f;
+            for (size_t w = 1; w < stats.job_workers.size(); w++)
+            {
+                worker_utilization += stats.job_workers[w].utilization();
+            }
+            if (stats.job_workers.size() > 1)
+            {
+                recorder.record("job_worker_utilization_pct",
+                                100.f * worker_utilization / (float)(stats.job_workers.size() - 1));
+            }
+        }
+    }
+
+    vkDeviceWaitIdle(_device);
+
+    /* 3 Write the report */
+
+    recorder.print_summary();
+
+    if (recorder.write(settings.report_path))
+    {
+        fmt::println("Wrote benchmark report to {}", settings.report_path);
+    }
+    else
+    {
+        fmt::println("Failed to write benchmark report: {}", settings.report_path);
+    }
+}
+
+void VulkanEngine::draw_tonemap(VkCommandBuffer cmd)
+{
+    TonemapPushConstants push_constants{};
+    push_constants.exposure = _tonemap_exposure;
+    push_constants.mode     = (uint32_t)_tonemap_mode;
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _tonemap_pipeline);
+
+    vkCmdBindDescriptorSets(
+        cmd, VK_PIPELINE_BIND_POINT_COMPUTE, _tonemap_pipeline_layout, 0, 1, &_tonemap_descriptors, 0, nullptr);
+
+    vkCmdPushConstants(
+        cmd, _tonemap_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(TonemapPushConstants), &push_constants);
+
+    // only the region covered by the draw extent holds valid data
+    vkCmdDispatch(cmd, std::ceil(_draw_extent.width / 16.0), std::ceil(_draw_extent.height / 16.0), 1);
+}
+
+void VulkanEngine::draw_headless()
+{
+    FrameData& frame = get_current_frame();
+
+    /* 1 Wait until the gpu has finished rendering this frame's previous contents */
+
+    util::ProfileZone phase{"wait for frame"};
+    VK_CHECK(_timeline.wait(frame._submitted, 1000000000));
+
+    read_gpu_timestamps(frame);
+    stats.gpu_cull = _gpu_culler.collect(_frame_number % FRAME_OVERLAP);
+    update_render_scale();
+
+    // the readback from FRAME_OVERLAP frames ago is now complete
+    phase.next("deliver frame");
+    deliver_headless_frame(frame);
+
+    _deferred_deletion.collect(_timeline);
+    frame._frame_descriptors.clear_pools(_device);
+    frame._transient_ring.reset();
+    frame._indirect_storage.used = 0;
+    reset_recording_contexts(frame);
+
+    acquire_snapshot();
+
+    /* 2 Adjust draw extent to prevent out of bounds draws */
+
+    _draw_extent.width  = std::min(_swapchain_extent.width, _draw_image.image_extent.width) * _render_scale;
+    _draw_extent.height = std::min(_swapchain_extent.height, _draw_image.image_extent.height) * _render_scale;
+
+    _scene_aspect.store((float)_draw_extent.width / (float)_draw_extent.height, std::memory_order_relaxed);
+
+    VkSemaphoreSubmitInfo compute_wait_info{};
+    if (_async_compute)
+    {
+        phase.next("submit compute");
+        compute_wait_info = submit_async_compute(frame);
+    }
+
+    VK_CHECK(vkResetCommandBuffer(frame._main_command_buffer, 0));
+
+    VkCommandBuffer cmd = frame._main_command_buffer;
+
+    VkCommandBufferBeginInfo cmd_begin_info =
+        vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    /* 3 Draw the scene and tonemap it into the LDR image */
+
+    phase.next("record commands");
+    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
+
+    frame._gpu_profiler.begin_scope(cmd, "frame");
+
+    vkutil::transition_image(cmd, _draw_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+    vkutil::transition_image(
+        cmd, _depth_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL);
+
+    draw_main(cmd);
+
+    // make the color attachment writes visible to the tonemap shader
+    vkutil::transition_image(cmd, _draw_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL);
+    vkutil::transition_image(cmd, _ldr_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL);
+
+    frame._gpu_profiler.begin_scope(cmd, "tonemap");
+    draw_tonemap(cmd);
+    frame._gpu_profiler.end_scope(cmd);
+
+    /* 4 Copy the LDR image into this frame's readback buffer */
+
+    bool wants_readback = !_headless_output_dir.empty() || _headless_frame_callback;
+
+    if (wants_readback)
+    {
+        vkutil::transition_image(cmd, _ldr_image.image, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL);
+
+        VkBufferImageCopy copy_region{};
+        copy_region.bufferOffset                    = 0;
+        copy_region.bufferRowLength                 = 0; // tightly packed
+        copy_region.bufferImageHeight               = 0;
+        copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy_region.imageSubresource.mipLevel       = 0;
+        copy_region.imageSubresource.baseArrayLayer = 0;
+        copy_region.imageSubresource.layerCount     = 1;
+        copy_region.imageExtent                     = {_draw_extent.width, _draw_extent.height, 1};
+
+        vkCmdCopyImageToBuffer(cmd,
+                               _ldr_image.image,
+                               VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               frame._readback_buffer.buffer,
+                               1,
+                               &copy_region);
+    }
+
+    frame._gpu_profiler.end_scope(cmd);
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    /* 5 Submit; nothing is presented, so only uploads and async compute work are waited on */
+
+    phase.next("submit");
+
+    VkSemaphoreSubmitInfo wait_infos[2] = {flush_uploads(), compute_wait_info};
+
+    frame._submitted                  = _timeline.next(QueueType::Graphics);
+    VkSemaphoreSubmitInfo signal_info = _timeline.signal_info(frame._submitted);
+
+    VkCommandBufferSubmitInfo cmd_info = vkinit::command_buffer_submit_info(cmd);
+    VkSubmitInfo2 submit               = vkinit::submit_info(&cmd_info, &signal_info, wait_infos);
+    submit.waitSemaphoreInfoCount      = _async_compute ? 2 : 1;
+
+    VK_CHECK(vkQueueSubmit2(_graphics_queue, 1, &submit, VK_NULL_HANDLE));
+
+    frame._readback_pending      = wants_readback;
+    frame._readback_frame_number = _frame_number;
+    frame._readback_extent       = _draw_extent;
+
+    _frame_number++;
+}
+
+void VulkanEngine::deliver_headless_frame(FrameData& frame)
+{
+    if (!frame._readback_pending)
+    {
+        return;
+    }
+
+    frame._readback_pending = false;
+
+    // GPU_TO_CPU memory is not guaranteed to be coherent
+    vmaInvalidateAllocation(_allocator, frame._readback_buffer.allocation, 0, VK_WHOLE_SIZE);
+
+    const uint8_t* pixels = (const uint8_t*)frame._readback_buffer.info.pMappedData;
+    size_t pixel_bytes    = frame._readback_extent.width * frame._readback_extent.height * 4;
+
+    HeadlessFrame result{.frame_number = frame._readback_frame_number,
+                         .width        = frame._readback_extent.width,
+                         .height       = frame._readback_extent.height,
+                         .pixels       = std::span<const uint8_t>(pixels, pixel_bytes)};
+
+    if (_headless_frame_callback)
+    {
+        _headless_frame_callback(result);
+    }
+
+    if (!_headless_output_dir.empty())
+    {
+        std::filesystem::path file_path =
+            std::filesystem::path(_headless_output_dir) / fmt::format("frame_{:05}.png", result.frame_number);
+
+        if (!stbi_write_png(file_path.string().c_str(),
+                            (int)result.width,
+                            (int)result.height,
+                            4,
+                            pixels,
+                            (int)result.width * 4))
+        {
+            fmt::println("Failed to write headless frame: {}", file_path.string());
+        }
+    }
+}
+
+void VulkanEngine::run_headless(int frame_count)
+{
+    assert(_headless);
+
+    if (!_headless_output_dir.empty())
+    {
+        std::filesystem::create_directories(_headless_output_dir);
+    }
+
+    for (int i = 0; i < frame_count; i++)
+    {
+        util::profiler_begin_frame();
+        GPBR_PROFILE_SCOPE("frame");
+
+        auto start = std::chrono::system_clock::now();
+
+        update_scene();
+
+        draw_headless();
 
         auto end     = std::chrono::system_clock::now();
         auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
 
         stats.frame_time = elapsed.count() / 1000.f;
     }
+
+    // flush the readbacks which are still in flight
+    vkDeviceWaitIdle(_device);
+
+    for (int i = 0; i < FRAME_OVERLAP; i++)
+    {
+        // deliver in submission order
+        deliver_headless_frame(_frames[(_frame_number + i) % FRAME_OVERLAP]);
+    }
 }
 
 void VulkanEngine::create_swapchain(uint32_t width, uint32_t height)
@@ -1066,36 +2521,192 @@ void VulkanEngine::create_swapchain(uint32_t width, uint32_t height)
 
 void VulkanEngine::init_swapchain()
 {
-    create_swapchain(_window_extent.width, _window_extent.height);
+    if (_headless)
+    {
+        // there is nothing to present to; the requested resolution stands in for the swapchain
+        _swapchain_extent = _window_extent;
+    }
+    else
+    {
+        create_swapchain(_window_extent.width, _window_extent.height);
+    }
+
+    /* 1 Create the render targets, and the depth pyramid which is sized with them */
+
+    _depth_pyramid.init(_device, _allocator);
+    _main_deletion_queue.push_function([this]() { _depth_pyramid.destroy(); });
+
+    create_render_targets(_swapchain_extent);
+
+    _main_deletion_queue.push_function([this]() { destroy_render_targets(); });
 
-    /* 1 Set extent and format of the _draw_image (also for _depth_image) */
+    /* 2 Initialize the readback buffers (headless only, which never resizes) */
 
-    VkExtent3D draw_image_extent = {2560, 1600, 1};
+    if (_headless)
+    {
+        size_t readback_size = _ldr_image.image_extent.width * _ldr_image.image_extent.height * 4;
+
+        for (int i = 0; i < FRAME_OVERLAP; i++)
+        {
+            _frames[i]._readback_buffer =
+                create_buffer(readback_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VMA_MEMORY_USAGE_GPU_TO_CPU);
+        }
+
+        _main_deletion_queue.push_function(
+            [=, this]()
+            {
+                for (int i = 0; i < FRAME_OVERLAP; i++)
+                {
+                    destroy_buffer(_frames[i]._readback_buffer);
+                }
+            });
+    }
+}
+
+// Returns the device memory an image with the given create info would need, without creating it.
+static VkDeviceSize image_memory_size(VkDevice device, const VkImageCreateInfo& info)
+{
+    VkDeviceImageMemoryRequirements image_requirements{.sType = VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS};
+    image_requirements.pCreateInfo = &info;
+
+    VkMemoryRequirements2 requirements{.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+    vkGetDeviceImageMemoryRequirements(device, &image_requirements, &requirements);
+
+    return requirements.memoryRequirements.size;
+}
+
+void VulkanEngine::create_render_targets(VkExtent2D swapchain_extent)
+{
+    /* 1 Size the targets for the largest render scale */
+
+    VkExtent3D target_extent = {std::max(1u, (uint32_t)(swapchain_extent.width * MAX_RENDER_SCALE)),
+                                std::max(1u, (uint32_t)(swapchain_extent.height * MAX_RENDER_SCALE)),
+                                1};
+
+    /* 2 Define usages for the _draw_image */
+
+    VkImageUsageFlags draw_image_usages{};
+    draw_image_usages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    draw_image_usages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    draw_image_usages |= VK_IMAGE_USAGE_STORAGE_BIT;
+    draw_image_usages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    /* 3 Create the images, tallying their memory against fixed 2560x1600 targets with full mip chains */
 
-    /* 1.1 Define usages for the _draw_image */
+    _render_target_bytes           = 0;
+    VkDeviceSize fixed_target_bytes = 0;
+
+    // nothing samples the lower mips of a render target, so none are allocated
+    auto create_target = [&](VkFormat format, VkImageUsageFlags usage, bool fixed_mipmapped)
+    {
+        AllocatedImage target = create_image(target_extent, format, usage, false, false);
+
+        VmaAllocationInfo allocation_info;
+        vmaGetAllocationInfo(_allocator, target.allocation, &allocation_info);
+        _render_target_bytes += allocation_info.size;
+
+        VkImageCreateInfo fixed_info = vkinit::image_create_info(format, usage, {2560, 1600, 1});
+        fixed_info.mipLevels         = fixed_mipmapped ? 12 : 1;
+        fixed_target_bytes += image_memory_size(_device, fixed_info);
+
+        return target;
+    };
+
+    _draw_image  = create_target(VK_FORMAT_R16G16B16A16_SFLOAT, draw_image_usages, true);
+    // the depth pyramid's first mip is reduced from the depth image
+    _depth_image = create_target(
+        VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, true);
+
+    _depth_pyramid.create_targets(_depth_image.image_view, {target_extent.width, target_extent.height});
+
+    if (_headless)
+    {
+        VkImageUsageFlags ldr_usages = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+        _ldr_image = create_target(VK_FORMAT_R8G8B8A8_UNORM, ldr_usages, false);
+    }
+
+    // one per frame, so the compute queue never writes an image the graphics queue may still be copying
+    if (_async_compute)
+    {
+        VkImageUsageFlags background_usages = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+        for (int i = 0; i < FRAME_OVERLAP; i++)
+        {
+            _frames[i]._background_image = create_target(_draw_image.image_format, background_usages, false);
+        }
+    }
+
+    /* 4 Report the memory used */
+
+    constexpr float MiB = 1024.f * 1024.f;
+    fmt::println("Render targets {}x{}: {:.1f} MiB ({:.1f} MiB less than fixed 2560x1600 mipmapped targets)",
+                 target_extent.width,
+                 target_extent.height,
+                 _render_target_bytes / MiB,
+                 ((float)fixed_target_bytes - (float)_render_target_bytes) / MiB);
+
+    _draw_extent.width  = std::min(swapchain_extent.width, _draw_image.image_extent.width);
+    _draw_extent.height = std::min(swapchain_extent.height, _draw_image.image_extent.height);
+
+    _scene_aspect.store((float)_draw_extent.width / (float)_draw_extent.height, std::memory_order_relaxed);
+}
+
+void VulkanEngine::destroy_render_targets()
+{
+    destroy_image(_draw_image);
+    destroy_image(_depth_image);
+    _depth_pyramid.destroy_targets();
+
+    if (_headless)
+    {
+        destroy_image(_ldr_image);
+    }
 
-    VkImageUsageFlags draw_image_usages{};
-    draw_image_usages |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
-    draw_image_usages |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
-    draw_image_usages |= VK_IMAGE_USAGE_STORAGE_BIT;
-    draw_image_usages |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if (_async_compute)
+    {
+        for (int i = 0; i < FRAME_OVERLAP; i++)
+        {
+            destroy_image(_frames[i]._background_image);
+        }
+    }
 
-    /* 2 Initialize draw image and depth image */
+    _render_target_bytes = 0;
+}
 
-    _draw_image = create_image(draw_image_extent, VK_FORMAT_R16G16B16A16_SFLOAT, draw_image_usages, true, false);
+void VulkanEngine::write_render_target_descriptors()
+{
+    {
+        DescriptorWriter writer;
+        writer.write_image(
+            0, _draw_image.image_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
 
-    _depth_image =
-        create_image(draw_image_extent, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, true, false);
+        writer.update_set(_device, _draw_image_descriptors);
+    }
 
-    _main_deletion_queue.push_function(
-        [=]()
+    if (_async_compute)
+    {
+        for (int i = 0; i < FRAME_OVERLAP; i++)
         {
-            vkDestroyImageView(_device, _draw_image.image_view, nullptr);
-            vmaDestroyImage(_allocator, _draw_image.image, _draw_image.allocation);
+            DescriptorWriter writer;
+            writer.write_image(0,
+                               _frames[i]._background_image.image_view,
+                               VK_NULL_HANDLE,
+                               VK_IMAGE_LAYOUT_GENERAL,
+                               VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+            writer.update_set(_device, _frames[i]._background_descriptors);
+        }
+    }
 
-            vkDestroyImageView(_device, _depth_image.image_view, nullptr);
-            vmaDestroyImage(_allocator, _depth_image.image, _depth_image.allocation);
-        });
+    if (_headless)
+    {
+        DescriptorWriter writer;
+        writer.write_image(
+            0, _draw_image.image_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        writer.write_image(
+            1, _ldr_image.image_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        writer.update_set(_device, _tonemap_descriptors);
+    }
 }
 
 void VulkanEngine::init_commands()
@@ -1119,71 +2730,116 @@ void VulkanEngine::init_commands()
         _main_deletion_queue.push_function([=]() { vkDestroyCommandPool(_device, _frames[i]._command_pool, nullptr); });
     }
 
-    /* 3 Create cmd pools and cmd buffers for immediate submits */
+    /* 3 Create a secondary command pool per frame and recording thread */
+
+    VkCommandPoolCreateInfo recording_pool_info =
+        vkinit::command_pool_create_info(_graphics_queue_family, VK_COMMAND_POOL_CREATE_TRANSIENT_BIT);
+
+    for (int i = 0; i < FRAME_OVERLAP; i++)
+    {
+        _frames[i]._recording_contexts.resize(_job_system->thread_count());
+
+        for (RecordingContext& context : _frames[i]._recording_contexts)
+        {
+            VK_CHECK(vkCreateCommandPool(_device, &recording_pool_info, nullptr, &context.pool));
+
+            VkCommandPool pool = context.pool;
+            _main_deletion_queue.push_function([=]() { vkDestroyCommandPool(_device, pool, nullptr); });
+        }
+    }
+
+    /* 4 Create a command pool and buffer per frame on the compute queue family */
+
+    if (_async_compute)
+    {
+        VkCommandPoolCreateInfo compute_pool_info =
+            vkinit::command_pool_create_info(_compute_queue_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+
+        for (int i = 0; i < FRAME_OVERLAP; i++)
+        {
+            VK_CHECK(vkCreateCommandPool(_device, &compute_pool_info, nullptr, &_frames[i]._compute_command_pool));
+
+            VkCommandBufferAllocateInfo compute_alloc_info =
+                vkinit::command_buffer_allocate_info(_frames[i]._compute_command_pool, 1);
+
+            VK_CHECK(vkAllocateCommandBuffers(_device, &compute_alloc_info, &_frames[i]._compute_command_buffer));
+
+            VkCommandPool pool = _frames[i]._compute_command_pool;
+            _main_deletion_queue.push_function([=]() { vkDestroyCommandPool(_device, pool, nullptr); });
+        }
+    }
+
+    /* 5 Create the upload manager with its command pools and staging ring */
+
+    _uploads.init(_device,
+                  _allocator,
+                  _timeline,
+                  _transfer_queue,
+                  _transfer_queue_family,
+                  _graphics_queue,
+                  _graphics_queue_family,
+                  STAGING_RING_SIZE);
 
-    VK_CHECK(vkCreateCommandPool(_device, &command_pool_info, nullptr, &_imm_command_pool));
+    _main_deletion_queue.push_function([this]() { _uploads.destroy(); });
 
-    // allocate the command buffer for immediate submits
-    VkCommandBufferAllocateInfo cmd_alloc_info = vkinit::command_buffer_allocate_info(_imm_command_pool, 1);
+    /* 6 Create the geometry arena meshes are uploaded into, which both upload queues write to */
+
+    std::vector<uint32_t> geometry_families = {_graphics_queue_family};
+    if (_transfer_queue_family != _graphics_queue_family)
+    {
+        geometry_families.push_back(_transfer_queue_family);
+    }
 
-    VK_CHECK(vkAllocateCommandBuffers(_device, &cmd_alloc_info, &_imm_command_buffer));
+    _geometry.init(_device, _allocator, GEOMETRY_VERTICES, GEOMETRY_INDICES, geometry_families);
 
-    _main_deletion_queue.push_function([=]() { vkDestroyCommandPool(_device, _imm_command_pool, nullptr); });
+    _main_deletion_queue.push_function([this]() { _geometry.destroy(); });
 }
 
 void VulkanEngine::init_sync_structures()
 {
-    // one fence to control when the gpu has finished rendering the frame,
-    // and 2 semaphores to syncronize rendering with swapchain
-    // fence initially signalled; must wait on it before the first frame
-    VkFenceCreateInfo fence_create_info = vkinit::fence_create_info(VK_FENCE_CREATE_SIGNALED_BIT);
-    VK_CHECK(vkCreateFence(_device, &fence_create_info, nullptr, &_imm_fence));
+    // one timeline semaphore per queue to track when the gpu has finished each submission,
+    // and 2 semaphores per frame to syncronize rendering with swapchain
+    // the frames start at point 0, which is always reached
+    _timeline.init(_device);
 
-    _main_deletion_queue.push_function([=]() { vkDestroyFence(_device, _imm_fence, nullptr); });
+    _main_deletion_queue.push_function([this]() { _timeline.destroy(); });
 
     for (int i = 0; i < FRAME_OVERLAP; i++)
     {
-        VK_CHECK(vkCreateFence(_device, &fence_create_info, nullptr, &_frames[i]._render_fence));
-
         VkSemaphoreCreateInfo semaphore_create_info = vkinit::semaphore_create_info();
 
         VK_CHECK(vkCreateSemaphore(_device, &semaphore_create_info, nullptr, &_frames[i]._swapchain_semaphore));
         VK_CHECK(vkCreateSemaphore(_device, &semaphore_create_info, nullptr, &_frames[i]._render_semaphore));
 
+        _frames[i]._gpu_profiler.init(_device, _timestamp_period, _timestamp_valid_bits);
+
         _main_deletion_queue.push_function(
             [=]()
             {
-                vkDestroyFence(_device, _frames[i]._render_fence, nullptr);
                 vkDestroySemaphore(_device, _frames[i]._swapchain_semaphore, nullptr);
                 vkDestroySemaphore(_device, _frames[i]._render_semaphore, nullptr);
+                _frames[i]._gpu_profiler.destroy();
             });
     }
-}
-
-void VulkanEngine::immediate_submit(std::function<void(VkCommandBuffer cmd)>&& function)
-{
-    VK_CHECK(vkResetFences(_device, 1, &_imm_fence));
-    VK_CHECK(vkResetCommandBuffer(_imm_command_buffer, 0));
-
-    VkCommandBuffer cmd = _imm_command_buffer;
-
-    VkCommandBufferBeginInfo cmd_begin_info =
-        vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
-
-    VK_CHECK(vkBeginCommandBuffer(cmd, &cmd_begin_info));
 
-    function(cmd);
-
-    VK_CHECK(vkEndCommandBuffer(cmd));
-
-    VkCommandBufferSubmitInfo cmd_info = vkinit::command_buffer_submit_info(cmd);
-    VkSubmitInfo2 submit               = vkinit::submit_info(&cmd_info, nullptr, nullptr);
+    if (!_async_compute)
+    {
+        return;
+    }
 
-    // submit command buffer to the queue and execute it.
-    //  _render_fence will now block until the graphic commands finish execution
-    VK_CHECK(vkQueueSubmit2(_graphics_queue, 1, &submit, _imm_fence));
+    for (int i = 0; i < FRAME_OVERLAP; i++)
+    {
+        _frames[i]._compute_profiler.init(_device, _timestamp_period, _compute_timestamp_valid_bits);
+    }
 
-    VK_CHECK(vkWaitForFences(_device, 1, &_imm_fence, true, 9999999999));
+    _main_deletion_queue.push_function(
+        [=]()
+        {
+            for (int i = 0; i < FRAME_OVERLAP; i++)
+            {
+                _frames[i]._compute_profiler.destroy();
+            }
+        });
 }
 
 void VulkanEngine::init_imgui()
@@ -1255,8 +2911,17 @@ void VulkanEngine::init_pipelines()
     // COMPUTE PIPELINES
     init_background_pipelines();
 
+    if (_headless)
+    {
+        init_tonemap_pipeline();
+    }
+
     // glTF PBR PIPELINES
     _metal_rough_material.build_pipelines(this);
+
+    _gpu_culler.init(
+        _device, _allocator, _timeline, _deferred_deletion, _depth_pyramid.read_layout(), FRAME_OVERLAP);
+    _main_deletion_queue.push_function([this]() { _gpu_culler.destroy(); });
 }
 
 void VulkanEngine::init_background_pipelines()
@@ -1342,13 +3007,51 @@ void VulkanEngine::init_background_pipelines()
         });
 }
 
+void VulkanEngine::init_tonemap_pipeline()
+{
+    VkPushConstantRange push_constant{};
+    push_constant.offset     = 0;
+    push_constant.size       = sizeof(TonemapPushConstants);
+    push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+    VkPipelineLayoutCreateInfo layout_info = vkinit::pipeline_layout_create_info();
+    layout_info.setLayoutCount             = 1;
+    layout_info.pSetLayouts                = &_tonemap_descriptor_layout;
+    layout_info.pushConstantRangeCount     = 1;
+    layout_info.pPushConstantRanges        = &push_constant;
+
+    VK_CHECK(vkCreatePipelineLayout(_device, &layout_info, nullptr, &_tonemap_pipeline_layout));
+
+    VkShaderModule tonemap_shader;
+    if (!vkutil::load_shader_module("./Shaders/tonemap.comp.spv", _device, &tonemap_shader))
+    {
+        fmt::print("Error when building the tonemap compute shader\n");
+    }
+
+    VkComputePipelineCreateInfo pipeline_info{.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipeline_info.layout = _tonemap_pipeline_layout;
+    pipeline_info.stage  = vkinit::pipeline_shader_stage_create_info(VK_SHADER_STAGE_COMPUTE_BIT, tonemap_shader);
+
+    VK_CHECK(vkCreateComputePipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &_tonemap_pipeline));
+
+    vkDestroyShaderModule(_device, tonemap_shader, nullptr);
+
+    _main_deletion_queue.push_function(
+        [=, this]()
+        {
+            vkDestroyPipelineLayout(_device, _tonemap_pipeline_layout, nullptr);
+            vkDestroyPipeline(_device, _tonemap_pipeline, nullptr);
+        });
+}
+
 void VulkanEngine::init_descriptors()
 {
-    // descriptor pool that will hold 10 sets with 1 image each
+    // descriptor pool that will hold 10 sets with 1 image each, and the scene set
     std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
         {         VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 3},
         {        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3},
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1},
     };
 
     global_descriptor_allocator.init(_device, 10, sizes);
@@ -1363,31 +3066,35 @@ void VulkanEngine::init_descriptors()
     }
     // descriptor set layout for scene
     {
+        // scene and light data live in the frame's transient ring and are selected with dynamic offsets
         DescriptorLayoutBuilder builder;
-        builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        builder.add_binding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        builder.add_binding(2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-        VkDescriptorSetLayoutBindingFlagsCreateInfo bind_flags = {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO, .pNext = nullptr};
-
-        std::array<VkDescriptorBindingFlags, 3> flag_array{
-            0, 0, VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT};
-
-        builder.bindings[2].descriptorCount = 4048;
-
-        bind_flags.bindingCount  = 3;
-        bind_flags.pBindingFlags = flag_array.data();
-
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+        builder.add_binding(1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
         _gpu_scene_data_descriptor_layout =
-            builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, &bind_flags);
+            builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
     }
-    // descriptor set layout for independent lights
+    // descriptor set layout for the bindless textures
     {
+        // dynamic buffers cannot be update-after-bind, so the texture array has a set of its own
         DescriptorLayoutBuilder builder;
-        builder.add_binding(0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-        _gpu_light_data_descriptor_layout =
-            builder.build(_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        builder.bindings[0].descriptorCount = MAX_BINDLESS_TEXTURES;
+
+        VkDescriptorBindingFlags flags = VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT |
+                                         VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                                         VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                         VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfo bind_flags = {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO, .pNext = nullptr};
+        bind_flags.bindingCount  = 1;
+        bind_flags.pBindingFlags = &flags;
+
+        _bindless_texture_descriptor_layout =
+            builder.build(_device,
+                          VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+                          &bind_flags,
+                          VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT);
     }
 
     _main_deletion_queue.push_function(
@@ -1395,19 +3102,38 @@ void VulkanEngine::init_descriptors()
         {
             vkDestroyDescriptorSetLayout(_device, _draw_image_descriptor_layout, nullptr);
             vkDestroyDescriptorSetLayout(_device, _gpu_scene_data_descriptor_layout, nullptr);
-            vkDestroyDescriptorSetLayout(_device, _gpu_light_data_descriptor_layout, nullptr);
+            vkDestroyDescriptorSetLayout(_device, _bindless_texture_descriptor_layout, nullptr);
         });
 
     // allocate a descriptor set for the draw image
     _draw_image_descriptors = global_descriptor_allocator.allocate(_device, _draw_image_descriptor_layout);
+
+    // the background images written on the compute queue use the same layout
+    if (_async_compute)
     {
-        DescriptorWriter writer;
-        writer.write_image(
-            0, _draw_image.image_view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        for (int i = 0; i < FRAME_OVERLAP; i++)
+        {
+            _frames[i]._background_descriptors =
+                global_descriptor_allocator.allocate(_device, _draw_image_descriptor_layout);
+        }
+    }
 
-        writer.update_set(_device, _draw_image_descriptors);
+    // descriptor set for the tonemapping compute shader (HDR source, LDR destination)
+    if (_headless)
+    {
+        DescriptorLayoutBuilder builder;
+        builder.add_binding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        builder.add_binding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        _tonemap_descriptor_layout = builder.build(_device, VK_SHADER_STAGE_COMPUTE_BIT);
+
+        _tonemap_descriptors = global_descriptor_allocator.allocate(_device, _tonemap_descriptor_layout);
+
+        _main_deletion_queue.push_function(
+            [&]() { vkDestroyDescriptorSetLayout(_device, _tonemap_descriptor_layout, nullptr); });
     }
 
+    write_render_target_descriptors();
+
     // create frame descriptors
 
     for (int i = 0; i < FRAME_OVERLAP; i++)
@@ -1425,6 +3151,73 @@ void VulkanEngine::init_descriptors()
 
         _main_deletion_queue.push_function([&, i]() { _frames[i]._frame_descriptors.destroy_pools(_device); });
     }
+
+    // create the transient buffer; each frame in flight owns one region of it
+
+    VkBufferUsageFlags transient_usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                                         VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT |
+                                         VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+
+    _transient_buffer =
+        create_buffer(TRANSIENT_RING_SIZE * FRAME_OVERLAP, transient_usage, VMA_MEMORY_USAGE_CPU_TO_GPU);
+
+    _main_deletion_queue.push_function(
+        [&]()
+        {
+            destroy_buffer(_transient_buffer);
+
+            // the indirect draw storage is created by the first frames drawing indirectly
+            for (int i = 0; i < FRAME_OVERLAP; i++)
+            {
+                destroy_buffer(_frames[i]._indirect_storage.buffer);
+            }
+        });
+
+    VkBufferDeviceAddressInfo transient_address_info{.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                                                     .buffer = _transient_buffer.buffer};
+    _transient_buffer_address = vkGetBufferDeviceAddress(_device, &transient_address_info);
+
+    for (int i = 0; i < FRAME_OVERLAP; i++)
+    {
+        TransientRing& ring = _frames[i]._transient_ring;
+        ring.buffer         = _transient_buffer;
+        ring.begin          = TRANSIENT_RING_SIZE * i;
+        ring.end            = ring.begin + TRANSIENT_RING_SIZE;
+        ring.alignment      = _min_buffer_alignment;
+        ring.head           = ring.begin;
+    }
+
+    // create the long-lived scene descriptor set
+
+    _global_descriptor_set = global_descriptor_allocator.allocate(_device, _gpu_scene_data_descriptor_layout);
+
+    // the offsets into the transient buffer are supplied when the set is bound
+    DescriptorWriter writer;
+    writer.write_buffer(
+        0, _transient_buffer.buffer, sizeof(GPUSceneData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+    writer.write_buffer(
+        1, _transient_buffer.buffer, sizeof(GPULightData), 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC);
+    writer.update_set(_device, _global_descriptor_set);
+
+    // create the bindless texture set, written as textures are loaded
+
+    std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> bindless_sizes = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, (float)MAX_BINDLESS_TEXTURES},
+    };
+
+    _bindless_descriptor_allocator.init(_device, 1, bindless_sizes, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+
+    _main_deletion_queue.push_function([&]() { _bindless_descriptor_allocator.destroy_pools(_device); });
+
+    VkDescriptorSetVariableDescriptorCountAllocateInfo alloc_array_info{
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO, .pNext = nullptr};
+
+    uint32_t descriptor_counts          = MAX_BINDLESS_TEXTURES;
+    alloc_array_info.pDescriptorCounts  = &descriptor_counts;
+    alloc_array_info.descriptorSetCount = 1;
+
+    _bindless_texture_set =
+        _bindless_descriptor_allocator.allocate(_device, _bindless_texture_descriptor_layout, &alloc_array_info);
 }
 
 AllocatedBuffer VulkanEngine::create_buffer(size_t alloc_size, VkBufferUsageFlags usage, VmaMemoryUsage memory_usage)
@@ -1446,59 +3239,62 @@ AllocatedBuffer VulkanEngine::create_buffer(size_t alloc_size, VkBufferUsageFlag
     return new_buffer;
 }
 
-GPUMeshBuffers VulkanEngine::upload_mesh(std::span<uint32_t> indices, std::span<Vertex> vertices)
+bool VulkanEngine::reserve_geometry(uint32_t vertex_count, uint32_t index_count)
 {
-    const size_t vertex_buffer_size = vertices.size() * sizeof(Vertex);
-    const size_t index_buffer_size  = indices.size() * sizeof(uint32_t);
-
-    GPUMeshBuffers new_surface;
-
-    new_surface.vertex_buffer = create_buffer(vertex_buffer_size,
-                                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                                                  VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-                                              VMA_MEMORY_USAGE_GPU_ONLY);
-
-    // find the address of the vertex buffer
-    VkBufferDeviceAddressInfo device_address_info{.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-                                                  .buffer = new_surface.vertex_buffer.buffer};
-    new_surface.vertex_buffer_address = vkGetBufferDeviceAddress(_device, &device_address_info);
-
-    // create index buffer
-    new_surface.index_buffer = create_buffer(index_buffer_size,
-                                             VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
-                                             VMA_MEMORY_USAGE_GPU_ONLY);
-
-    AllocatedBuffer staging = create_buffer(
-        vertex_buffer_size + index_buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_ONLY);
-
-    void* data = staging.allocation->GetMappedData();
-
-    // copy vertex buffer and index buffer into staging buffer
-    memcpy(data, vertices.data(), vertex_buffer_size);
+    if (_geometry.fits(vertex_count, index_count))
+    {
+        return true;
+    }
 
-    memcpy((char*)data + vertex_buffer_size, indices.data(), index_buffer_size);
+    RetiredGeometryBuffers retired;
+    if (!_geometry.grow(vertex_count, index_count, retired))
+    {
+        fmt::println("Failed to grow the geometry arena for {} vertices and {} indices", vertex_count, index_count);
+        return false;
+    }
 
-    immediate_submit(
-        [&](VkCommandBuffer cmd)
-        {
-            VkBufferCopy vertex_copy{0};
-            vertex_copy.dstOffset = 0;
-            vertex_copy.srcOffset = 0;
-            vertex_copy.size      = vertex_buffer_size;
+    // meshes keep their offsets, so the old contents move over as they are. The copies follow the uploads already
+    // queued into the old buffers, and frames wait for them like for any upload. They join the open batch rather
+    // than being submitted on their own, so a scene load which grows the arena stays one submission
+    _uploads.copy_buffer(retired.vertices.buffer, _geometry.vertex_buffer(), retired.vertex_bytes);
+    _uploads.copy_buffer(retired.indices.buffer, _geometry.index_buffer(), retired.index_bytes);
 
-            vkCmdCopyBuffer(cmd, staging.buffer, new_surface.vertex_buffer.buffer, 1, &vertex_copy);
+    // the batch reads from the old buffers, and frames already submitted still draw from them
+    _uploads.destroy_after_batch(retired.vertices);
+    _uploads.destroy_after_batch(retired.indices);
 
-            VkBufferCopy index_copy{0};
-            index_copy.dstOffset = 0;
-            index_copy.srcOffset = vertex_buffer_size;
-            index_copy.size      = index_buffer_size;
+    fmt::println("Geometry arena grown to {} vertices and {} indices",
+                 _geometry.vertices().capacity(),
+                 _geometry.indices().capacity());
+    return true;
+}
 
-            vkCmdCopyBuffer(cmd, staging.buffer, new_surface.index_buffer.buffer, 1, &index_copy);
-        });
+std::optional<GeometryAllocation> VulkanEngine::upload_mesh(std::span<uint32_t> indices, std::span<Vertex> vertices)
+{
+    uint32_t vertex_count = (uint32_t)vertices.size();
+    uint32_t index_count  = (uint32_t)indices.size();
 
-    destroy_buffer(staging);
+    if (!reserve_geometry(vertex_count, index_count))
+    {
+        return std::nullopt;
+    }
 
-    return new_surface;
+    GeometryAllocation geometry = *_geometry.allocate(vertex_count, index_count);
+
+    // the data is staged immediately, so the spans may be released once this returns. The arena is shared between
+    // the queues, as frames keep drawing from it while the copies run
+    _uploads.upload_buffer(_geometry.vertex_buffer(),
+                           GeometryArena::vertex_offset(geometry),
+                           vertices.data(),
+                           vertices.size() * sizeof(Vertex),
+                           VK_SHARING_MODE_CONCURRENT);
+    _uploads.upload_buffer(_geometry.index_buffer(),
+                           GeometryArena::index_offset(geometry),
+                           indices.data(),
+                           indices.size() * sizeof(uint32_t),
+                           VK_SHARING_MODE_CONCURRENT);
+
+    return geometry;
 }
 
 void VulkanEngine::destroy_buffer(const AllocatedBuffer& buffer)
@@ -1556,12 +3352,7 @@ AllocatedImage VulkanEngine::create_image(void* data,
                                           bool mipmapped /*= false*/,
                                           bool multisampled /*= false*/)
 {
-    // create staging buffer to hold pixel data
     size_t data_size = size.depth * size.width * size.height * 4;
-    AllocatedBuffer upload_buffer =
-        create_buffer(data_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VMA_MEMORY_USAGE_CPU_TO_GPU);
-
-    memcpy(upload_buffer.info.pMappedData, data, data_size);
 
     AllocatedImage new_image = create_image(size,
                                             format,
@@ -1569,43 +3360,8 @@ AllocatedImage VulkanEngine::create_image(void* data,
                                             mipmapped,
                                             multisampled);
 
-    // copy staging buffer pixel data into the new_image
-    immediate_submit(
-        [&](VkCommandBuffer cmd)
-        {
-            vkutil::transition_image(
-                cmd, new_image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-
-            VkBufferImageCopy copy_region = {};
-            copy_region.bufferOffset      = 0;
-            copy_region.bufferRowLength   = 0;
-            copy_region.bufferImageHeight = 0;
-
-            copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
-            copy_region.imageSubresource.mipLevel       = 0;
-            copy_region.imageSubresource.baseArrayLayer = 0;
-            copy_region.imageSubresource.layerCount     = 1;
-            copy_region.imageExtent                     = size;
-
-            vkCmdCopyBufferToImage(
-                cmd, upload_buffer.buffer, new_image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
-
-            if (mipmapped)
-            {
-                vkutil::generate_mipmaps(
-                    cmd, new_image.image, VkExtent2D{new_image.image_extent.width, new_image.image_extent.height});
-            }
-            else
-            {
-
-                vkutil::transition_image(cmd,
-                                         new_image.image,
-                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-            }
-        });
+    _uploads.upload_image(new_image, data, data_size, mipmapped);
 
-    destroy_buffer(upload_buffer);
     return new_image;
 }
 
@@ -1650,7 +3406,7 @@ void GLTFMetallic_Roughness::build_pipelines(VulkanEngine* engine)
     material_layout = layout_builder.build(engine->_device, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
 
     VkDescriptorSetLayout layouts[] = {
-        engine->_gpu_scene_data_descriptor_layout, engine->_gpu_light_data_descriptor_layout, material_layout};
+        engine->_gpu_scene_data_descriptor_layout, material_layout, engine->_bindless_texture_descriptor_layout};
 
     VkPipelineLayoutCreateInfo mesh_layout_info = vkinit::pipeline_layout_create_info();
     mesh_layout_info.setLayoutCount             = 3;
@@ -1738,37 +3494,148 @@ MaterialInstance GLTFMetallic_Roughness::write_material(VkDevice device,
     return mat_data;
 }
 
+void MeshNode::refresh_transform(const glm::mat4& parent_matrix)
+{
+    Node::refresh_transform(parent_matrix);
+    update_bounds();
+}
+
+void MeshNode::update_bounds()
+{
+    surface_bounds.resize(mesh->surfaces.size());
+    for (size_t i = 0; i < mesh->surfaces.size(); i++)
+    {
+        const Bounds& b   = mesh->surfaces[i].bounds;
+        surface_bounds[i] = transform_bounds(b.origin, b.extents, b.sphere_radius, world_transform);
+    }
+}
+
 void MeshNode::draw(const glm::mat4& top_matrix, DrawContext& ctx)
 {
-    glm::mat4 node_matrix = top_matrix * world_transform;
+    // the world transform and the cached bounds hold as long as nothing is applied on top of them
+    bool identity = top_matrix == glm::mat4{1.f};
+    bool cached   = identity && surface_bounds.size() == mesh->surfaces.size();
 
-    for (auto& s : mesh->surfaces)
+    glm::mat4 node_matrix = identity ? world_transform : top_matrix * world_transform;
+    uint64_t version      = identity ? world_version : 0;
+
+    for (uint32_t i = 0; i < mesh->surfaces.size(); i++)
     {
-        RenderObject def;
-        def.index_count           = s.count;
-        def.first_index           = s.start_index;
-        def.index_buffer          = mesh->mesh_buffers.index_buffer.buffer;
-        def.material              = &s.material->data;
-        def.bounds                = s.bounds;
-        def.transform             = node_matrix;
-        def.vertex_buffer_address = mesh->mesh_buffers.vertex_buffer_address;
+        const Bounds& b = mesh->surfaces[i].bounds;
+        ctx.add(render_object(i,
+                              node_matrix,
+                              version,
+                              cached ? surface_bounds[i]
+                                     : transform_bounds(b.origin, b.extents, b.sphere_radius, node_matrix)));
+    }
 
-        if (s.material->data.pass_type == MaterialPass::Transparent)
-        {
-            ctx.transparent_surfaces.push_back(def);
-        }
-        else if (s.material->data.pass_type == MaterialPass::Mask)
+    // recurse down
+    Node::draw(top_matrix, ctx);
+}
+
+RenderObject MeshNode::render_object(uint32_t surface,
+                                     const glm::mat4& transform,
+                                     uint64_t version,
+                                     const WorldBounds& bounds) const
+{
+    const GeoSurface& s = mesh->surfaces[surface];
+
+    RenderObject def;
+    def.index_count       = s.count;
+    def.first_index       = mesh->geometry.first_index + s.start_index;
+    def.vertex_offset     = (int32_t)mesh->geometry.first_vertex;
+    def.material          = &s.material->data;
+    def.bounds            = s.bounds;
+    def.world_bounds      = bounds;
+    def.transform         = transform;
+    def.transform_version = version;
+
+    return def;
+}
+
+void DrawContext::add(const RenderObject& object)
+{
+    if (object.material->pass_type == MaterialPass::Transparent)
+    {
+        transparent_surfaces.push_back(object);
+    }
+    else if (object.material->pass_type == MaterialPass::Mask)
+    {
+        mask_surfaces.push_back(object);
+    }
+    else
+    {
+        opaque_surfaces.push_back(object);
+    }
+}
+
+void DrawRefs::add(const RenderObject& object)
+{
+    if (object.material->pass_type == MaterialPass::Transparent)
+    {
+        transparent_surfaces.push_back(&object);
+    }
+    else if (object.material->pass_type == MaterialPass::Mask)
+    {
+        mask_surfaces.push_back(&object);
+    }
+    else
+    {
+        opaque_surfaces.push_back(&object);
+    }
+}
+
+void DrawRefs::clear()
+{
+    opaque_surfaces.clear();
+    transparent_surfaces.clear();
+    mask_surfaces.clear();
+}
+
+void SceneObjects::update(LoadedGLTF& scene)
+{
+    GPBR_PROFILE_SCOPE("update scene objects");
+
+    std::vector<uint32_t> moved_surfaces;
+    scene.update_transforms(moved_surfaces);
+
+    if (scene.structure_version != version)
+    {
+        // nodes were added or removed, or this is a new scene: the surfaces are renumbered
+        objects.clear();
+        objects.reserve(scene.surfaces.size());
+
+        for (const SurfaceRef& s : scene.surfaces)
         {
-            ctx.mask_surfaces.push_back(def);
+            objects.push_back(s.node->render_object(
+                s.surface, s.node->world_transform, s.node->world_version, s.node->surface_bounds[s.surface]));
         }
-        else
+
+        refs.clear();
+        for (const RenderObject& r : objects)
         {
-            ctx.opaque_surfaces.push_back(def);
+            refs.add(r);
         }
+
+        version = scene.structure_version;
+        return;
     }
 
-    // recurse down
-    Node::draw(top_matrix, ctx);
+    for (uint32_t i : moved_surfaces)
+    {
+        const SurfaceRef& s = scene.surfaces[i];
+
+        objects[i].transform         = s.node->world_transform;
+        objects[i].transform_version = s.node->world_version;
+        objects[i].world_bounds      = s.node->surface_bounds[s.surface];
+    }
+}
+
+void SceneObjects::clear()
+{
+    objects.clear();
+    refs.clear();
+    version = 0;
 }
 
 TextureID TextureCache::add_texture(const VkImageView& image_view, VkSampler sampler, const std::string& name)
@@ -1783,8 +3650,17 @@ TextureID TextureCache::add_texture(const VkImageView& image_view, VkSampler sam
 
     uint32_t index = cache.size();
 
+    if (index >= MAX_BINDLESS_TEXTURES)
+    {
+        fmt::println("Bindless texture limit ({}) reached; {} falls back to texture 0", MAX_BINDLESS_TEXTURES, name);
+        return TextureID{0};
+    }
+
     cache.push_back(VkDescriptorImageInfo{
         .sampler = sampler, .imageView = image_view, .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL});
 
+    // written into the bindless set before the next draw
+    pending.push_back(index);
+
     return TextureID{index};
 }
\ No newline at end of file
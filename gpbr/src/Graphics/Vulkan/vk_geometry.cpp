@@ -0,0 +1,312 @@
+#include "Volk/volk.h"
+#include "gpbr/Graphics/Vulkan/vk_geometry.h"
+#include <algorithm>
+
+void RangeAllocator::init(uint32_t capacity)
+{
+    _capacity = capacity;
+    _used     = 0;
+
+    _free_ranges.clear();
+    _free_ranges.emplace(0, capacity);
+}
+
+void RangeAllocator::grow(uint32_t capacity)
+{
+    if (capacity <= _capacity)
+    {
+        return;
+    }
+
+    uint32_t added = capacity - _capacity;
+
+    // the new range extends a free range ending at the old capacity
+    auto last = _free_ranges.empty() ? _free_ranges.end() : std::prev(_free_ranges.end());
+    if (last != _free_ranges.end() && last->first + last->second == _capacity)
+    {
+        last->second += added;
+    }
+    else
+    {
+        _free_ranges.emplace(_capacity, added);
+    }
+
+    _capacity = capacity;
+}
+
+std::optional<uint32_t> RangeAllocator::allocate(uint32_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    for (auto it = _free_ranges.begin(); it != _free_ranges.end(); it++)
+    {
+        auto [offset, free_count] = *it;
+        if (free_count < count)
+        {
+            continue;
+        }
+
+        // keep the remainder of the range free
+        _free_ranges.erase(it);
+        if (free_count > count)
+        {
+            _free_ranges.emplace(offset + count, free_count - count);
+        }
+
+        _used += count;
+        return offset;
+    }
+
+    return std::nullopt;
+}
+
+void RangeAllocator::free(uint32_t offset, uint32_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    _used -= count;
+
+    auto next = _free_ranges.lower_bound(offset);
+
+    // merge with the free range which follows
+    if (next != _free_ranges.end() && offset + count == next->first)
+    {
+        count += next->second;
+        next = _free_ranges.erase(next);
+    }
+
+    // and with the one which precedes
+    if (next != _free_ranges.begin())
+    {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset)
+        {
+            prev->second += count;
+            return;
+        }
+    }
+
+    _free_ranges.emplace_hint(next, offset, count);
+}
+
+bool RangeAllocator::fits(uint32_t count) const
+{
+    if (count == 0)
+    {
+        return true;
+    }
+
+    for (auto [offset, free_count] : _free_ranges)
+    {
+        if (free_count >= count)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns VK_NULL_HANDLE buffers if the device is out of memory.
+static AllocatedBuffer create_arena_buffer(VmaAllocator allocator,
+                                           VkDeviceSize size,
+                                           VkBufferUsageFlags usage,
+                                           std::span<const uint32_t> queue_families)
+{
+    VkBufferCreateInfo buffer_info = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size               = size;
+    buffer_info.usage              = usage | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+
+    if (queue_families.size() > 1)
+    {
+        buffer_info.sharingMode           = VK_SHARING_MODE_CONCURRENT;
+        buffer_info.queueFamilyIndexCount = (uint32_t)queue_families.size();
+        buffer_info.pQueueFamilyIndices   = queue_families.data();
+    }
+
+    VmaAllocationCreateInfo vma_alloc_info = {};
+    vma_alloc_info.usage                   = VMA_MEMORY_USAGE_GPU_ONLY;
+
+    AllocatedBuffer buffer{};
+    VkResult result =
+        vmaCreateBuffer(allocator, &buffer_info, &vma_alloc_info, &buffer.buffer, &buffer.allocation, &buffer.info);
+
+    if (result != VK_SUCCESS)
+    {
+        return {};
+    }
+    return buffer;
+}
+
+static VkBufferUsageFlags vertex_usage()
+{
+    return VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+}
+
+static VkBufferUsageFlags index_usage()
+{
+    return VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+}
+
+// Returns a capacity at least twice the current one with room for count elements past it, or 0 if none fits in 32
+// bits.
+static uint32_t grown_capacity(uint32_t capacity, uint32_t count)
+{
+    uint64_t grown = std::max<uint64_t>((uint64_t)capacity * 2, (uint64_t)capacity + count);
+    return (grown > UINT32_MAX) ? 0 : (uint32_t)grown;
+}
+
+void GeometryArena::init(VkDevice device,
+                         VmaAllocator allocator,
+                         uint32_t vertex_capacity,
+                         uint32_t index_capacity,
+                         std::span<const uint32_t> queue_families)
+{
+    _device         = device;
+    _allocator      = allocator;
+    _queue_families = {queue_families.begin(), queue_families.end()};
+
+    _vertex_buffer = create_arena_buffer(
+        _allocator, (VkDeviceSize)vertex_capacity * sizeof(Vertex), vertex_usage(), _queue_families);
+    _index_buffer = create_arena_buffer(
+        _allocator, (VkDeviceSize)index_capacity * sizeof(uint32_t), index_usage(), _queue_families);
+
+    if (_vertex_buffer.buffer == VK_NULL_HANDLE || _index_buffer.buffer == VK_NULL_HANDLE)
+    {
+        fmt::println("Failed to create the geometry arena");
+        abort();
+    }
+
+    VkBufferDeviceAddressInfo device_address_info{.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                                                  .buffer = _vertex_buffer.buffer};
+    _vertex_buffer_address = vkGetBufferDeviceAddress(device, &device_address_info);
+
+    _vertices.init(vertex_capacity);
+    _indices.init(index_capacity);
+}
+
+void GeometryArena::destroy()
+{
+    vmaDestroyBuffer(_allocator, _vertex_buffer.buffer, _vertex_buffer.allocation);
+    vmaDestroyBuffer(_allocator, _index_buffer.buffer, _index_buffer.allocation);
+}
+
+std::optional<GeometryAllocation> GeometryArena::allocate(uint32_t vertex_count, uint32_t index_count)
+{
+    std::optional<uint32_t> first_vertex = _vertices.allocate(vertex_count);
+    if (!first_vertex.has_value())
+    {
+        return std::nullopt;
+    }
+
+    std::optional<uint32_t> first_index = _indices.allocate(index_count);
+    if (!first_index.has_value())
+    {
+        _vertices.free(*first_vertex, vertex_count);
+        return std::nullopt;
+    }
+
+    GeometryAllocation allocation;
+    allocation.first_vertex = *first_vertex;
+    allocation.vertex_count = vertex_count;
+    allocation.first_index  = *first_index;
+    allocation.index_count  = index_count;
+    return allocation;
+}
+
+bool GeometryArena::fits(uint32_t vertex_count, uint32_t index_count) const
+{
+    return _vertices.fits(vertex_count) && _indices.fits(index_count);
+}
+
+bool GeometryArena::grow(uint32_t vertex_count, uint32_t index_count, RetiredGeometryBuffers& retired)
+{
+    /* 1 Create the larger buffers, keeping the old ones if either fails */
+
+    uint32_t vertex_capacity = _vertices.capacity();
+    uint32_t index_capacity  = _indices.capacity();
+
+    if (!_vertices.fits(vertex_count))
+    {
+        vertex_capacity = grown_capacity(vertex_capacity, vertex_count);
+    }
+    if (!_indices.fits(index_count))
+    {
+        index_capacity = grown_capacity(index_capacity, index_count);
+    }
+
+    if (vertex_capacity == 0 || index_capacity == 0)
+    {
+        return false;
+    }
+
+    AllocatedBuffer vertex_buffer{};
+    AllocatedBuffer index_buffer{};
+
+    if (vertex_capacity != _vertices.capacity())
+    {
+        vertex_buffer = create_arena_buffer(
+            _allocator, (VkDeviceSize)vertex_capacity * sizeof(Vertex), vertex_usage(), _queue_families);
+    }
+    if (index_capacity != _indices.capacity())
+    {
+        index_buffer = create_arena_buffer(
+            _allocator, (VkDeviceSize)index_capacity * sizeof(uint32_t), index_usage(), _queue_families);
+    }
+
+    bool vertices_failed = vertex_capacity != _vertices.capacity() && vertex_buffer.buffer == VK_NULL_HANDLE;
+    bool indices_failed  = index_capacity != _indices.capacity() && index_buffer.buffer == VK_NULL_HANDLE;
+
+    if (vertices_failed || indices_failed)
+    {
+        vmaDestroyBuffer(_allocator, vertex_buffer.buffer, vertex_buffer.allocation);
+        vmaDestroyBuffer(_allocator, index_buffer.buffer, index_buffer.allocation);
+        return false;
+    }
+
+    /* 2 Swap them in, handing the old ones to the caller */
+
+    retired = {};
+
+    if (vertex_buffer.buffer != VK_NULL_HANDLE)
+    {
+        retired.vertices     = _vertex_buffer;
+        retired.vertex_bytes = (VkDeviceSize)_vertices.capacity() * sizeof(Vertex);
+        _vertex_buffer       = vertex_buffer;
+        _vertices.grow(vertex_capacity);
+
+        VkBufferDeviceAddressInfo device_address_info{.sType  = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+                                                      .buffer = _vertex_buffer.buffer};
+        _vertex_buffer_address = vkGetBufferDeviceAddress(_device, &device_address_info);
+    }
+    if (index_buffer.buffer != VK_NULL_HANDLE)
+    {
+        retired.indices     = _index_buffer;
+        retired.index_bytes = (VkDeviceSize)_indices.capacity() * sizeof(uint32_t);
+        _index_buffer       = index_buffer;
+        _indices.grow(index_capacity);
+    }
+
+    return true;
+}
+
+void GeometryArena::free(const GeometryAllocation& allocation)
+{
+    _vertices.free(allocation.first_vertex, allocation.vertex_count);
+    _indices.free(allocation.first_index, allocation.index_count);
+}
+
+VkDeviceSize GeometryArena::vertex_offset(const GeometryAllocation& allocation)
+{
+    return (VkDeviceSize)allocation.first_vertex * sizeof(Vertex);
+}
+
+VkDeviceSize GeometryArena::index_offset(const GeometryAllocation& allocation)
+{
+    return (VkDeviceSize)allocation.first_index * sizeof(uint32_t);
+}
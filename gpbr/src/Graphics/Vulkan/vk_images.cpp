@@ -19,9 +19,58 @@ void vkutil::transition_image(VkCommandBuffer cmd,
     image_barrier.oldLayout = current_layout;
     image_barrier.newLayout = new_layout;
 
-    VkImageAspectFlags aspect_mask = (new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) ?
-                                         VK_IMAGE_ASPECT_DEPTH_BIT :
-                                         VK_IMAGE_ASPECT_COLOR_BIT;
+    bool depth = new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+                 new_layout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+    VkImageAspectFlags aspect_mask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    image_barrier.subresourceRange = vkinit::image_subresource_range(aspect_mask);
+    image_barrier.image            = image;
+
+    VkDependencyInfo dep_info{};
+    dep_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dep_info.pNext = nullptr;
+
+    dep_info.imageMemoryBarrierCount = 1;
+    dep_info.pImageMemoryBarriers    = &image_barrier;
+
+    vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
+void vkutil::transfer_image_ownership(VkCommandBuffer cmd,
+                                      VkImage image,
+                                      VkImageLayout current_layout,
+                                      VkImageLayout new_layout,
+                                      uint32_t src_queue_family,
+                                      uint32_t dst_queue_family,
+                                      bool release)
+{
+    VkImageMemoryBarrier2 image_barrier{.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2};
+    image_barrier.pNext = nullptr;
+
+    // the releasing queue only makes its writes available, the acquiring queue only makes them visible
+    // (the acquire is ordered after the semaphore wait through its source stages)
+    if (release)
+    {
+        image_barrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        image_barrier.srcAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT;
+        image_barrier.dstStageMask  = VK_PIPELINE_STAGE_2_NONE;
+        image_barrier.dstAccessMask = VK_ACCESS_2_NONE;
+    }
+    else
+    {
+        image_barrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        image_barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        image_barrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        image_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_WRITE_BIT | VK_ACCESS_2_MEMORY_READ_BIT;
+    }
+
+    image_barrier.oldLayout           = current_layout;
+    image_barrier.newLayout           = new_layout;
+    image_barrier.srcQueueFamilyIndex = src_queue_family;
+    image_barrier.dstQueueFamilyIndex = dst_queue_family;
+
+    bool depth = new_layout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL ||
+                 new_layout == VK_IMAGE_LAYOUT_DEPTH_READ_ONLY_OPTIMAL;
+    VkImageAspectFlags aspect_mask = depth ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
     image_barrier.subresourceRange = vkinit::image_subresource_range(aspect_mask);
     image_barrier.image            = image;
 
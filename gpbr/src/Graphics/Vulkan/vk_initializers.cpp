@@ -11,14 +11,15 @@ VkCommandPoolCreateInfo vkinit::command_pool_create_info(uint32_t queue_family_i
     return info;
 }
 
-VkCommandBufferAllocateInfo vkinit::command_buffer_allocate_info(VkCommandPool pool, uint32_t count /*= 1*/)
+VkCommandBufferAllocateInfo vkinit::command_buffer_allocate_info(
+    VkCommandPool pool, uint32_t count /*= 1*/, VkCommandBufferLevel level /*= VK_COMMAND_BUFFER_LEVEL_PRIMARY*/)
 {
     VkCommandBufferAllocateInfo info = {};
     info.sType                       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     info.pNext                       = nullptr;
     info.commandPool                 = pool;
     info.commandBufferCount          = count;
-    info.level                       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    info.level                       = level;
     return info;
 }
 
@@ -1,6 +1,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
 #include <variant>
 #include "Volk/volk.h"
@@ -9,6 +12,7 @@
 #include "gpbr/Graphics/Vulkan/vk_engine.h"
 #include "gpbr/Graphics/Vulkan/vk_initializers.h"
 #include "gpbr/Graphics/Vulkan/vk_types.h"
+#include "gpbr/Util/profiler.h"
 #include <glm/gtx/quaternion.hpp>
 
 #include <fastgltf/glm_element_traits.hpp>
@@ -16,12 +20,21 @@
 #include <fastgltf/types.hpp>
 #include <fastgltf/tools.hpp>
 
-// Attempts to load an image into memory as an AllocatedImage.
-std::optional<AllocatedImage> load_image(VulkanEngine* engine, fastgltf::Asset& asset, fastgltf::Image& image)
+// RGBA8 pixels decoded by stb_image.
+struct DecodedImage
 {
-    AllocatedImage new_image{};
+    unsigned char* data{nullptr}; // Freed with stbi_image_free().
+    int width{0};
+    int height{0};
+};
+
+// Decodes an image into memory. Only reads the asset and touches no Vulkan state, so images may be decoded on any
+// thread.
+DecodedImage decode_image(fastgltf::Asset& asset, fastgltf::Image& image)
+{
+    DecodedImage decoded{};
 
-    int width, height, nrChannels;
+    int nrChannels;
 
     std::visit(
         fastgltf::visitor{
@@ -32,41 +45,16 @@ std::optional<AllocatedImage> load_image(VulkanEngine* engine, fastgltf::Asset&
                 assert(filePath.uri.isLocalPath());
 
                 const std::string path(filePath.uri.path().begin(), filePath.uri.path().end());
-                unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrChannels, 4);
-
-                if (data)
-                {
-                    VkExtent3D imagesize;
-                    imagesize.width  = width;
-                    imagesize.height = height;
-                    imagesize.depth  = 1;
-
-                    new_image = engine->create_image(
-                        data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
-
-                    stbi_image_free(data);
-                }
+                decoded.data = stbi_load(path.c_str(), &decoded.width, &decoded.height, &nrChannels, 4);
             },
             [&](fastgltf::sources::Vector& vector)
             {
-                unsigned char* data = stbi_load_from_memory((unsigned char*)vector.bytes.data(),
-                                                            static_cast<int>(vector.bytes.size()),
-                                                            &width,
-                                                            &height,
-                                                            &nrChannels,
-                                                            4);
-                if (data)
-                {
-                    VkExtent3D imagesize;
-                    imagesize.width  = width;
-                    imagesize.height = height;
-                    imagesize.depth  = 1;
-
-                    new_image = engine->create_image(
-                        data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
-
-                    stbi_image_free(data);
-                }
+                decoded.data = stbi_load_from_memory((unsigned char*)vector.bytes.data(),
+                                                     static_cast<int>(vector.bytes.size()),
+                                                     &decoded.width,
+                                                     &decoded.height,
+                                                     &nrChannels,
+                                                     4);
             },
             [&](fastgltf::sources::BufferView& view)
             {
@@ -76,34 +64,42 @@ std::optional<AllocatedImage> load_image(VulkanEngine* engine, fastgltf::Asset&
                 std::visit(fastgltf::visitor{[](auto& arg) { std::cout << "!monostate!" << std::endl; },
                                              [&](fastgltf::sources::Array& array)
                                              {
-                                                 unsigned char* data = stbi_load_from_memory(
+                                                 decoded.data = stbi_load_from_memory(
                                                      (unsigned char*)array.bytes.data() + bufferView.byteOffset,
                                                      static_cast<int>(bufferView.byteLength),
-                                                     &width,
-                                                     &height,
+                                                     &decoded.width,
+                                                     &decoded.height,
                                                      &nrChannels,
                                                      4);
-                                                 if (data)
-                                                 {
-                                                     VkExtent3D imagesize;
-                                                     imagesize.width  = width;
-                                                     imagesize.height = height;
-                                                     imagesize.depth  = 1;
-
-                                                     new_image = engine->create_image(data,
-                                                                                      imagesize,
-                                                                                      VK_FORMAT_R8G8B8A8_UNORM,
-                                                                                      VK_IMAGE_USAGE_SAMPLED_BIT,
-                                                                                      true);
-
-                                                     stbi_image_free(data);
-                                                 }
                                              }},
                            buffer.data);
             },
         },
         image.data);
 
+    return decoded;
+}
+
+// Uploads decoded pixels as an AllocatedImage and frees them. Must be called from the thread owning the engine's
+// upload manager.
+std::optional<AllocatedImage> upload_image(VulkanEngine* engine, DecodedImage& decoded)
+{
+    if (decoded.data == nullptr)
+    {
+        return {};
+    }
+
+    VkExtent3D imagesize;
+    imagesize.width  = decoded.width;
+    imagesize.height = decoded.height;
+    imagesize.depth  = 1;
+
+    AllocatedImage new_image =
+        engine->create_image(decoded.data, imagesize, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_USAGE_SAMPLED_BIT, true);
+
+    stbi_image_free(decoded.data);
+    decoded.data = nullptr;
+
     if (new_image.image == VK_NULL_HANDLE)
     {
         return {};
@@ -150,10 +146,122 @@ VkSamplerMipmapMode extract_mipmap_mode(fastgltf::Filter filter)
     }
 }
 
+// Reads the index and vertex data of every primitive of a mesh and fills in its surfaces.
+// Only reads the asset, so meshes may be decoded on any thread.
+void decode_mesh(fastgltf::Asset& gltf,
+                 fastgltf::Mesh& mesh,
+                 const std::vector<std::shared_ptr<GLTFMaterial>>& materials,
+                 MeshAsset& new_mesh,
+                 std::vector<uint32_t>& indices,
+                 std::vector<Vertex>& vertices)
+{
+    for (auto&& p : mesh.primitives)
+    {
+        GeoSurface new_surface;
+        new_surface.start_index = (uint32_t)indices.size();
+        new_surface.count       = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
+
+        size_t initial_vtx = vertices.size();
+
+        // load indices
+        {
+            fastgltf::Accessor& index_accessor = gltf.accessors[p.indicesAccessor.value()];
+            indices.reserve(indices.size() + index_accessor.count);
+
+            fastgltf::iterateAccessor<std::uint32_t>(
+                gltf, index_accessor, [&](std::uint32_t idx) { indices.push_back(idx + initial_vtx); });
+        }
+
+        // load vertex positions
+        {
+            fastgltf::Accessor& pos_accessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
+            vertices.resize(vertices.size() + pos_accessor.count);
+
+            fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf,
+                                                          pos_accessor,
+                                                          [&](glm::vec3 v, size_t index)
+                                                          {
+                                                              Vertex new_vertex;
+                                                              new_vertex.position           = v;
+                                                              new_vertex.normal             = {1, 0, 0};
+                                                              new_vertex.color              = glm::vec4{1.f};
+                                                              new_vertex.uv_x               = 0;
+                                                              new_vertex.uv_y               = 0;
+                                                              vertices[initial_vtx + index] = new_vertex;
+                                                          });
+        }
+
+        // load vertex normals
+        auto normals = p.findAttribute("NORMAL");
+        if (normals != p.attributes.end())
+        {
+
+            fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf,
+                                                          gltf.accessors[(*normals).accessorIndex],
+                                                          [&](glm::vec3 v, size_t index)
+                                                          { vertices[initial_vtx + index].normal = v; });
+        }
+
+        // load vertex UVs
+        auto uv = p.findAttribute("TEXCOORD_0");
+        if (uv != p.attributes.end())
+        {
+
+            fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf,
+                                                          gltf.accessors[(*uv).accessorIndex],
+                                                          [&](glm::vec2 v, size_t index)
+                                                          {
+                                                              vertices[initial_vtx + index].uv_x = v.x;
+                                                              vertices[initial_vtx + index].uv_y = v.y;
+                                                          });
+        }
+
+        // load vertex colors
+        auto colors = p.findAttribute("COLOR_0");
+        if (colors != p.attributes.end())
+        {
+
+            fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf,
+                                                          gltf.accessors[(*colors).accessorIndex],
+                                                          [&](glm::vec4 v, size_t index)
+                                                          { vertices[initial_vtx + index].color = v; });
+        }
+
+        if (p.materialIndex.has_value())
+        {
+            new_surface.material = materials[p.materialIndex.value()];
+        }
+        else
+        {
+            new_surface.material = materials[0];
+        }
+
+        // Calculate the bounding box for the surface
+
+        glm::vec3 minpos = vertices[initial_vtx].position;
+        glm::vec3 maxpos = vertices[initial_vtx].position;
+        for (int i = initial_vtx; i < vertices.size(); i++)
+        {
+            minpos = glm::min(minpos, vertices[i].position);
+            maxpos = glm::max(maxpos, vertices[i].position);
+        }
+
+        new_surface.bounds.origin        = (maxpos + minpos) / 2.f;
+        new_surface.bounds.extents       = (maxpos - minpos) / 2.f;
+        new_surface.bounds.sphere_radius = glm::length(new_surface.bounds.extents);
+        new_mesh.surfaces.push_back(new_surface);
+    }
+}
+
 std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::string_view file_path)
 {
     fmt::println("Loading glTF: {}", file_path);
 
+    auto load_start = std::chrono::steady_clock::now();
+
+    GPBR_PROFILE_SCOPE("load_gltf");
+    util::ProfileZone phase{"gltf parse"};
+
     std::shared_ptr<LoadedGLTF> scene = std::make_shared<LoadedGLTF>();
     scene->creator                    = engine;
     LoadedGLTF& file                  = *scene.get();
@@ -211,6 +319,8 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
 
     //= Initialize the descriptor pool =========================================
 
+    phase.next("gltf samplers");
+
     std::vector<DescriptorAllocatorGrowable::PoolSizeRatio> sizes = {
         {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 3},
         {        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 3},
@@ -247,12 +357,68 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
 
     //= Load all textures (use error texture by default) =======================
 
+    phase.next("gltf textures");
+
     // TODO: Use different criteria to differentiate textures
 
+    // decoding dominates load times, so images are decoded across the job system and uploaded afterwards
+    std::vector<DecodedImage> decoded_images(gltf.images.size());
+
+    engine->_job_system->parallel_for((uint32_t)gltf.images.size(),
+                                      1,
+                                      [&](uint32_t begin, uint32_t end, uint32_t thread_index)
+                                      {
+                                          GPBR_PROFILE_SCOPE("decode image");
+                                          for (uint32_t i = begin; i < end; i++)
+                                          {
+                                              decoded_images[i] = decode_image(gltf, gltf.images[i]);
+                                          }
+                                      });
+
+    // set aside staging for every image and mesh up front, so the whole asset is uploaded in one submission
+    // instead of the staging ring flushing and waiting whenever it fills up
+    VkDeviceSize staging_size  = 0;
+    uint32_t staging_uploads   = 0;
+    uint32_t batches_submitted = engine->_uploads.submitted_batches();
+    uint64_t bytes_uploaded    = engine->_uploads.uploaded_bytes();
+
+    for (DecodedImage& decoded : decoded_images)
+    {
+        if (decoded.data != nullptr)
+        {
+            staging_size += (VkDeviceSize)decoded.width * decoded.height * 4;
+            staging_uploads++;
+        }
+    }
+
+    uint64_t total_vertices = 0;
+    uint64_t total_indices  = 0;
+    for (fastgltf::Mesh& mesh : gltf.meshes)
+    {
+        for (auto&& p : mesh.primitives)
+        {
+            total_indices += gltf.accessors[p.indicesAccessor.value()].count;
+            total_vertices += gltf.accessors[p.findAttribute("POSITION")->accessorIndex].count;
+        }
+        staging_uploads += 2;
+    }
+    staging_size += total_indices * sizeof(uint32_t) + total_vertices * sizeof(Vertex);
+
+    // grow the arena once for the whole file rather than mesh by mesh, and before anything is staged: a file which
+    // does not fit leaves no uploads behind, and the copies of the arena's old contents join this file's batch
+    if (total_vertices > UINT32_MAX || total_indices > UINT32_MAX ||
+        !engine->reserve_geometry((uint32_t)total_vertices, (uint32_t)total_indices))
+    {
+        fmt::println("Not enough geometry memory for {}", file_path);
+        return {};
+    }
+
+    engine->_uploads.reserve(staging_size, staging_uploads);
+
     int ic = 0; // image counter
     for (fastgltf::Image& image : gltf.images)
     {
-        std::optional<AllocatedImage> img = load_image(engine, gltf, image);
+        std::optional<AllocatedImage> img = upload_image(engine, decoded_images[ic]);
 
         if (img.has_value())
         {
@@ -271,6 +437,8 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
 
     //= Load materials =========================================================
 
+    phase.next("gltf materials");
+
     file.material_data_buffer =
         engine->create_buffer(sizeof(GLTFMetallic_Roughness::MaterialConstants) * gltf.materials.size(),
                               VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
@@ -368,8 +536,11 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
 
     //= Load meshes ============================================================
 
-    std::vector<uint32_t> indices;
-    std::vector<Vertex> vertices;
+    phase.next("gltf meshes");
+
+    // vertex data of each mesh; decoded across the job system and uploaded in order afterwards
+    std::vector<std::vector<uint32_t>> mesh_indices(gltf.meshes.size());
+    std::vector<std::vector<Vertex>> mesh_vertices(gltf.meshes.size());
 
     for (fastgltf::Mesh& mesh : gltf.meshes)
     {
@@ -377,112 +548,46 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
         meshes.push_back(new_mesh);
         file.meshes[mesh.name.c_str()] = new_mesh;
         new_mesh->name                 = mesh.name;
+    }
 
-        indices.clear();
-        vertices.clear();
-
-        for (auto&& p : mesh.primitives)
+    engine->_job_system->parallel_for(
+        (uint32_t)gltf.meshes.size(),
+        1,
+        [&](uint32_t begin, uint32_t end, uint32_t thread_index)
         {
-            GeoSurface new_surface;
-            new_surface.start_index = (uint32_t)indices.size();
-            new_surface.count       = (uint32_t)gltf.accessors[p.indicesAccessor.value()].count;
-
-            size_t initial_vtx = vertices.size();
-
-            // load indices
-            {
-                fastgltf::Accessor& index_accessor = gltf.accessors[p.indicesAccessor.value()];
-                indices.reserve(indices.size() + index_accessor.count);
-
-                fastgltf::iterateAccessor<std::uint32_t>(
-                    gltf, index_accessor, [&](std::uint32_t idx) { indices.push_back(idx + initial_vtx); });
-            }
-
-            // load vertex positions
-            {
-                fastgltf::Accessor& pos_accessor = gltf.accessors[p.findAttribute("POSITION")->accessorIndex];
-                vertices.resize(vertices.size() + pos_accessor.count);
-
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf,
-                                                              pos_accessor,
-                                                              [&](glm::vec3 v, size_t index)
-                                                              {
-                                                                  Vertex new_vertex;
-                                                                  new_vertex.position           = v;
-                                                                  new_vertex.normal             = {1, 0, 0};
-                                                                  new_vertex.color              = glm::vec4{1.f};
-                                                                  new_vertex.uv_x               = 0;
-                                                                  new_vertex.uv_y               = 0;
-                                                                  vertices[initial_vtx + index] = new_vertex;
-                                                              });
-            }
-
-            // load vertex normals
-            auto normals = p.findAttribute("NORMAL");
-            if (normals != p.attributes.end())
-            {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec3>(gltf,
-                                                              gltf.accessors[(*normals).accessorIndex],
-                                                              [&](glm::vec3 v, size_t index)
-                                                              { vertices[initial_vtx + index].normal = v; });
-            }
-
-            // load vertex UVs
-            auto uv = p.findAttribute("TEXCOORD_0");
-            if (uv != p.attributes.end())
-            {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec2>(gltf,
-                                                              gltf.accessors[(*uv).accessorIndex],
-                                                              [&](glm::vec2 v, size_t index)
-                                                              {
-                                                                  vertices[initial_vtx + index].uv_x = v.x;
-                                                                  vertices[initial_vtx + index].uv_y = v.y;
-                                                              });
-            }
-
-            // load vertex colors
-            auto colors = p.findAttribute("COLOR_0");
-            if (colors != p.attributes.end())
-            {
-
-                fastgltf::iterateAccessorWithIndex<glm::vec4>(gltf,
-                                                              gltf.accessors[(*colors).accessorIndex],
-                                                              [&](glm::vec4 v, size_t index)
-                                                              { vertices[initial_vtx + index].color = v; });
-            }
-
-            if (p.materialIndex.has_value())
+            GPBR_PROFILE_SCOPE("decode mesh");
+            for (uint32_t i = begin; i < end; i++)
             {
-                new_surface.material = materials[p.materialIndex.value()];
-            }
-            else
-            {
-                new_surface.material = materials[0];
+                decode_mesh(gltf, gltf.meshes[i], materials, *meshes[i], mesh_indices[i], mesh_vertices[i]);
             }
+        });
 
-            // Calculate the bounding box for the surface
-
-            glm::vec3 minpos = vertices[initial_vtx].position;
-            glm::vec3 maxpos = vertices[initial_vtx].position;
-            for (int i = initial_vtx; i < vertices.size(); i++)
-            {
-                minpos = glm::min(minpos, vertices[i].position);
-                maxpos = glm::max(maxpos, vertices[i].position);
-            }
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        std::optional<GeometryAllocation> geometry = engine->upload_mesh(mesh_indices[i], mesh_vertices[i]);
+        if (!geometry.has_value())
+        {
+            // submit what was staged rather than leave the reservation open for the next upload to inherit; the
+            // scene releases the images and meshes once the batch is done
+            engine->_uploads.flush();
 
-            new_surface.bounds.origin        = (maxpos + minpos) / 2.f;
-            new_surface.bounds.extents       = (maxpos - minpos) / 2.f;
-            new_surface.bounds.sphere_radius = glm::length(new_surface.bounds.extents);
-            new_mesh->surfaces.push_back(new_surface);
+            fmt::println("Not enough geometry memory for {}", file_path);
+            return {};
         }
+        meshes[i]->geometry = *geometry;
 
-        new_mesh->mesh_buffers = engine->upload_mesh(indices, vertices);
+        // release the CPU copy as soon as it is staged
+        mesh_indices[i]  = {};
+        mesh_vertices[i] = {};
     }
 
+    // start the copies while the nodes are built; frames wait for them on the GPU
+    engine->_uploads.flush();
+
     //= Load nodes and their associated meshes =================================
 
+    phase.next("gltf nodes");
+
     for (fastgltf::Node& node : gltf.nodes)
     {
         std::shared_ptr<Node> new_node;
@@ -524,6 +629,8 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
     }
 
     // run loop again to setup transform hierarchy
+    std::vector<uint32_t> parents(nodes.size(), TransformHierarchy::NO_PARENT);
+
     for (int i = 0; i < gltf.nodes.size(); i++)
     {
         fastgltf::Node& node              = gltf.nodes[i];
@@ -533,6 +640,7 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
         {
             scene_node->children.push_back(nodes[c]);
             nodes[c]->parent = scene_node;
+            parents[c]       = (uint32_t)i;
         }
     }
 
@@ -542,9 +650,25 @@ std::optional<std::shared_ptr<LoadedGLTF>> load_gltf(VulkanEngine* engine, std::
         if (node->parent.lock() == nullptr)
         {
             file.top_nodes.push_back(node);
-            node->refresh_transform(glm::mat4{1.f});
         }
     }
+
+    // flatten the hierarchy straight from the glTF node indices, and propagate the transforms in one pass
+    std::vector<Node*> node_pointers(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        node_pointers[i] = nodes[i].get();
+    }
+
+    file.build_transforms(node_pointers, parents);
+    file.build_bvh();
+
+    float load_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - load_start).count();
+    fmt::println("Loaded glTF in {:.1f} ms: {:.1f} MiB uploaded in {} submission(s)",
+                 load_ms,
+                 (engine->_uploads.uploaded_bytes() - bytes_uploaded) / (1024.f * 1024.f),
+                 engine->_uploads.submitted_batches() - batches_submitted);
+
     return scene;
 }
 
@@ -556,32 +680,246 @@ void LoadedGLTF::draw(const glm::mat4& top_matrix, DrawContext& ctx)
     }
 }
 
+void LoadedGLTF::query_visible(const FrustumPlanes& planes, std::vector<uint32_t>& visible) const
+{
+    size_t first = visible.size();
+    bvh.query_frustum(planes, visible);
+
+    // in drawing order, so the draws come out the same from tick to tick
+    std::sort(visible.begin() + first, visible.end());
+}
+
+void LoadedGLTF::add_node(const std::shared_ptr<Node>& node, const std::shared_ptr<Node>& parent)
+{
+    if (parent)
+    {
+        parent->children.push_back(node);
+        node->parent = parent;
+    }
+    else
+    {
+        top_nodes.push_back(node);
+    }
+
+    rebuild_transforms();
+    build_bvh();
+}
+
+void LoadedGLTF::remove_node(const std::shared_ptr<Node>& node)
+{
+    std::shared_ptr<Node> parent                 = node->parent.lock();
+    std::vector<std::shared_ptr<Node>>& siblings = parent ? parent->children : top_nodes;
+
+    siblings.erase(std::remove(siblings.begin(), siblings.end(), node), siblings.end());
+    node->parent.reset();
+
+    rebuild_transforms();
+    build_bvh();
+}
+
+void LoadedGLTF::mark_moved(const Node& node)
+{
+    transforms.set_local(node.transform_index, node.local_transform);
+}
+
+void LoadedGLTF::update_transforms(std::vector<uint32_t>& moved_surfaces)
+{
+    _updated_ranges.clear();
+    if (!transforms.update(_updated_ranges))
+    {
+        return;
+    }
+
+    size_t first = moved_surfaces.size();
+    for (const TransformRange& range : _updated_ranges)
+    {
+        sync_nodes(range.begin, range.end, &moved_surfaces);
+    }
+
+    std::span<const uint32_t> moved(moved_surfaces.begin() + first, moved_surfaces.end());
+
+    std::vector<WorldBounds> bounds(moved.size());
+    for (size_t i = 0; i < moved.size(); i++)
+    {
+        const SurfaceRef& s = surfaces[moved[i]];
+        bounds[i]           = s.node->surface_bounds[s.surface];
+    }
+
+    bvh.refit(moved, bounds);
+}
+
+void LoadedGLTF::build_transforms(std::span<Node* const> nodes, std::span<const uint32_t> parents)
+{
+    std::vector<glm::mat4> locals(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        locals[i] = nodes[i]->local_transform;
+    }
+
+    std::vector<uint32_t> indices = transforms.build(locals, parents);
+
+    _transform_nodes.resize(nodes.size());
+    _transform_meshes.resize(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        nodes[i]->transform_index = indices[i];
+
+        _transform_nodes[indices[i]]  = nodes[i];
+        _transform_meshes[indices[i]] = dynamic_cast<MeshNode*>(nodes[i]);
+    }
+
+    sync_nodes(0, transforms.size(), nullptr);
+}
+
+void LoadedGLTF::rebuild_transforms()
+{
+    std::vector<Node*> nodes;
+    std::vector<uint32_t> parents;
+
+    // depth first; each entry of the stack is a node and the index of its parent in nodes
+    std::vector<std::pair<Node*, uint32_t>> stack;
+    for (auto it = top_nodes.rbegin(); it != top_nodes.rend(); it++)
+    {
+        stack.push_back({it->get(), TransformHierarchy::NO_PARENT});
+    }
+
+    while (!stack.empty())
+    {
+        auto [node, parent] = stack.back();
+        stack.pop_back();
+
+        uint32_t index = (uint32_t)nodes.size();
+        nodes.push_back(node);
+        parents.push_back(parent);
+
+        for (auto it = node->children.rbegin(); it != node->children.rend(); it++)
+        {
+            stack.push_back({it->get(), index});
+        }
+    }
+
+    build_transforms(nodes, parents);
+}
+
+void LoadedGLTF::sync_nodes(uint32_t begin, uint32_t end, std::vector<uint32_t>* moved_surfaces)
+{
+    for (uint32_t i = begin; i < end; i++)
+    {
+        _transform_nodes[i]->world_transform = transforms.world(i);
+        _transform_nodes[i]->world_version   = transforms.world_version(i);
+
+        MeshNode* mesh_node = _transform_meshes[i];
+        if (mesh_node == nullptr)
+        {
+            continue;
+        }
+
+        mesh_node->update_bounds();
+
+        if (moved_surfaces != nullptr)
+        {
+            for (uint32_t s = 0; s < mesh_node->mesh->surfaces.size(); s++)
+            {
+                moved_surfaces->push_back(mesh_node->first_surface + s);
+            }
+        }
+    }
+}
+
+std::vector<WorldBounds> LoadedGLTF::surface_bounds() const
+{
+    std::vector<WorldBounds> bounds(surfaces.size());
+    for (size_t i = 0; i < surfaces.size(); i++)
+    {
+        bounds[i] = surfaces[i].node->surface_bounds[surfaces[i].surface];
+    }
+    return bounds;
+}
+
+void LoadedGLTF::build_bvh()
+{
+    surfaces.clear();
+
+    // in hierarchy order, so the surfaces of a subtree are contiguous
+    for (MeshNode* mesh_node : _transform_meshes)
+    {
+        if (mesh_node == nullptr)
+        {
+            continue;
+        }
+
+        mesh_node->first_surface = (uint32_t)surfaces.size();
+        for (uint32_t i = 0; i < mesh_node->mesh->surfaces.size(); i++)
+        {
+            surfaces.push_back({mesh_node, i});
+        }
+    }
+
+    bvh.build(surface_bounds());
+
+    static std::atomic<uint64_t> next_structure_version{1};
+    structure_version = next_structure_version.fetch_add(1, std::memory_order_relaxed);
+}
+
 void LoadedGLTF::clear_all()
 {
-    VkDevice dv = creator->_device;
+    VulkanEngine* engine = creator;
+    if (engine == nullptr)
+    {
+        return;
+    }
+
+    /* 1 Gather the resources, leaving out the default images */
 
+    std::vector<GeometryAllocation> geometry;
     for (auto& [k, v] : meshes)
     {
-        creator->destroy_buffer(v->mesh_buffers.index_buffer);
-        creator->destroy_buffer(v->mesh_buffers.vertex_buffer);
+        geometry.push_back(v->geometry);
     }
 
+    std::vector<AllocatedImage> owned_images;
     for (auto& [k, v] : images)
     {
-
-        if (v.image == creator->_error_checkerboard_image.image)
+        if (v.image == engine->_error_checkerboard_image.image)
         {
             continue; // dont destroy the default images
         }
-        creator->destroy_image(v);
+        owned_images.push_back(v);
     }
 
-    for (auto& sampler : samplers)
-    {
-        vkDestroySampler(dv, sampler, nullptr);
-    }
+    /* 2 Destroy them once the frames and uploads submitted so far, which may still use them, have finished */
+
+    // queued uploads into the buffers are submitted first, so the last graphics point covers them too
+    engine->_uploads.flush();
+
+    engine->_deferred_deletion.push(
+        engine->_timeline.last(QueueType::Graphics),
+        [engine,
+         geometry        = std::move(geometry),
+         material_buffer = material_data_buffer,
+         owned_images    = std::move(owned_images),
+         samplers        = std::move(samplers),
+         pool            = std::move(descriptor_pool)]() mutable
+        {
+            // the ranges are only reused once nothing draws from them
+            for (const GeometryAllocation& allocation : geometry)
+            {
+                engine->_geometry.free(allocation);
+            }
+
+            engine->destroy_buffer(material_buffer);
 
-    descriptor_pool.destroy_pools(dv);
+            for (AllocatedImage& image : owned_images)
+            {
+                engine->destroy_image(image);
+            }
+
+            for (VkSampler sampler : samplers)
+            {
+                vkDestroySampler(engine->_device, sampler, nullptr);
+            }
 
-    creator->destroy_buffer(material_data_buffer);
+            pool.destroy_pools(engine->_device);
+        });
 }
\ No newline at end of file
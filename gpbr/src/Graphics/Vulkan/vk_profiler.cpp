@@ -0,0 +1,134 @@
+#include "Volk/volk.h"
+#include "gpbr/Graphics/Vulkan/vk_profiler.h"
+#include "gpbr/Graphics/Vulkan/vk_initializers.h"
+#include <string_view>
+
+void GpuProfiler::init(VkDevice device, float timestamp_period, uint32_t valid_bits, uint32_t max_scopes)
+{
+    _device           = device;
+    _timestamp_period = timestamp_period;
+    _max_queries      = max_scopes * 2;
+    _valid_mask       = (valid_bits >= 64) ? ~0ull : ((1ull << valid_bits) - 1);
+
+    if (valid_bits == 0)
+    {
+        return;
+    }
+
+    VkQueryPoolCreateInfo info = vkinit::query_pool_create_info(VK_QUERY_TYPE_TIMESTAMP, _max_queries);
+    VK_CHECK(vkCreateQueryPool(_device, &info, nullptr, &_pool));
+
+    // queries must be reset before their first use (hostQueryReset)
+    vkResetQueryPool(_device, _pool, 0, _max_queries);
+
+    _timestamps.resize(_max_queries);
+}
+
+void GpuProfiler::destroy()
+{
+    if (_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyQueryPool(_device, _pool, nullptr);
+        _pool = VK_NULL_HANDLE;
+    }
+}
+
+void GpuProfiler::collect()
+{
+    if (_pool == VK_NULL_HANDLE || _next_query == 0)
+    {
+        return;
+    }
+
+    // the command buffer has finished, so every written query is available without waiting
+    VkResult result = vkGetQueryPoolResults(_device,
+                                            _pool,
+                                            0,
+                                            _next_query,
+                                            _next_query * sizeof(uint64_t),
+                                            _timestamps.data(),
+                                            sizeof(uint64_t),
+                                            VK_QUERY_RESULT_64_BIT);
+
+    if (result == VK_SUCCESS)
+    {
+        _results.clear();
+        for (const Scope& scope : _scopes)
+        {
+            // a scope left open has no end timestamp
+            if (scope.end_query == UINT32_MAX)
+            {
+                continue;
+            }
+
+            uint64_t ticks  = (_timestamps[scope.end_query] - _timestamps[scope.begin_query]) & _valid_mask;
+            double start_ms = (double)(_timestamps[scope.begin_query] & _valid_mask) * _timestamp_period / 1000000.0;
+            _results.push_back({scope.name, (float)ticks * _timestamp_period / 1000000.f, scope.depth, start_ms});
+        }
+    }
+
+    vkResetQueryPool(_device, _pool, 0, _next_query);
+
+    _next_query = 0;
+    _scopes.clear();
+    _open_scopes.clear();
+}
+
+void GpuProfiler::begin_scope(VkCommandBuffer cmd, const char* name)
+{
+    if (_pool == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    // a scope beyond the pool's capacity is not timed, but still opened so end_scope closes it and not its parent
+    if (_next_query + 2 > _max_queries)
+    {
+        _open_scopes.push_back(DROPPED_SCOPE);
+        return;
+    }
+
+    // the end query is reserved now so a scope always owns a consecutive pair
+    uint32_t begin_query = _next_query;
+    _next_query += 2;
+
+    _open_scopes.push_back((uint32_t)_scopes.size());
+    _scopes.push_back({name, begin_query, UINT32_MAX, (int)_open_scopes.size() - 1});
+
+    // ALL_COMMANDS waits for prior work, so sequential scopes do not overlap
+    vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _pool, begin_query);
+}
+
+void GpuProfiler::end_scope(VkCommandBuffer cmd)
+{
+    if (_open_scopes.empty())
+    {
+        return;
+    }
+
+    uint32_t index = _open_scopes.back();
+    _open_scopes.pop_back();
+
+    if (index == DROPPED_SCOPE)
+    {
+        return;
+    }
+
+    Scope& scope = _scopes[index];
+
+    scope.end_query = scope.begin_query + 1;
+
+    vkCmdWriteTimestamp2(cmd, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, _pool, scope.end_query);
+}
+
+float GpuProfiler::find(const char* name) const
+{
+    for (const GpuScopeTiming& timing : _results)
+    {
+        if (std::string_view(timing.name) == name)
+        {
+            return timing.time_ms;
+        }
+    }
+    return 0.f;
+}
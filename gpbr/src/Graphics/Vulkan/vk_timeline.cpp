@@ -0,0 +1,112 @@
+#include "Volk/volk.h"
+#include "gpbr/Graphics/Vulkan/vk_timeline.h"
+#include "gpbr/Graphics/Vulkan/vk_initializers.h"
+#include <algorithm>
+
+void DeviceTimeline::init(VkDevice device)
+{
+    _device = device;
+
+    VkSemaphoreTypeCreateInfo timeline_info{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+    timeline_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timeline_info.initialValue  = 0;
+
+    VkSemaphoreCreateInfo semaphore_info = vkinit::semaphore_create_info();
+    semaphore_info.pNext                 = &timeline_info;
+
+    for (VkSemaphore& semaphore : _semaphores)
+    {
+        VK_CHECK(vkCreateSemaphore(_device, &semaphore_info, nullptr, &semaphore));
+    }
+}
+
+void DeviceTimeline::destroy()
+{
+    for (VkSemaphore& semaphore : _semaphores)
+    {
+        vkDestroySemaphore(_device, semaphore, nullptr);
+        semaphore = VK_NULL_HANDLE;
+    }
+}
+
+TimelinePoint DeviceTimeline::next(QueueType queue)
+{
+    return {queue, ++_reserved[(size_t)queue]};
+}
+
+TimelinePoint DeviceTimeline::last(QueueType queue) const
+{
+    return {queue, _reserved[(size_t)queue]};
+}
+
+VkSemaphoreSubmitInfo DeviceTimeline::signal_info(TimelinePoint point, VkPipelineStageFlags2 stage_mask) const
+{
+    VkSemaphoreSubmitInfo info = vkinit::semaphore_submit_info(stage_mask, _semaphores[(size_t)point.queue]);
+    info.value                 = point.value;
+    return info;
+}
+
+VkSemaphoreSubmitInfo DeviceTimeline::wait_info(TimelinePoint point, VkPipelineStageFlags2 stage_mask) const
+{
+    VkSemaphoreSubmitInfo info = vkinit::semaphore_submit_info(stage_mask, _semaphores[(size_t)point.queue]);
+    info.value                 = point.value;
+    return info;
+}
+
+bool DeviceTimeline::is_complete(TimelinePoint point)
+{
+    uint64_t& completed = _completed[(size_t)point.queue];
+
+    if (point.value > completed)
+    {
+        VK_CHECK(vkGetSemaphoreCounterValue(_device, _semaphores[(size_t)point.queue], &completed));
+    }
+    return point.value <= completed;
+}
+
+VkResult DeviceTimeline::wait(TimelinePoint point, uint64_t timeout_ns)
+{
+    if (point.value <= _completed[(size_t)point.queue])
+    {
+        return VK_SUCCESS;
+    }
+
+    VkSemaphoreWaitInfo wait_info{.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores    = &_semaphores[(size_t)point.queue];
+    wait_info.pValues        = &point.value;
+
+    VkResult result = vkWaitSemaphores(_device, &wait_info, timeout_ns);
+    if (result == VK_SUCCESS)
+    {
+        _completed[(size_t)point.queue] = std::max(_completed[(size_t)point.queue], point.value);
+    }
+    return result;
+}
+
+void TimelineDeletionQueue::push(TimelinePoint point, std::function<void()>&& function)
+{
+    _entries.push_back({point, std::move(function)});
+}
+
+void TimelineDeletionQueue::collect(DeviceTimeline& timeline)
+{
+    // entries of different queues complete out of order, so the whole queue is scanned
+    auto remaining = std::stable_partition(
+        _entries.begin(), _entries.end(), [&](const Entry& entry) { return !timeline.is_complete(entry.point); });
+
+    for (auto it = remaining; it != _entries.end(); it++)
+    {
+        it->function();
+    }
+    _entries.erase(remaining, _entries.end());
+}
+
+void TimelineDeletionQueue::flush()
+{
+    for (Entry& entry : _entries)
+    {
+        entry.function();
+    }
+    _entries.clear();
+}
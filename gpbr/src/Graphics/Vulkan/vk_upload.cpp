@@ -0,0 +1,548 @@
+#include "Volk/volk.h"
+#include "gpbr/Graphics/Vulkan/vk_upload.h"
+#include "gpbr/Graphics/Vulkan/vk_images.h"
+#include "gpbr/Graphics/Vulkan/vk_initializers.h"
+#include "gpbr/Util/profiler.h"
+#include <cstring>
+
+// Covers the texel size of every format uploaded, as transfer queues require for buffer to image copies.
+constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+static AllocatedBuffer create_staging_buffer(VmaAllocator allocator, VkDeviceSize size)
+{
+    VkBufferCreateInfo buffer_info = {.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
+    buffer_info.size               = size;
+    buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+    VmaAllocationCreateInfo vma_alloc_info = {};
+    vma_alloc_info.usage                   = VMA_MEMORY_USAGE_CPU_ONLY;
+    vma_alloc_info.flags                   = VMA_ALLOCATION_CREATE_MAPPED_BIT;
+
+    AllocatedBuffer buffer;
+    VK_CHECK(
+        vmaCreateBuffer(allocator, &buffer_info, &vma_alloc_info, &buffer.buffer, &buffer.allocation, &buffer.info));
+    return buffer;
+}
+
+// Records one half of a buffer's queue family ownership transfer; see vkutil::transfer_image_ownership.
+static void transfer_buffer_ownership(
+    VkCommandBuffer cmd, VkBuffer buffer, uint32_t src_queue_family, uint32_t dst_queue_family, bool release)
+{
+    VkBufferMemoryBarrier2 buffer_barrier{.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER_2};
+
+    if (release)
+    {
+        buffer_barrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+        buffer_barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+        buffer_barrier.dstStageMask  = VK_PIPELINE_STAGE_2_NONE;
+        buffer_barrier.dstAccessMask = VK_ACCESS_2_NONE;
+    }
+    else
+    {
+        buffer_barrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        buffer_barrier.srcAccessMask = VK_ACCESS_2_NONE;
+        buffer_barrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+        buffer_barrier.dstAccessMask = VK_ACCESS_2_MEMORY_READ_BIT;
+    }
+
+    buffer_barrier.srcQueueFamilyIndex = src_queue_family;
+    buffer_barrier.dstQueueFamilyIndex = dst_queue_family;
+    buffer_barrier.buffer              = buffer;
+    buffer_barrier.offset              = 0;
+    buffer_barrier.size                = VK_WHOLE_SIZE;
+
+    VkDependencyInfo dep_info{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dep_info.bufferMemoryBarrierCount = 1;
+    dep_info.pBufferMemoryBarriers    = &buffer_barrier;
+
+    vkCmdPipelineBarrier2(cmd, &dep_info);
+}
+
+void UploadManager::init(VkDevice device,
+                         VmaAllocator allocator,
+                         DeviceTimeline& timeline,
+                         VkQueue transfer_queue,
+                         uint32_t transfer_queue_family,
+                         VkQueue graphics_queue,
+                         uint32_t graphics_queue_family,
+                         VkDeviceSize staging_size)
+{
+    _device                = device;
+    _allocator             = allocator;
+    _timeline              = &timeline;
+    _transfer_queue        = transfer_queue;
+    _transfer_queue_family = transfer_queue_family;
+    _graphics_queue        = graphics_queue;
+    _graphics_queue_family = graphics_queue_family;
+
+    VkCommandPoolCreateInfo transfer_pool_info =
+        vkinit::command_pool_create_info(_transfer_queue_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    VK_CHECK(vkCreateCommandPool(_device, &transfer_pool_info, nullptr, &_transfer_pool));
+
+    if (separate_transfer_queue())
+    {
+        VkCommandPoolCreateInfo graphics_pool_info =
+            vkinit::command_pool_create_info(_graphics_queue_family, VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+        VK_CHECK(vkCreateCommandPool(_device, &graphics_pool_info, nullptr, &_graphics_pool));
+    }
+
+    _ring      = create_staging_buffer(_allocator, staging_size);
+    _ring_size = staging_size;
+}
+
+void UploadManager::destroy()
+{
+    retire();
+
+    // a batch which was never submitted may still hold staging and released buffers
+    if (_open.has_value())
+    {
+        for (AllocatedBuffer& staging : _open->dedicated_staging)
+        {
+            vmaDestroyBuffer(_allocator, staging.buffer, staging.allocation);
+        }
+        for (AllocatedBuffer& buffer : _open->released)
+        {
+            vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
+        }
+        _open.reset();
+    }
+    _free.clear();
+
+    vmaDestroyBuffer(_allocator, _ring.buffer, _ring.allocation);
+
+    // freeing the pools frees every command buffer
+    vkDestroyCommandPool(_device, _transfer_pool, nullptr);
+    if (_graphics_pool != VK_NULL_HANDLE)
+    {
+        vkDestroyCommandPool(_device, _graphics_pool, nullptr);
+    }
+}
+
+UploadHandle UploadManager::upload_buffer(
+    VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size, VkSharingMode dst_sharing_mode)
+{
+    // nothing to wait for
+    if (size == 0)
+    {
+        return {0};
+    }
+
+    auto [staging, staging_offset] = stage(data, size);
+    Batch& batch                   = open_batch();
+
+    VkBufferCopy copy{};
+    copy.srcOffset = staging_offset;
+    copy.dstOffset = dst_offset;
+    copy.size      = size;
+
+    vkCmdCopyBuffer(batch.transfer_cmd, staging, dst, 1, &copy);
+
+    if (separate_transfer_queue() && dst_sharing_mode == VK_SHARING_MODE_EXCLUSIVE)
+    {
+        transfer_buffer_ownership(batch.transfer_cmd, dst, _transfer_queue_family, _graphics_queue_family, true);
+        transfer_buffer_ownership(batch.graphics_cmd, dst, _transfer_queue_family, _graphics_queue_family, false);
+    }
+
+    return {batch.number};
+}
+
+UploadHandle UploadManager::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+{
+    if (size == 0)
+    {
+        return {0};
+    }
+
+    Batch& batch = open_batch();
+
+    // earlier copies, including those of batches already submitted to the queue, finish writing src before it is
+    // read, and later ones write dst only after this copy
+    VkMemoryBarrier2 barrier{.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2};
+    barrier.srcStageMask  = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT;
+    barrier.dstStageMask  = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT;
+    barrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+    VkDependencyInfo dependency{.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO};
+    dependency.memoryBarrierCount = 1;
+    dependency.pMemoryBarriers    = &barrier;
+
+    vkCmdPipelineBarrier2(batch.transfer_cmd, &dependency);
+
+    VkBufferCopy copy{};
+    copy.size = size;
+    vkCmdCopyBuffer(batch.transfer_cmd, src, dst, 1, &copy);
+
+    vkCmdPipelineBarrier2(batch.transfer_cmd, &dependency);
+
+    return {batch.number};
+}
+
+UploadHandle UploadManager::upload_image(const AllocatedImage& image,
+                                         const void* data,
+                                         VkDeviceSize size,
+                                         bool mipmapped)
+{
+    auto [staging, staging_offset] = stage(data, size);
+    Batch& batch                   = open_batch();
+
+    /* 1 Copy mip 0 on the transfer queue */
+
+    vkutil::transition_image(
+        batch.transfer_cmd, image.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    VkBufferImageCopy copy_region = {};
+    copy_region.bufferOffset      = staging_offset;
+    copy_region.bufferRowLength   = 0;
+    copy_region.bufferImageHeight = 0;
+
+    copy_region.imageSubresource.aspectMask     = VK_IMAGE_ASPECT_COLOR_BIT;
+    copy_region.imageSubresource.mipLevel       = 0;
+    copy_region.imageSubresource.baseArrayLayer = 0;
+    copy_region.imageSubresource.layerCount     = 1;
+    copy_region.imageExtent                     = image.image_extent;
+
+    vkCmdCopyBufferToImage(
+        batch.transfer_cmd, staging, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy_region);
+
+    /* 2 Hand the image to the graphics queue, which blits the mips */
+
+    // mipmapped images stay in TRANSFER_DST, as generate_mipmaps expects
+    VkImageLayout handoff_layout =
+        mipmapped ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    if (separate_transfer_queue())
+    {
+        vkutil::transfer_image_ownership(batch.transfer_cmd,
+                                         image.image,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                         handoff_layout,
+                                         _transfer_queue_family,
+                                         _graphics_queue_family,
+                                         true);
+        vkutil::transfer_image_ownership(batch.graphics_cmd,
+                                         image.image,
+                                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                         handoff_layout,
+                                         _transfer_queue_family,
+                                         _graphics_queue_family,
+                                         false);
+    }
+    else if (!mipmapped)
+    {
+        vkutil::transition_image(
+            batch.graphics_cmd, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, handoff_layout);
+    }
+
+    if (mipmapped)
+    {
+        vkutil::generate_mipmaps(
+            batch.graphics_cmd, image.image, VkExtent2D{image.image_extent.width, image.image_extent.height});
+    }
+
+    return {batch.number};
+}
+
+void UploadManager::destroy_after_batch(const AllocatedBuffer& buffer)
+{
+    if (buffer.buffer == VK_NULL_HANDLE)
+    {
+        return;
+    }
+
+    open_batch().released.push_back(buffer);
+}
+
+void UploadManager::reserve(VkDeviceSize size, uint32_t upload_count)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    // every upload may need padding to stay aligned
+    size += upload_count * (STAGING_ALIGNMENT - 1);
+
+    Batch& batch = open_batch();
+
+    VkDeviceSize offset;
+    if (try_allocate_ring(size, offset))
+    {
+        batch.reserved_buffer = _ring.buffer;
+        batch.reserved_mapped = _ring.info.pMappedData;
+        batch.reserved_head   = offset;
+        batch.reserved_end    = offset + size;
+        return;
+    }
+
+    AllocatedBuffer staging = create_staging_buffer(_allocator, size);
+    batch.dedicated_staging.push_back(staging);
+
+    batch.reserved_buffer = staging.buffer;
+    batch.reserved_mapped = staging.info.pMappedData;
+    batch.reserved_head   = 0;
+    batch.reserved_end    = size;
+}
+
+void UploadManager::flush()
+{
+    retire();
+
+    if (!_open.has_value())
+    {
+        return;
+    }
+
+    GPBR_PROFILE_SCOPE("flush uploads");
+
+    Batch& batch = *_open;
+
+    /* 1 Submit the copies, then the graphics queue's half of the batch once they are done */
+
+    VK_CHECK(vkEndCommandBuffer(batch.transfer_cmd));
+
+    if (separate_transfer_queue())
+    {
+        VK_CHECK(vkEndCommandBuffer(batch.graphics_cmd));
+
+        TimelinePoint copies_done = _timeline->next(QueueType::Transfer);
+
+        VkCommandBufferSubmitInfo transfer_cmd_info = vkinit::command_buffer_submit_info(batch.transfer_cmd);
+        VkSemaphoreSubmitInfo transfer_signal       = _timeline->signal_info(copies_done);
+
+        VkSubmitInfo2 transfer_submit = vkinit::submit_info(&transfer_cmd_info, &transfer_signal, nullptr);
+        VK_CHECK(vkQueueSubmit2(_transfer_queue, 1, &transfer_submit, VK_NULL_HANDLE));
+
+        batch.completion = _timeline->next(QueueType::Graphics);
+
+        VkCommandBufferSubmitInfo graphics_cmd_info = vkinit::command_buffer_submit_info(batch.graphics_cmd);
+        VkSemaphoreSubmitInfo graphics_wait         = _timeline->wait_info(copies_done);
+        VkSemaphoreSubmitInfo graphics_signal       = _timeline->signal_info(batch.completion);
+
+        VkSubmitInfo2 graphics_submit = vkinit::submit_info(&graphics_cmd_info, &graphics_signal, &graphics_wait);
+        VK_CHECK(vkQueueSubmit2(_graphics_queue, 1, &graphics_submit, VK_NULL_HANDLE));
+    }
+    else
+    {
+        batch.completion = _timeline->next(QueueType::Graphics);
+
+        VkCommandBufferSubmitInfo cmd_info = vkinit::command_buffer_submit_info(batch.transfer_cmd);
+        VkSemaphoreSubmitInfo signal_info  = _timeline->signal_info(batch.completion);
+
+        VkSubmitInfo2 submit = vkinit::submit_info(&cmd_info, &signal_info, nullptr);
+        VK_CHECK(vkQueueSubmit2(_graphics_queue, 1, &submit, VK_NULL_HANDLE));
+    }
+
+    /* 2 Keep the batch's staging memory until the timeline reaches its point */
+
+    _completion_point = batch.completion;
+    _submitted_batches++;
+
+    _in_flight.push_back(std::move(batch));
+    _open.reset();
+}
+
+bool UploadManager::is_complete(UploadHandle handle)
+{
+    if (_open.has_value() && handle.batch >= _open->number)
+    {
+        return false;
+    }
+
+    for (const Batch& batch : _in_flight)
+    {
+        if (batch.number == handle.batch)
+        {
+            return _timeline->is_complete(batch.completion);
+        }
+    }
+
+    // retired
+    return true;
+}
+
+void UploadManager::wait(UploadHandle handle)
+{
+    if (_open.has_value() && handle.batch >= _open->number)
+    {
+        flush();
+    }
+
+    for (const Batch& batch : _in_flight)
+    {
+        if (batch.number == handle.batch)
+        {
+            VK_CHECK(_timeline->wait(batch.completion));
+            return;
+        }
+    }
+}
+
+UploadManager::Batch& UploadManager::open_batch()
+{
+    if (_open.has_value())
+    {
+        return *_open;
+    }
+
+    /* 1 Reuse the command buffers of a completed batch, or allocate new ones */
+
+    if (!_free.empty())
+    {
+        _open = std::move(_free.back());
+        _free.pop_back();
+    }
+    else
+    {
+        _open.emplace();
+
+        VkCommandBufferAllocateInfo transfer_alloc_info = vkinit::command_buffer_allocate_info(_transfer_pool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(_device, &transfer_alloc_info, &_open->transfer_cmd));
+
+        _open->graphics_cmd = _open->transfer_cmd;
+        if (separate_transfer_queue())
+        {
+            VkCommandBufferAllocateInfo graphics_alloc_info = vkinit::command_buffer_allocate_info(_graphics_pool, 1);
+            VK_CHECK(vkAllocateCommandBuffers(_device, &graphics_alloc_info, &_open->graphics_cmd));
+        }
+    }
+
+    /* 2 Begin recording; the timeline points are only reserved on submission, in submission order */
+
+    Batch& batch          = *_open;
+    batch.number          = ++_opened_batches;
+    batch.completion      = {};
+    batch.ring_bytes      = 0;
+    batch.reserved_buffer = VK_NULL_HANDLE;
+    batch.reserved_mapped = nullptr;
+    batch.reserved_head   = 0;
+    batch.reserved_end    = 0;
+
+    VkCommandBufferBeginInfo begin_info =
+        vkinit::command_buffer_begin_info(VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT);
+
+    VK_CHECK(vkResetCommandBuffer(batch.transfer_cmd, 0));
+    VK_CHECK(vkBeginCommandBuffer(batch.transfer_cmd, &begin_info));
+
+    if (separate_transfer_queue())
+    {
+        VK_CHECK(vkResetCommandBuffer(batch.graphics_cmd, 0));
+        VK_CHECK(vkBeginCommandBuffer(batch.graphics_cmd, &begin_info));
+    }
+
+    return batch;
+}
+
+std::pair<VkBuffer, VkDeviceSize> UploadManager::stage(const void* data, VkDeviceSize size)
+{
+    _uploaded_bytes += size;
+
+    /* 1 Use the space set aside by reserve() while it lasts */
+
+    if (_open.has_value() && _open->reserved_buffer != VK_NULL_HANDLE)
+    {
+        Batch& batch        = *_open;
+        VkDeviceSize offset = (batch.reserved_head + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+        if (offset + size <= batch.reserved_end)
+        {
+            batch.reserved_head = offset + size;
+
+            memcpy((char*)batch.reserved_mapped + offset, data, size);
+            return {batch.reserved_buffer, offset};
+        }
+    }
+
+    /* 2 Data larger than the ring gets a staging buffer of its own */
+
+    if (size > _ring_size)
+    {
+        AllocatedBuffer staging = create_staging_buffer(_allocator, size);
+        memcpy(staging.info.pMappedData, data, size);
+
+        open_batch().dedicated_staging.push_back(staging);
+        return {staging.buffer, 0};
+    }
+
+    /* 3 Otherwise take space at the head of the ring, waiting for earlier batches to free it if necessary */
+
+    while (true)
+    {
+        VkDeviceSize offset;
+        if (try_allocate_ring(size, offset))
+        {
+            memcpy((char*)_ring.info.pMappedData + offset, data, size);
+            return {_ring.buffer, offset};
+        }
+
+        // the open batch's own space only frees up once it has been submitted
+        if (_in_flight.empty())
+        {
+            flush();
+        }
+
+        GPBR_PROFILE_SCOPE("wait for staging space");
+        VK_CHECK(_timeline->wait(_in_flight.front().completion));
+        retire();
+    }
+}
+
+bool UploadManager::try_allocate_ring(VkDeviceSize size, VkDeviceSize& offset)
+{
+    if (size > _ring_size)
+    {
+        return false;
+    }
+
+    if (_used == 0)
+    {
+        _head = 0;
+    }
+
+    offset               = (_head + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    VkDeviceSize padding = offset - _head;
+
+    // allocations never straddle the end of the ring
+    if (offset + size > _ring_size)
+    {
+        offset  = 0;
+        padding = _ring_size - _head;
+    }
+
+    if (_used + padding + size > _ring_size)
+    {
+        return false;
+    }
+
+    _head = offset + size;
+    _used += padding + size;
+    open_batch().ring_bytes += padding + size;
+    return true;
+}
+
+void UploadManager::retire()
+{
+    // batches complete in submission order, as their last halves all run on the graphics queue
+    while (!_in_flight.empty() && _timeline->is_complete(_in_flight.front().completion))
+    {
+        Batch& batch = _in_flight.front();
+
+        _used -= batch.ring_bytes;
+
+        for (AllocatedBuffer& staging : batch.dedicated_staging)
+        {
+            vmaDestroyBuffer(_allocator, staging.buffer, staging.allocation);
+        }
+        batch.dedicated_staging.clear();
+
+        for (AllocatedBuffer& buffer : batch.released)
+        {
+            vmaDestroyBuffer(_allocator, buffer.buffer, buffer.allocation);
+        }
+        batch.released.clear();
+
+        _free.push_back(std::move(batch));
+        _in_flight.pop_front();
+    }
+}
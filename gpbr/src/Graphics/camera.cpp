@@ -91,6 +91,11 @@ void Camera::update()
 }
 
 void Camera::process_SDL_event(SDL_Event& e)
+{
+    ::process_SDL_event(input, e, mouse_sensitivity);
+}
+
+void process_SDL_event(InputState& input, const SDL_Event& e, float mouse_sensitivity)
 {
     // Keyboard inputs
     if (e.type == SDL_EVENT_KEY_DOWN)
@@ -135,7 +140,7 @@ void Camera::process_SDL_event(SDL_Event& e)
     // Mouse Inputs
     if (e.type == SDL_EVENT_MOUSE_MOTION)
     {
-        input.yaw_target   = (float)e.motion.xrel / mouse_sensitivity;
-        input.pitch_target = (float)e.motion.yrel / mouse_sensitivity;
+        input.yaw_target += (float)e.motion.xrel / mouse_sensitivity;
+        input.pitch_target += (float)e.motion.yrel / mouse_sensitivity;
     }
 }
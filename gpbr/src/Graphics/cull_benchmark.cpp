@@ -0,0 +1,845 @@
+#include "gpbr/Graphics/cull_benchmark.h"
+#include "gpbr/Graphics/Vulkan/vk_engine.h"
+#include "gpbr/Graphics/frustum_culling.h"
+#include "gpbr/Graphics/scene_bvh.h"
+#include "gpbr/Graphics/transform_hierarchy.h"
+#include "gpbr/Util/benchmark.h"
+#include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <span>
+
+constexpr uint32_t CULL_BENCH_COUNTS[]  = {10'000, 50'000, 250'000}; // Objects per scene.
+constexpr int CULL_BENCH_ITERATIONS     = 50;                        // Timed runs of each method per scene.
+constexpr uint32_t CULL_BENCH_SEED      = 1234;
+constexpr float CULL_BENCH_SCENE_EXTENT = 600.f; // Objects are spread over a cube of twice this size.
+constexpr int CULL_BENCH_QUERIES        = 64;    // BVH box and ray queries checked per scene.
+constexpr uint32_t CULL_BENCH_TREE_SIZE = 8;     // Objects per tree of the hierarchy the moving objects form.
+constexpr int CULL_BENCH_MOVES          = 256;   // Objects moved per scene.
+constexpr uint32_t CULL_BENCH_NODES     = 2'000; // Nodes of the glTF-like scene the edit checks start from.
+constexpr int CULL_BENCH_EDITS          = 64;    // Rounds of node edits to it.
+
+using Clock = std::chrono::high_resolution_clock;
+
+// Returns the milliseconds elapsed since start.
+static float elapsed_ms(Clock::time_point start)
+{
+    return std::chrono::duration<float, std::milli>(Clock::now() - start).count();
+}
+
+// Orders ray hits by distance, and hits at the same distance by object.
+static bool ray_hit_order(const BvhRayHit& A, const BvhRayHit& B)
+{
+    return (A.distance != B.distance) ? A.distance < B.distance : A.item < B.item;
+}
+
+// The test the kernels perform, written the straightforward way: an object is culled when its sphere, or the corner
+// of its box farthest along a plane's normal, is behind the plane.
+static bool reference_visible(const WorldBounds& bounds, const FrustumPlanes& planes)
+{
+    for (const glm::vec4& plane : planes)
+    {
+        glm::vec3 normal = glm::vec3(plane);
+
+        if (glm::dot(normal, bounds.center) + plane.w < -bounds.radius)
+        {
+            return false;
+        }
+
+        glm::vec3 corner = bounds.center + glm::sign(normal) * bounds.extents;
+        if (glm::dot(normal, corner) + plane.w < 0.f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The BVH's box query by brute force: every object whose box overlaps the one from min to max, in index order.
+static std::vector<uint32_t> reference_box(std::span<const WorldBounds> bounds,
+                                           const glm::vec3& min,
+                                           const glm::vec3& max)
+{
+    std::vector<uint32_t> items;
+    for (uint32_t i = 0; i < (uint32_t)bounds.size(); i++)
+    {
+        glm::vec3 box_min = bounds[i].center - bounds[i].extents;
+        glm::vec3 box_max = bounds[i].center + bounds[i].extents;
+
+        if (glm::all(glm::lessThanEqual(box_min, max)) && glm::all(glm::greaterThanEqual(box_max, min)))
+        {
+            items.push_back(i);
+        }
+    }
+    return items;
+}
+
+// The BVH's ray query by brute force: every object whose box the ray enters within max_distance, ordered by
+// distance and then index. An axis the ray runs parallel to only requires the origin to lie within the box.
+static std::vector<BvhRayHit> reference_ray(std::span<const WorldBounds> bounds,
+                                            const glm::vec3& origin,
+                                            const glm::vec3& direction,
+                                            float max_distance)
+{
+    std::vector<BvhRayHit> hits;
+    for (uint32_t i = 0; i < (uint32_t)bounds.size(); i++)
+    {
+        glm::vec3 box_min = bounds[i].center - bounds[i].extents;
+        glm::vec3 box_max = bounds[i].center + bounds[i].extents;
+
+        float enter = 0.f;
+        float exit  = max_distance;
+        bool hit    = true;
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (direction[axis] == 0.f)
+            {
+                hit = hit && origin[axis] >= box_min[axis] && origin[axis] <= box_max[axis];
+                continue;
+            }
+
+            float inverse = 1.f / direction[axis];
+            float t0      = (box_min[axis] - origin[axis]) * inverse;
+            float t1      = (box_max[axis] - origin[axis]) * inverse;
+
+            enter = std::max(enter, std::min(t0, t1));
+            exit  = std::min(exit, std::max(t0, t1));
+        }
+
+        if (hit && enter <= exit)
+        {
+            hits.push_back({i, enter});
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), ray_hit_order);
+    return hits;
+}
+
+// Builds objects of random size, orientation and scale scattered around the camera.
+static std::vector<RenderObject> random_objects(uint32_t count, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> position(-CULL_BENCH_SCENE_EXTENT, CULL_BENCH_SCENE_EXTENT);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::uniform_real_distribution<float> extent(0.1f, 4.f);
+    std::uniform_real_distribution<float> scale(0.5f, 3.f);
+    std::uniform_real_distribution<float> angle(0.f, glm::two_pi<float>());
+
+    std::vector<RenderObject> objects(count);
+
+    for (RenderObject& r : objects)
+    {
+        r = {};
+        r.bounds.origin        = glm::vec3(unit(rng), unit(rng), unit(rng));
+        r.bounds.extents       = glm::vec3(extent(rng), extent(rng), extent(rng));
+        r.bounds.sphere_radius = glm::length(r.bounds.extents);
+
+        glm::vec3 axis = glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.f, 0.f, 1e-3f);
+
+        r.transform = glm::translate(glm::vec3(position(rng), position(rng), position(rng))) *
+                      glm::rotate(angle(rng), glm::normalize(axis)) *
+                      glm::scale(glm::vec3(scale(rng), scale(rng), scale(rng)));
+
+        // as cached by MeshNode::refresh_transform
+        r.world_bounds =
+            transform_bounds(r.bounds.origin, r.bounds.extents, r.bounds.sphere_radius, r.transform);
+    }
+
+    return objects;
+}
+
+// Joins the objects into a TransformHierarchy of small trees, moves some of them, and checks everything the engine
+// derives from a move against recomputing it: the world transforms and their versions, a BVH refit over the moved
+// objects only, and the instances GpuCuller stages. A frame without moves must update nothing and stage nothing.
+// Returns false on any difference.
+static bool check_moved_objects(std::span<const RenderObject> objects,
+                                const FrustumPlanes& planes,
+                                BenchmarkRecorder& recorder,
+                                std::mt19937& rng)
+{
+    uint32_t count = (uint32_t)objects.size();
+
+    std::uniform_real_distribution<float> offset(-4.f, 4.f);
+    std::uniform_real_distribution<float> angle(0.f, glm::two_pi<float>());
+    std::uniform_real_distribution<float> position(-CULL_BENCH_SCENE_EXTENT, CULL_BENCH_SCENE_EXTENT);
+    std::uniform_real_distribution<float> half_size(5.f, 100.f);
+
+    /* 1 The hierarchy: each tree's root is placed like its object, the other nodes near a node before them */
+
+    std::vector<glm::mat4> locals(count);
+    std::vector<uint32_t> parents(count);
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        uint32_t position_in_tree = i % CULL_BENCH_TREE_SIZE;
+
+        if (position_in_tree == 0)
+        {
+            parents[i] = TransformHierarchy::NO_PARENT;
+            locals[i]  = objects[i].transform;
+            continue;
+        }
+
+        parents[i] = i - 1 - (uint32_t)(rng() % position_in_tree);
+        locals[i]  = glm::translate(glm::vec3(offset(rng), offset(rng), offset(rng))) *
+                    glm::rotate(angle(rng), glm::vec3(0.f, 1.f, 0.f));
+    }
+
+    TransformHierarchy hierarchy;
+    std::vector<uint32_t> entries = hierarchy.build(locals, parents);
+
+    std::vector<uint32_t> entry_objects(count);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        entry_objects[entries[i]] = i;
+    }
+
+    // the objects and their bounds by entry, as LoadedGLTF keeps them by surface
+    std::vector<RenderObject> instances(count);
+    std::vector<WorldBounds> bounds(count);
+
+    auto sync_entry = [&](uint32_t entry)
+    {
+        RenderObject& r = instances[entry];
+
+        r                   = objects[entry_objects[entry]];
+        r.transform         = hierarchy.world(entry);
+        r.transform_version = hierarchy.world_version(entry);
+        r.world_bounds      = transform_bounds(r.bounds.origin, r.bounds.extents, r.bounds.sphere_radius, r.transform);
+
+        bounds[entry] = r.world_bounds;
+    };
+
+    for (uint32_t entry = 0; entry < count; entry++)
+    {
+        sync_entry(entry);
+    }
+
+    SceneBVH bvh;
+    bvh.build(bounds);
+
+    std::vector<const RenderObject*> draws(count);
+    for (uint32_t entry = 0; entry < count; entry++)
+    {
+        draws[entry] = &instances[entry];
+    }
+
+    /* 2 A static frame, after the first one has staged every instance */
+
+    GpuCuller culler;
+    std::vector<uint32_t> changed;
+    culler.find_changed_instances(draws, changed);
+
+    std::vector<TransformRange> ranges;
+    bool static_updated = hierarchy.update(ranges);
+
+    changed.clear();
+    culler.find_changed_instances(draws, changed);
+    size_t static_staged = changed.size();
+
+    /* 3 Move some nodes, then recompute every world transform from the locals */
+
+    std::vector<uint64_t> old_versions(count);
+    std::vector<uint8_t> moved(count, 0);
+
+    for (uint32_t entry = 0; entry < count; entry++)
+    {
+        old_versions[entry] = hierarchy.world_version(entry);
+    }
+
+    for (int move = 0; move < CULL_BENCH_MOVES; move++)
+    {
+        uint32_t entry = (uint32_t)(rng() % count);
+        hierarchy.set_local(entry,
+                            glm::translate(glm::vec3(offset(rng), offset(rng), offset(rng))) * hierarchy.local(entry));
+        moved[entry] = 1;
+    }
+
+    Clock::time_point update_start = Clock::now();
+    bool moved_updated             = hierarchy.update(ranges);
+    recorder.record(fmt::format("cull_{}_hierarchy_update_ms", count), elapsed_ms(update_start));
+
+    std::vector<uint8_t> updated(count, 0);
+    for (const TransformRange& range : ranges)
+    {
+        std::fill(updated.begin() + range.begin, updated.begin() + range.end, 1);
+    }
+
+    // parents precede their children, so each reads its parent's finished result
+    std::vector<glm::mat4> reference(count);
+
+    uint32_t world_mismatches   = 0;
+    uint32_t version_mismatches = 0;
+
+    for (uint32_t entry = 0; entry < count; entry++)
+    {
+        uint32_t parent = hierarchy.parent(entry);
+        if (parent != TransformHierarchy::NO_PARENT)
+        {
+            reference[entry] = reference[parent] * hierarchy.local(entry);
+            moved[entry]     = moved[entry] || moved[parent];
+        }
+        else
+        {
+            reference[entry] = hierarchy.local(entry);
+        }
+
+        bool new_version = hierarchy.world_version(entry) != old_versions[entry];
+
+        world_mismatches += (hierarchy.world(entry) != reference[entry]) ? 1 : 0;
+        version_mismatches += (new_version != (moved[entry] != 0) || updated[entry] != moved[entry]) ? 1 : 0;
+    }
+
+    /* 4 Refit the BVH over the moved objects only, and compare its queries with those of a full refit */
+
+    std::vector<uint32_t> moved_items;
+    std::vector<WorldBounds> moved_bounds;
+
+    for (const TransformRange& range : ranges)
+    {
+        for (uint32_t entry = range.begin; entry < range.end; entry++)
+        {
+            sync_entry(entry);
+            moved_items.push_back(entry);
+            moved_bounds.push_back(bounds[entry]);
+        }
+    }
+
+    SceneBVH full_bvh = bvh;
+    full_bvh.refit(bounds);
+
+    Clock::time_point refit_start = Clock::now();
+    bvh.refit(moved_items, moved_bounds);
+    recorder.record(fmt::format("cull_{}_bvh_partial_refit_ms", count), elapsed_ms(refit_start));
+
+    std::vector<uint32_t> items;
+    std::vector<uint32_t> full_items;
+
+    bvh.query_frustum(planes, items);
+    full_bvh.query_frustum(planes, full_items);
+    std::sort(items.begin(), items.end());
+    std::sort(full_items.begin(), full_items.end());
+
+    bool same_frustum = items == full_items;
+
+    uint32_t box_mismatches = 0;
+    for (int query = 0; query < CULL_BENCH_QUERIES; query++)
+    {
+        glm::vec3 center(position(rng), position(rng), position(rng));
+        glm::vec3 half(half_size(rng), half_size(rng), half_size(rng));
+
+        items.clear();
+        full_items.clear();
+        bvh.query_box(center - half, center + half, items);
+        full_bvh.query_box(center - half, center + half, full_items);
+        std::sort(items.begin(), items.end());
+        std::sort(full_items.begin(), full_items.end());
+
+        bool same_box = items == full_items && items == reference_box(bounds, center - half, center + half);
+        box_mismatches += same_box ? 0 : 1;
+    }
+
+    /* 5 The moved frame must stage exactly the moved objects */
+
+    changed.clear();
+    culler.find_changed_instances(draws, changed);
+
+    fmt::println("  moved  static frame: update() returned {}, {} instances staged", static_updated, static_staged);
+    fmt::println("  moved  {} of {} objects: {} world transforms and {} versions differ from a full recompute, "
+                 "{} instances staged",
+                 moved_items.size(),
+                 count,
+                 world_mismatches,
+                 version_mismatches,
+                 changed.size());
+    fmt::println("  moved  partial refit: frustum query {}, {} of {} box queries differ from a full refit",
+                 same_frustum ? "matches" : "differs",
+                 box_mismatches,
+                 CULL_BENCH_QUERIES);
+
+    return !static_updated && static_staged == 0 && moved_updated && world_mismatches == 0 &&
+           version_mismatches == 0 && changed == moved_items && same_frustum && box_mismatches == 0;
+}
+
+// Compares everything SceneObjects takes from a surface. RenderObject has padding, so memcmp would not do.
+static bool same_object(const RenderObject& A, const RenderObject& B)
+{
+    return A.index_count == B.index_count && A.first_index == B.first_index && A.vertex_offset == B.vertex_offset &&
+           A.material == B.material && A.bounds.origin == B.bounds.origin && A.bounds.extents == B.bounds.extents &&
+           A.transform == B.transform && A.transform_version == B.transform_version &&
+           A.world_bounds.center == B.world_bounds.center && A.world_bounds.extents == B.world_bounds.extents &&
+           A.world_bounds.radius == B.world_bounds.radius;
+}
+
+// Whether A and B hold the same objects, and their references point at the same indices of them in each pass.
+static bool same_scene_objects(const SceneObjects& A, const SceneObjects& B)
+{
+    auto same_refs = [&](const std::vector<const RenderObject*>& A_refs, const std::vector<const RenderObject*>& B_refs)
+    {
+        return std::equal(A_refs.begin(),
+                          A_refs.end(),
+                          B_refs.begin(),
+                          B_refs.end(),
+                          [&](const RenderObject* a, const RenderObject* b)
+                          { return a - A.objects.data() == b - B.objects.data(); });
+    };
+
+    return std::equal(A.objects.begin(), A.objects.end(), B.objects.begin(), B.objects.end(), same_object) &&
+           same_refs(A.refs.opaque_surfaces, B.refs.opaque_surfaces) &&
+           same_refs(A.refs.transparent_surfaces, B.refs.transparent_surfaces) &&
+           same_refs(A.refs.mask_surfaces, B.refs.mask_surfaces);
+}
+
+// Returns a node placed near its parent, holding one of meshes unless it is an empty node.
+static std::shared_ptr<Node> random_node(std::span<const std::shared_ptr<MeshAsset>> meshes, std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> offset(-8.f, 8.f);
+    std::uniform_real_distribution<float> angle(0.f, glm::two_pi<float>());
+
+    std::shared_ptr<Node> node;
+    if (rng() % 4 == 0)
+    {
+        node = std::make_shared<Node>();
+    }
+    else
+    {
+        std::shared_ptr<MeshNode> mesh_node = std::make_shared<MeshNode>();
+        mesh_node->mesh                     = meshes[rng() % meshes.size()];
+        node                                = mesh_node;
+    }
+
+    node->local_transform = glm::translate(glm::vec3(offset(rng), offset(rng), offset(rng))) *
+                            glm::rotate(angle(rng), glm::vec3(0.f, 1.f, 0.f));
+    return node;
+}
+
+// Assembles a scene the way load_gltf() does, without an engine, then adds, removes and moves nodes through the
+// LoadedGLTF API. After each round of edits, the render objects SceneObjects keeps from round to round, rebuilt or
+// patched, must equal those of a new SceneObjects, and the world transforms of the nodes must equal the products of
+// the local transforms down the node tree. Returns false on any difference.
+static bool check_scene_edits(std::mt19937& rng)
+{
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    std::uniform_real_distribution<float> extent(0.1f, 4.f);
+    std::uniform_real_distribution<float> offset(-8.f, 8.f);
+
+    /* 1 Materials of every pass, and meshes of a few surfaces each */
+
+    std::vector<std::shared_ptr<GLTFMaterial>> materials;
+    for (MaterialPass pass : {MaterialPass::MainColor, MaterialPass::Transparent, MaterialPass::Mask})
+    {
+        std::shared_ptr<GLTFMaterial> material = std::make_shared<GLTFMaterial>();
+        material->data                         = {nullptr, VK_NULL_HANDLE, pass};
+        materials.push_back(material);
+    }
+
+    std::vector<std::shared_ptr<MeshAsset>> meshes(16);
+    for (uint32_t m = 0; m < meshes.size(); m++)
+    {
+        meshes[m]                       = std::make_shared<MeshAsset>();
+        meshes[m]->geometry.first_index = m * 1024;
+
+        for (uint32_t i = 0, count = 1 + (uint32_t)(rng() % 3); i < count; i++)
+        {
+            GeoSurface surface;
+            surface.start_index          = i * 256;
+            surface.count                = 256;
+            surface.bounds.origin        = glm::vec3(unit(rng), unit(rng), unit(rng));
+            surface.bounds.extents       = glm::vec3(extent(rng), extent(rng), extent(rng));
+            surface.bounds.sphere_radius = glm::length(surface.bounds.extents);
+            surface.material             = materials[rng() % materials.size()];
+
+            meshes[m]->surfaces.push_back(surface);
+        }
+    }
+
+    /* 2 The scene: a forest whose nodes are numbered like glTF nodes, each parent before its children */
+
+    LoadedGLTF scene;
+
+    std::vector<std::shared_ptr<Node>> nodes(CULL_BENCH_NODES);
+    std::vector<Node*> node_pointers(CULL_BENCH_NODES);
+    std::vector<uint32_t> parents(CULL_BENCH_NODES);
+
+    for (uint32_t i = 0; i < CULL_BENCH_NODES; i++)
+    {
+        nodes[i]         = random_node(meshes, rng);
+        node_pointers[i] = nodes[i].get();
+        parents[i]       = (i < 16 || rng() % 8 == 0) ? TransformHierarchy::NO_PARENT : (uint32_t)(rng() % i);
+
+        if (parents[i] == TransformHierarchy::NO_PARENT)
+        {
+            scene.top_nodes.push_back(nodes[i]);
+            continue;
+        }
+
+        nodes[parents[i]]->children.push_back(nodes[i]);
+        nodes[i]->parent = nodes[parents[i]];
+    }
+
+    scene.build_transforms(node_pointers, parents);
+    scene.build_bvh();
+
+    /* 3 Rounds of edits, each followed by the update update_scene() performs */
+
+    SceneObjects objects;
+    objects.update(scene);
+
+    std::vector<std::shared_ptr<Node>> live;
+    std::vector<std::pair<Node*, glm::mat4>> stack;
+
+    uint32_t patched_rounds    = 0;
+    uint32_t object_mismatches = 0;
+    uint32_t node_mismatches   = 0;
+
+    for (int round = 0; round < CULL_BENCH_EDITS; round++)
+    {
+        // the nodes in the scene, parents first
+        live.assign(scene.top_nodes.begin(), scene.top_nodes.end());
+        for (size_t i = 0; i < live.size(); i++)
+        {
+            live.insert(live.end(), live[i]->children.begin(), live[i]->children.end());
+        }
+
+        // some moves every round, so some are still pending when the structure changes
+        for (int move = 0; move < 4; move++)
+        {
+            Node& node     = *live[rng() % live.size()];
+            glm::vec3 step = glm::vec3(offset(rng), offset(rng), offset(rng));
+
+            node.local_transform = glm::translate(step) * node.local_transform;
+            scene.mark_moved(node);
+        }
+
+        uint64_t structure_version = scene.structure_version;
+
+        if (round % 4 == 0)
+        {
+            std::shared_ptr<Node> node  = random_node(meshes, rng);
+            std::shared_ptr<Node> child = random_node(meshes, rng);
+
+            node->children.push_back(child);
+            child->parent = node;
+
+            scene.add_node(node, (rng() % 4 == 0) ? nullptr : live[rng() % live.size()]);
+        }
+        else if (round % 4 == 1)
+        {
+            scene.remove_node(live[rng() % live.size()]);
+        }
+
+        patched_rounds += (scene.structure_version == structure_version) ? 1 : 0;
+
+        objects.update(scene);
+
+        SceneObjects rebuilt;
+        rebuilt.update(scene);
+
+        object_mismatches += same_scene_objects(objects, rebuilt) ? 0 : 1;
+
+        // every node's world transform and surface bounds, recomputed down the tree
+        stack.clear();
+        for (const std::shared_ptr<Node>& node : scene.top_nodes)
+        {
+            stack.push_back({node.get(), glm::mat4(1.f)});
+        }
+
+        while (!stack.empty())
+        {
+            auto [node, parent_world] = stack.back();
+            stack.pop_back();
+
+            glm::mat4 world = parent_world * node->local_transform;
+            bool matches    = node->world_transform == world;
+
+            if (MeshNode* mesh_node = dynamic_cast<MeshNode*>(node))
+            {
+                for (size_t i = 0; i < mesh_node->mesh->surfaces.size(); i++)
+                {
+                    const Bounds& b         = mesh_node->mesh->surfaces[i].bounds;
+                    const WorldBounds& kept = mesh_node->surface_bounds[i];
+                    WorldBounds bounds      = transform_bounds(b.origin, b.extents, b.sphere_radius, world);
+
+                    matches = matches && kept.center == bounds.center && kept.extents == bounds.extents &&
+                              kept.radius == bounds.radius;
+                }
+            }
+            node_mismatches += matches ? 0 : 1;
+
+            for (const std::shared_ptr<Node>& child : node->children)
+            {
+                stack.push_back({child.get(), world});
+            }
+        }
+    }
+
+    fmt::println("scene edits: {} of {} rounds differ from rebuilt render objects ({} patched in place), {} nodes "
+                 "differ from their transforms down the tree",
+                 object_mismatches,
+                 CULL_BENCH_EDITS,
+                 patched_rounds,
+                 node_mismatches);
+
+    return object_mismatches == 0 && node_mismatches == 0 && patched_rounds > 0;
+}
+
+bool run_cull_benchmark(const std::string& report_path)
+{
+    // the engine's camera and projection, looking down -Z from the origin
+    Camera camera;
+    camera.aspect = 16.f / 9.f;
+    camera.update();
+
+    glm::mat4 projection = glm::perspective(camera.fovy, camera.aspect, camera.far, camera.near);
+    projection[1][1] *= -1;
+
+    glm::mat4 view_proj  = projection * camera.view_mat;
+    FrustumPlanes planes = frustum_planes(view_proj);
+
+    CullKernel best_kernel = best_cull_kernel();
+
+    BenchmarkRecorder recorder;
+    recorder.set_info("benchmark", "cull");
+    recorder.set_info("best_kernel", cull_kernel_name(best_kernel));
+    recorder.set_info("iterations", std::to_string(CULL_BENCH_ITERATIONS));
+
+    std::mt19937 rng(CULL_BENCH_SEED);
+
+    bool passed = true;
+
+    for (uint32_t count : CULL_BENCH_COUNTS)
+    {
+        std::vector<RenderObject> objects = random_objects(count, rng);
+
+        BoundsSoA bounds;
+        bounds.resize(count);
+
+        std::vector<uint8_t> visible(count);
+        std::vector<uint8_t> reference(count);
+
+        /* 1 The reference results */
+
+        uint32_t reference_count = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            reference[i] = reference_visible(objects[i].world_bounds, planes) ? 1 : 0;
+            reference_count += reference[i];
+        }
+
+        /* 2 The per-object test the engine used to cull with */
+
+        uint32_t in_frustum_count = 0;
+        for (int iteration = 0; iteration < CULL_BENCH_ITERATIONS; iteration++)
+        {
+            Clock::time_point start = Clock::now();
+
+            in_frustum_count = 0;
+            for (const RenderObject& r : objects)
+            {
+                in_frustum_count += in_frustum(r, view_proj, camera) ? 1 : 0;
+            }
+
+            recorder.record(fmt::format("cull_{}_in_frustum_ms", count), elapsed_ms(start));
+        }
+
+        /* 3 Transforming the bounds of every object, which only moved objects pay for */
+
+        for (int iteration = 0; iteration < CULL_BENCH_ITERATIONS; iteration++)
+        {
+            Clock::time_point start = Clock::now();
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const RenderObject& r = objects[i];
+                bounds.set(i, transform_bounds(r.bounds.origin, r.bounds.extents, r.bounds.sphere_radius, r.transform));
+            }
+
+            recorder.record(fmt::format("cull_{}_transform_ms", count), elapsed_ms(start));
+        }
+
+        /* 4 Gathering the cached world-space bounds, then each kernel over them */
+
+        for (int iteration = 0; iteration < CULL_BENCH_ITERATIONS; iteration++)
+        {
+            Clock::time_point start = Clock::now();
+
+            for (uint32_t i = 0; i < count; i++)
+            {
+                bounds.set(i, objects[i].world_bounds);
+            }
+
+            recorder.record(fmt::format("cull_{}_gather_ms", count), elapsed_ms(start));
+        }
+
+        fmt::println(
+            "{} objects: reference {} visible, in_frustum {} visible", count, reference_count, in_frustum_count);
+
+        for (CullKernel kernel : {CullKernel::Scalar, CullKernel::SSE, CullKernel::AVX2})
+        {
+            if (kernel > best_kernel)
+            {
+                break;
+            }
+
+            for (int iteration = 0; iteration < CULL_BENCH_ITERATIONS; iteration++)
+            {
+                Clock::time_point start = Clock::now();
+
+                cull_bounds(bounds, planes, 0, count, visible.data(), kernel);
+
+                recorder.record(fmt::format("cull_{}_{}_ms", count, cull_kernel_name(kernel)), elapsed_ms(start));
+            }
+
+            uint32_t mismatches = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                mismatches += visible[i] != reference[i] ? 1 : 0;
+            }
+
+            fmt::println("  {:<6} {} mismatches", cull_kernel_name(kernel), mismatches);
+            passed = passed && mismatches == 0;
+        }
+
+        /* 5 A BVH over the bounds, whose leaves must hold every visible object */
+
+        std::vector<WorldBounds> world_bounds(count);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            world_bounds[i] = objects[i].world_bounds;
+        }
+
+        SceneBVH bvh;
+        Clock::time_point build_start = Clock::now();
+        bvh.build(world_bounds);
+        recorder.record(fmt::format("cull_{}_bvh_build_ms", count), elapsed_ms(build_start));
+
+        std::vector<uint32_t> candidates;
+        for (int iteration = 0; iteration < CULL_BENCH_ITERATIONS; iteration++)
+        {
+            Clock::time_point start = Clock::now();
+
+            candidates.clear();
+            bvh.query_frustum(planes, candidates);
+
+            recorder.record(fmt::format("cull_{}_bvh_query_ms", count), elapsed_ms(start));
+        }
+
+        std::vector<uint8_t> candidate(count, 0);
+        for (uint32_t i : candidates)
+        {
+            candidate[i] = 1;
+        }
+
+        uint32_t missed = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            missed += (reference[i] && !candidate[i]) ? 1 : 0;
+        }
+
+        fmt::println("  bvh    {} candidates, {} visible objects missed", candidates.size(), missed);
+        passed = passed && missed == 0;
+
+        /* 6 Box and ray queries against the BVH, each checked against a search over every object */
+
+        std::uniform_real_distribution<float> position(-CULL_BENCH_SCENE_EXTENT, CULL_BENCH_SCENE_EXTENT);
+        std::uniform_real_distribution<float> half_size(5.f, 100.f);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+
+        uint32_t box_mismatches = 0;
+        uint32_t ray_mismatches = 0;
+
+        std::vector<uint32_t> box_items;
+        std::vector<BvhRayHit> ray_hits;
+
+        for (int query = 0; query < CULL_BENCH_QUERIES; query++)
+        {
+            glm::vec3 center(position(rng), position(rng), position(rng));
+            glm::vec3 half(half_size(rng), half_size(rng), half_size(rng));
+
+            box_items.clear();
+            Clock::time_point box_start = Clock::now();
+            bvh.query_box(center - half, center + half, box_items);
+            recorder.record(fmt::format("cull_{}_bvh_box_ms", count), elapsed_ms(box_start));
+
+            std::sort(box_items.begin(), box_items.end());
+            box_mismatches += (box_items != reference_box(world_bounds, center - half, center + half)) ? 1 : 0;
+
+            // every fourth ray runs along an axis and an edge of an object's box, so two of its direction components
+            // are zero while its origin lies on the box's planes
+            glm::vec3 origin(position(rng), position(rng), position(rng));
+            glm::vec3 direction;
+
+            if (query % 4 == 0)
+            {
+                const WorldBounds& edge = world_bounds[rng() % count];
+                int axis                = (query / 4) % 3;
+
+                origin       = edge.center - edge.extents;
+                origin[axis] = position(rng);
+
+                direction       = glm::vec3(0.f);
+                direction[axis] = (query % 8 == 0) ? 1.f : -1.f;
+            }
+            else
+            {
+                direction = glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)) + glm::vec3(0.f, 0.f, 1e-3f));
+            }
+
+            float max_distance = 4.f * CULL_BENCH_SCENE_EXTENT;
+
+            ray_hits.clear();
+            Clock::time_point ray_start = Clock::now();
+            bvh.query_ray(origin, direction, max_distance, ray_hits);
+            recorder.record(fmt::format("cull_{}_bvh_ray_ms", count), elapsed_ms(ray_start));
+
+            // the BVH orders hits at the same distance arbitrarily
+            bool nearest_first = std::is_sorted(ray_hits.begin(),
+                                                ray_hits.end(),
+                                                [](const BvhRayHit& A, const BvhRayHit& B)
+                                                { return A.distance < B.distance; });
+            std::sort(ray_hits.begin(), ray_hits.end(), ray_hit_order);
+
+            std::vector<BvhRayHit> reference_hits = reference_ray(world_bounds, origin, direction, max_distance);
+
+            bool same_hits = std::equal(ray_hits.begin(),
+                                        ray_hits.end(),
+                                        reference_hits.begin(),
+                                        reference_hits.end(),
+                                        [](const BvhRayHit& A, const BvhRayHit& B)
+                                        { return A.item == B.item && A.distance == B.distance; });
+
+            ray_mismatches += (nearest_first && same_hits) ? 0 : 1;
+        }
+
+        fmt::println("  bvh    {} of {} box queries and {} of {} ray queries differ from a full search",
+                     box_mismatches,
+                     CULL_BENCH_QUERIES,
+                     ray_mismatches,
+                     CULL_BENCH_QUERIES);
+        passed = passed && box_mismatches == 0 && ray_mismatches == 0;
+
+        /* 7 Moving objects through a transform hierarchy, and everything updated from it */
+
+        passed = check_moved_objects(objects, planes, recorder, rng) && passed;
+    }
+
+    // nodes added to, removed from and moved within a scene, and its render objects kept up to date with them
+    passed = check_scene_edits(rng) && passed;
+
+    recorder.print_summary();
+
+    if (!recorder.write(report_path))
+    {
+        fmt::println("Could not write the culling benchmark report to {}", report_path);
+        return false;
+    }
+
+    if (!passed)
+    {
+        fmt::println("A culling kernel, the BVH, a moved object or an edited scene disagreed with the reference "
+                     "implementation");
+    }
+    return passed;
+}
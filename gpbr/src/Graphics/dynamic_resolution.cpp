@@ -0,0 +1,77 @@
+#include "gpbr/Graphics/dynamic_resolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+float DynamicResolution::update(float gpu_ms, float current_scale)
+{
+    float scale = std::clamp(current_scale, settings.min_scale, settings.max_scale);
+
+    if (gpu_ms <= 0.f)
+    {
+        push_history(scale);
+        return scale;
+    }
+
+    // frames still in flight when the scale changed were rendered at the old one
+    if (_settle_counter > 0)
+    {
+        _settle_counter--;
+        push_history(scale);
+        return scale;
+    }
+
+    _smoothed_ms = (_smoothed_ms == 0.f) ? gpu_ms : _smoothed_ms + settings.smoothing * (gpu_ms - _smoothed_ms);
+
+    // the scale expected to land in the middle of the hysteresis band
+    float band_center = settings.target_ms * (1.f - settings.headroom * 0.5f);
+    float ideal_scale = scale * std::sqrt(band_center / _smoothed_ms);
+
+    float new_scale = scale;
+
+    if (_smoothed_ms > settings.target_ms)
+    {
+        _under_budget_frames = 0;
+        new_scale            = std::max(ideal_scale, settings.min_scale);
+    }
+    else if (_smoothed_ms < settings.target_ms * (1.f - settings.headroom))
+    {
+        if (++_under_budget_frames >= settings.upscale_delay)
+        {
+            _under_budget_frames = 0;
+            new_scale            = std::min({ideal_scale, scale + settings.max_step_up, settings.max_scale});
+        }
+    }
+    else
+    {
+        _under_budget_frames = 0;
+    }
+
+    // ignore changes too small to be worth restarting the measurement for
+    if (std::abs(new_scale - scale) > 0.005f)
+    {
+        scale           = new_scale;
+        _settle_counter = settings.settle_frames;
+        _smoothed_ms    = 0.f;
+    }
+
+    push_history(scale);
+    return scale;
+}
+
+void DynamicResolution::reset()
+{
+    _smoothed_ms         = 0.f;
+    _settle_counter      = 0;
+    _under_budget_frames = 0;
+    _history.clear();
+}
+
+void DynamicResolution::push_history(float scale)
+{
+    if (_history.size() == HISTORY_LENGTH)
+    {
+        _history.erase(_history.begin());
+    }
+    _history.push_back(scale);
+}
@@ -0,0 +1,239 @@
+#include "gpbr/Graphics/frustum_culling.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define GPBR_CULL_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define GPBR_CULL_X86 0
+#endif
+
+// An object is outside a plane when the distance of its center is below minus the smaller of its radius and the
+// reach of its box towards the plane. Every kernel evaluates, per object and plane:
+//   distance = ((nx * cx + ny * cy) + nz * cz) + w
+//   reach    = min(((|nx| * ex + |ny| * ey) + |nz| * ez), r)
+//   inside  &= distance >= -reach
+
+// Culls the objects in [begin, end) in groups of 8 and returns the first object left over. Defined in
+// frustum_culling_avx2.cpp, the only file compiled with AVX2 enabled, so it takes plain arrays: components holds
+// the seven arrays of a BoundsSoA in declaration order, and planes the 24 floats of a FrustumPlanes.
+uint32_t cull_bounds_avx2(
+    const float* const* components, const float* planes, uint32_t begin, uint32_t end, uint8_t* visible);
+
+FrustumPlanes frustum_planes(const glm::mat4& view_proj)
+{
+    glm::mat4 m = glm::transpose(view_proj); // rows of view_proj as columns
+
+    FrustumPlanes planes = {
+        m[3] + m[0], // left
+        m[3] - m[0], // right
+        m[3] + m[1], // bottom
+        m[3] - m[1], // top
+        m[2],        // z = 0
+        m[3] - m[2], // z = w
+    };
+
+    for (glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+    return planes;
+}
+
+WorldBounds transform_bounds(const glm::vec3& origin,
+                             const glm::vec3& extents,
+                             float sphere_radius,
+                             const glm::mat4& transform)
+{
+    glm::mat3 axes = glm::mat3(transform);
+
+    WorldBounds bounds;
+    bounds.center = glm::vec3(transform * glm::vec4(origin, 1.f));
+
+    // each of the box's axes stretches the enclosing box by its absolute extent along every world axis
+    bounds.extents = glm::abs(axes[0]) * extents.x + glm::abs(axes[1]) * extents.y + glm::abs(axes[2]) * extents.z;
+
+    float scale   = std::max({glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2])});
+    bounds.radius = sphere_radius * scale;
+
+    return bounds;
+}
+
+void BoundsSoA::resize(size_t count)
+{
+    center_x.resize(count);
+    center_y.resize(count);
+    center_z.resize(count);
+    extent_x.resize(count);
+    extent_y.resize(count);
+    extent_z.resize(count);
+    radius.resize(count);
+}
+
+CullKernel best_cull_kernel()
+{
+    static const CullKernel kernel = []()
+    {
+#if GPBR_CULL_X86
+#if defined(_MSC_VER)
+        // AVX2 needs the CPU feature, and the OS saving the YMM registers
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] >= 7)
+        {
+            __cpuid(info, 1);
+            bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+
+            __cpuidex(info, 7, 0);
+            if (os_saves_ymm && (info[1] & (1 << 5)) != 0)
+            {
+                return CullKernel::AVX2;
+            }
+        }
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return CullKernel::AVX2;
+        }
+#endif
+        // SSE2 is part of x86-64
+        return CullKernel::SSE;
+#else
+        return CullKernel::Scalar;
+#endif
+    }();
+
+    return kernel;
+}
+
+const char* cull_kernel_name(CullKernel kernel)
+{
+    switch (kernel)
+    {
+    case CullKernel::SSE:
+        return "sse";
+    case CullKernel::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+static void cull_bounds_scalar(
+    const BoundsSoA& bounds, const FrustumPlanes& planes, uint32_t begin, uint32_t end, uint8_t* visible)
+{
+    for (uint32_t i = begin; i < end; i++)
+    {
+        float cx = bounds.center_x[i];
+        float cy = bounds.center_y[i];
+        float cz = bounds.center_z[i];
+        float ex = bounds.extent_x[i];
+        float ey = bounds.extent_y[i];
+        float ez = bounds.extent_z[i];
+        float r  = bounds.radius[i];
+
+        bool inside = true;
+
+        for (const glm::vec4& plane : planes)
+        {
+            float distance = ((plane.x * cx + plane.y * cy) + plane.z * cz) + plane.w;
+            float reach    = std::min((std::abs(plane.x) * ex + std::abs(plane.y) * ey) + std::abs(plane.z) * ez, r);
+
+            inside = inside && distance >= -reach;
+        }
+
+        visible[i] = inside ? 1 : 0;
+    }
+}
+
+#if GPBR_CULL_X86
+static uint32_t cull_bounds_sse(
+    const BoundsSoA& bounds, const FrustumPlanes& planes, uint32_t begin, uint32_t end, uint8_t* visible)
+{
+    // the planes broadcast to every lane once
+    __m128 normal_x[6], normal_y[6], normal_z[6], offset[6], abs_x[6], abs_y[6], abs_z[6];
+    for (int p = 0; p < 6; p++)
+    {
+        normal_x[p] = _mm_set1_ps(planes[p].x);
+        normal_y[p] = _mm_set1_ps(planes[p].y);
+        normal_z[p] = _mm_set1_ps(planes[p].z);
+        offset[p]   = _mm_set1_ps(planes[p].w);
+        abs_x[p]    = _mm_set1_ps(std::abs(planes[p].x));
+        abs_y[p]    = _mm_set1_ps(std::abs(planes[p].y));
+        abs_z[p]    = _mm_set1_ps(std::abs(planes[p].z));
+    }
+
+    const __m128 sign = _mm_set1_ps(-0.f);
+
+    uint32_t i = begin;
+    for (; i + 4 <= end; i += 4)
+    {
+        __m128 cx = _mm_loadu_ps(&bounds.center_x[i]);
+        __m128 cy = _mm_loadu_ps(&bounds.center_y[i]);
+        __m128 cz = _mm_loadu_ps(&bounds.center_z[i]);
+        __m128 ex = _mm_loadu_ps(&bounds.extent_x[i]);
+        __m128 ey = _mm_loadu_ps(&bounds.extent_y[i]);
+        __m128 ez = _mm_loadu_ps(&bounds.extent_z[i]);
+        __m128 r  = _mm_loadu_ps(&bounds.radius[i]);
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+
+        for (int p = 0; p < 6; p++)
+        {
+            __m128 distance = _mm_add_ps(
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal_x[p], cx), _mm_mul_ps(normal_y[p], cy)),
+                           _mm_mul_ps(normal_z[p], cz)),
+                offset[p]);
+            __m128 reach = _mm_min_ps(
+                _mm_add_ps(_mm_add_ps(_mm_mul_ps(abs_x[p], ex), _mm_mul_ps(abs_y[p], ey)), _mm_mul_ps(abs_z[p], ez)),
+                r);
+
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_xor_ps(reach, sign)));
+        }
+
+        int mask = _mm_movemask_ps(inside);
+        for (int lane = 0; lane < 4; lane++)
+        {
+            visible[i + lane] = (uint8_t)((mask >> lane) & 1);
+        }
+    }
+
+    return i;
+}
+#endif
+
+void cull_bounds(const BoundsSoA& bounds,
+                 const FrustumPlanes& planes,
+                 uint32_t begin,
+                 uint32_t end,
+                 uint8_t* visible,
+                 CullKernel kernel)
+{
+    // the wide kernels leave the objects which do not fill a whole register to the scalar one
+#if GPBR_CULL_X86
+    if (kernel == CullKernel::AVX2)
+    {
+        const float* components[] = {bounds.center_x.data(),
+                                     bounds.center_y.data(),
+                                     bounds.center_z.data(),
+                                     bounds.extent_x.data(),
+                                     bounds.extent_y.data(),
+                                     bounds.extent_z.data(),
+                                     bounds.radius.data()};
+
+        begin = cull_bounds_avx2(components, &planes[0].x, begin, end, visible);
+    }
+    else if (kernel == CullKernel::SSE)
+    {
+        begin = cull_bounds_sse(bounds, planes, begin, end, visible);
+    }
+#endif
+
+    cull_bounds_scalar(bounds, planes, begin, end, visible);
+}
@@ -0,0 +1,65 @@
+// The AVX2 culling kernel. This file is compiled with AVX2 enabled and only called once the CPU is known to support
+// it, so it must not define anything the rest of the program could end up sharing, such as inline functions of
+// headers; it works on plain arrays instead. See frustum_culling.cpp for the test it performs.
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+
+uint32_t cull_bounds_avx2(
+    const float* const* components, const float* planes, uint32_t begin, uint32_t end, uint8_t* visible)
+{
+    // the planes broadcast to every lane once
+    __m256 normal_x[6], normal_y[6], normal_z[6], offset[6], abs_x[6], abs_y[6], abs_z[6];
+
+    const __m256 sign = _mm256_set1_ps(-0.f);
+
+    for (int p = 0; p < 6; p++)
+    {
+        normal_x[p] = _mm256_set1_ps(planes[p * 4 + 0]);
+        normal_y[p] = _mm256_set1_ps(planes[p * 4 + 1]);
+        normal_z[p] = _mm256_set1_ps(planes[p * 4 + 2]);
+        offset[p]   = _mm256_set1_ps(planes[p * 4 + 3]);
+        abs_x[p]    = _mm256_andnot_ps(sign, normal_x[p]);
+        abs_y[p]    = _mm256_andnot_ps(sign, normal_y[p]);
+        abs_z[p]    = _mm256_andnot_ps(sign, normal_z[p]);
+    }
+
+    uint32_t i = begin;
+    for (; i + 8 <= end; i += 8)
+    {
+        __m256 cx = _mm256_loadu_ps(components[0] + i);
+        __m256 cy = _mm256_loadu_ps(components[1] + i);
+        __m256 cz = _mm256_loadu_ps(components[2] + i);
+        __m256 ex = _mm256_loadu_ps(components[3] + i);
+        __m256 ey = _mm256_loadu_ps(components[4] + i);
+        __m256 ez = _mm256_loadu_ps(components[5] + i);
+        __m256 r  = _mm256_loadu_ps(components[6] + i);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+
+        // separate multiplies and adds, not FMA, so the results match the other kernels exactly
+        for (int p = 0; p < 6; p++)
+        {
+            __m256 distance = _mm256_add_ps(
+                _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(normal_x[p], cx), _mm256_mul_ps(normal_y[p], cy)),
+                              _mm256_mul_ps(normal_z[p], cz)),
+                offset[p]);
+            __m256 reach = _mm256_min_ps(
+                _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(abs_x[p], ex), _mm256_mul_ps(abs_y[p], ey)),
+                              _mm256_mul_ps(abs_z[p], ez)),
+                r);
+
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_xor_ps(reach, sign), _CMP_GE_OQ));
+        }
+
+        int mask = _mm256_movemask_ps(inside);
+        for (int lane = 0; lane < 8; lane++)
+        {
+            visible[i + lane] = (uint8_t)((mask >> lane) & 1);
+        }
+    }
+
+    return i;
+}
+#endif
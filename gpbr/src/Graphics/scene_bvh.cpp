@@ -0,0 +1,464 @@
+#include "gpbr/Graphics/scene_bvh.h"
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+static constexpr uint32_t BVH_BIN_COUNT = 12; // Candidate split planes per axis are the boundaries between bins.
+static constexpr uint32_t BVH_LEAF_SIZE = 4;  // Larger nodes are always split.
+
+static float surface_area(const glm::vec3& min, const glm::vec3& max)
+{
+    glm::vec3 d = max - min;
+    return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+// Returns true if the ray enters the box within max_distance, and the distance at which it does in distance.
+static bool ray_box(const glm::vec3& origin,
+                    const glm::vec3& inverse_direction,
+                    const glm::vec3& min,
+                    const glm::vec3& max,
+                    float max_distance,
+                    float& distance)
+{
+    float enter = 0.f;
+    float exit  = max_distance;
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        // a ray parallel to the slab is within it everywhere or nowhere. The slab test would compute 0 * inf = NaN
+        // for an origin on one of its planes
+        if (std::isinf(inverse_direction[axis]))
+        {
+            if (origin[axis] < min[axis] || origin[axis] > max[axis])
+            {
+                return false;
+            }
+            continue;
+        }
+
+        float t0 = (min[axis] - origin[axis]) * inverse_direction[axis];
+        float t1 = (max[axis] - origin[axis]) * inverse_direction[axis];
+
+        enter = std::max(enter, std::min(t0, t1));
+        exit  = std::min(exit, std::max(t0, t1));
+    }
+
+    distance = enter;
+    return enter <= exit;
+}
+
+void SceneBVH::clear()
+{
+    _nodes.clear();
+    _items.clear();
+    _item_leaves.clear();
+    _item_min.clear();
+    _item_max.clear();
+}
+
+void SceneBVH::fit_items(Node& node) const
+{
+    node.min = glm::vec3(std::numeric_limits<float>::max());
+    node.max = glm::vec3(-std::numeric_limits<float>::max());
+
+    for (uint32_t i = node.first_item; i < node.first_item + node.item_count; i++)
+    {
+        node.min = glm::min(node.min, _item_min[_items[i]]);
+        node.max = glm::max(node.max, _item_max[_items[i]]);
+    }
+}
+
+void SceneBVH::mark_leaf(uint32_t index)
+{
+    const Node& node = _nodes[index];
+    for (uint32_t i = node.first_item; i < node.first_item + node.item_count; i++)
+    {
+        _item_leaves[_items[i]] = index;
+    }
+}
+
+void SceneBVH::build(std::span<const WorldBounds> bounds)
+{
+    clear();
+
+    uint32_t total = (uint32_t)bounds.size();
+    if (total == 0)
+    {
+        return;
+    }
+
+    /* 1 Item boxes */
+
+    std::vector<glm::vec3> centroids(total);
+    _item_min.resize(total);
+    _item_max.resize(total);
+    _items.resize(total);
+    _item_leaves.resize(total);
+    std::iota(_items.begin(), _items.end(), 0u);
+
+    for (uint32_t i = 0; i < total; i++)
+    {
+        _item_min[i] = bounds[i].center - bounds[i].extents;
+        _item_max[i] = bounds[i].center + bounds[i].extents;
+        centroids[i] = bounds[i].center;
+    }
+
+    /* 2 Split nodes top-down until splitting no longer pays off */
+
+    _nodes.reserve(2 * total);
+    _nodes.push_back({});
+    _nodes[0].item_count = total;
+    fit_items(_nodes[0]);
+
+    // nodes still to be split; an explicit stack, as a poorly balanced tree may be deep
+    std::vector<uint32_t> stack = {0};
+
+    while (!stack.empty())
+    {
+        uint32_t index = stack.back();
+        stack.pop_back();
+
+        uint32_t first = _nodes[index].first_item;
+        uint32_t count = _nodes[index].item_count;
+
+        if (count <= 1)
+        {
+            mark_leaf(index);
+            continue;
+        }
+
+        // bin the centroids along each axis, and find the split plane with the lowest SAH cost
+        glm::vec3 centroid_min = centroids[_items[first]];
+        glm::vec3 centroid_max = centroid_min;
+        for (uint32_t i = first; i < first + count; i++)
+        {
+            centroid_min = glm::min(centroid_min, centroids[_items[i]]);
+            centroid_max = glm::max(centroid_max, centroids[_items[i]]);
+        }
+
+        float best_cost = std::numeric_limits<float>::max();
+        int best_axis   = -1;
+        uint32_t best_bin{0}; // Last bin on the left.
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float extent = centroid_max[axis] - centroid_min[axis];
+            if (extent <= 0.f)
+            {
+                continue;
+            }
+
+            struct Bin
+            {
+                glm::vec3 min{std::numeric_limits<float>::max()};
+                glm::vec3 max{-std::numeric_limits<float>::max()};
+                uint32_t count{0};
+            };
+            Bin bins[BVH_BIN_COUNT];
+
+            float scale = BVH_BIN_COUNT / extent;
+            for (uint32_t i = first; i < first + count; i++)
+            {
+                uint32_t item = _items[i];
+                uint32_t bin  = std::min((uint32_t)((centroids[item][axis] - centroid_min[axis]) * scale),
+                                        BVH_BIN_COUNT - 1);
+
+                bins[bin].min = glm::min(bins[bin].min, _item_min[item]);
+                bins[bin].max = glm::max(bins[bin].max, _item_max[item]);
+                bins[bin].count++;
+            }
+
+            // sweep from the left, then from the right, accumulating the boxes on each side of every plane
+            float left_area[BVH_BIN_COUNT - 1];
+            uint32_t left_count[BVH_BIN_COUNT - 1];
+
+            Bin left;
+            for (uint32_t b = 0; b < BVH_BIN_COUNT - 1; b++)
+            {
+                left.min = glm::min(left.min, bins[b].min);
+                left.max = glm::max(left.max, bins[b].max);
+                left.count += bins[b].count;
+
+                left_area[b]  = left.count > 0 ? surface_area(left.min, left.max) : 0.f;
+                left_count[b] = left.count;
+            }
+
+            Bin right;
+            for (uint32_t b = BVH_BIN_COUNT - 1; b > 0; b--)
+            {
+                right.min = glm::min(right.min, bins[b].min);
+                right.max = glm::max(right.max, bins[b].max);
+                right.count += bins[b].count;
+
+                if (left_count[b - 1] == 0 || right.count == 0)
+                {
+                    continue;
+                }
+
+                float cost = left_count[b - 1] * left_area[b - 1] + right.count * surface_area(right.min, right.max);
+                if (cost < best_cost)
+                {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin  = b - 1;
+                }
+            }
+        }
+
+        float leaf_cost = count * surface_area(_nodes[index].min, _nodes[index].max);
+        if (count <= BVH_LEAF_SIZE && (best_axis < 0 || best_cost >= leaf_cost))
+        {
+            mark_leaf(index);
+            continue;
+        }
+
+        // partition the items; if their centroids all coincide, any split is as good as another, so halve them
+        uint32_t middle = first + count / 2;
+
+        if (best_axis >= 0)
+        {
+            float scale = BVH_BIN_COUNT / (centroid_max[best_axis] - centroid_min[best_axis]);
+            auto split  = std::partition(_items.begin() + first,
+                                        _items.begin() + first + count,
+                                        [&](uint32_t item)
+                                        {
+                                            uint32_t bin = std::min(
+                                                (uint32_t)((centroids[item][best_axis] - centroid_min[best_axis]) *
+                                                           scale),
+                                                BVH_BIN_COUNT - 1);
+                                            return bin <= best_bin;
+                                        });
+            middle = (uint32_t)(split - _items.begin());
+        }
+        if (middle == first || middle == first + count)
+        {
+            middle = first + count / 2;
+        }
+
+        uint32_t left = (uint32_t)_nodes.size();
+        _nodes.push_back({});
+        _nodes.push_back({});
+
+        _nodes[left].first_item     = first;
+        _nodes[left].item_count     = middle - first;
+        _nodes[left].parent         = index;
+        _nodes[left + 1].first_item = middle;
+        _nodes[left + 1].item_count = first + count - middle;
+        _nodes[left + 1].parent     = index;
+        fit_items(_nodes[left]);
+        fit_items(_nodes[left + 1]);
+
+        _nodes[index].left_child = left;
+
+        stack.push_back(left);
+        stack.push_back(left + 1);
+    }
+}
+
+void SceneBVH::refit(std::span<const WorldBounds> bounds)
+{
+    for (uint32_t i = 0; i < item_count(); i++)
+    {
+        _item_min[i] = bounds[i].center - bounds[i].extents;
+        _item_max[i] = bounds[i].center + bounds[i].extents;
+    }
+
+    // children come after their parent, so a backwards pass sees every child before its parent
+    for (size_t i = _nodes.size(); i-- > 0;)
+    {
+        Node& node = _nodes[i];
+
+        if (node.left_child == 0)
+        {
+            fit_items(node);
+        }
+        else
+        {
+            const Node& left  = _nodes[node.left_child];
+            const Node& right = _nodes[node.left_child + 1];
+
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+}
+
+void SceneBVH::refit(std::span<const uint32_t> items, std::span<const WorldBounds> bounds)
+{
+    for (size_t k = 0; k < items.size(); k++)
+    {
+        _item_min[items[k]] = bounds[k].center - bounds[k].extents;
+        _item_max[items[k]] = bounds[k].center + bounds[k].extents;
+    }
+
+    // from each item's leaf up to the root; nodes shared by several items are refit more than once
+    for (uint32_t item : items)
+    {
+        uint32_t index = _item_leaves[item];
+        fit_items(_nodes[index]);
+
+        while (index != 0)
+        {
+            index = _nodes[index].parent;
+
+            Node& node        = _nodes[index];
+            const Node& left  = _nodes[node.left_child];
+            const Node& right = _nodes[node.left_child + 1];
+
+            node.min = glm::min(left.min, right.min);
+            node.max = glm::max(left.max, right.max);
+        }
+    }
+}
+
+void SceneBVH::query_frustum(const FrustumPlanes& planes, std::vector<uint32_t>& items) const
+{
+    if (_nodes.empty())
+    {
+        return;
+    }
+
+    std::vector<uint32_t> stack = {0};
+
+    while (!stack.empty())
+    {
+        const Node& node = _nodes[stack.back()];
+        stack.pop_back();
+
+        glm::vec3 center = (node.min + node.max) * 0.5f;
+        glm::vec3 half   = (node.max - node.min) * 0.5f;
+
+        bool outside = false;
+        bool inside  = true;
+
+        for (const glm::vec4& plane : planes)
+        {
+            float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+            float reach    = glm::dot(glm::abs(glm::vec3(plane)), half);
+
+            if (distance < -reach)
+            {
+                outside = true;
+                break;
+            }
+            inside = inside && distance >= reach;
+        }
+
+        if (outside)
+        {
+            continue;
+        }
+
+        // a node inside every plane contributes its whole subtree without further tests
+        if (inside || node.left_child == 0)
+        {
+            items.insert(items.end(),
+                         _items.begin() + node.first_item,
+                         _items.begin() + node.first_item + node.item_count);
+        }
+        else
+        {
+            stack.push_back(node.left_child);
+            stack.push_back(node.left_child + 1);
+        }
+    }
+}
+
+void SceneBVH::query_box(const glm::vec3& min, const glm::vec3& max, std::vector<uint32_t>& items) const
+{
+    if (_nodes.empty())
+    {
+        return;
+    }
+
+    auto overlaps = [&](const glm::vec3& box_min, const glm::vec3& box_max)
+    { return glm::all(glm::lessThanEqual(box_min, max)) && glm::all(glm::greaterThanEqual(box_max, min)); };
+
+    std::vector<uint32_t> stack = {0};
+
+    while (!stack.empty())
+    {
+        const Node& node = _nodes[stack.back()];
+        stack.pop_back();
+
+        if (!overlaps(node.min, node.max))
+        {
+            continue;
+        }
+
+        bool contained = glm::all(glm::greaterThanEqual(node.min, min)) && glm::all(glm::lessThanEqual(node.max, max));
+
+        if (contained)
+        {
+            items.insert(items.end(),
+                         _items.begin() + node.first_item,
+                         _items.begin() + node.first_item + node.item_count);
+        }
+        else if (node.left_child == 0)
+        {
+            for (uint32_t i = node.first_item; i < node.first_item + node.item_count; i++)
+            {
+                if (overlaps(_item_min[_items[i]], _item_max[_items[i]]))
+                {
+                    items.push_back(_items[i]);
+                }
+            }
+        }
+        else
+        {
+            stack.push_back(node.left_child);
+            stack.push_back(node.left_child + 1);
+        }
+    }
+}
+
+void SceneBVH::query_ray(const glm::vec3& origin,
+                         const glm::vec3& direction,
+                         float max_distance,
+                         std::vector<BvhRayHit>& hits) const
+{
+    if (_nodes.empty())
+    {
+        return;
+    }
+
+    // a zero component divides to infinity, which marks the axis as parallel for ray_box
+    glm::vec3 inverse_direction = 1.f / direction;
+    size_t first_hit            = hits.size();
+
+    std::vector<uint32_t> stack = {0};
+
+    while (!stack.empty())
+    {
+        const Node& node = _nodes[stack.back()];
+        stack.pop_back();
+
+        float distance;
+        if (!ray_box(origin, inverse_direction, node.min, node.max, max_distance, distance))
+        {
+            continue;
+        }
+
+        if (node.left_child != 0)
+        {
+            stack.push_back(node.left_child);
+            stack.push_back(node.left_child + 1);
+            continue;
+        }
+
+        for (uint32_t i = node.first_item; i < node.first_item + node.item_count; i++)
+        {
+            uint32_t item = _items[i];
+            if (ray_box(origin, inverse_direction, _item_min[item], _item_max[item], max_distance, distance))
+            {
+                hits.push_back({item, distance});
+            }
+        }
+    }
+
+    std::sort(hits.begin() + first_hit,
+              hits.end(),
+              [](const BvhRayHit& A, const BvhRayHit& B) { return A.distance < B.distance; });
+}
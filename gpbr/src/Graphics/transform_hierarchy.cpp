@@ -0,0 +1,164 @@
+#include "gpbr/Graphics/transform_hierarchy.h"
+#include <algorithm>
+#include <atomic>
+
+// Source of world versions, shared by every hierarchy.
+static std::atomic<uint64_t> next_world_version{1};
+
+std::vector<uint32_t> TransformHierarchy::build(std::span<const glm::mat4> locals, std::span<const uint32_t> parents)
+{
+    uint32_t count = (uint32_t)locals.size();
+
+    /* 1 Children of each node, in the given order */
+
+    std::vector<uint32_t> child_starts(count + 1, 0);
+    for (uint32_t parent : parents)
+    {
+        if (parent != NO_PARENT)
+        {
+            child_starts[parent + 1]++;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        child_starts[i + 1] += child_starts[i];
+    }
+
+    std::vector<uint32_t> children(child_starts[count]);
+    std::vector<uint32_t> filled(child_starts.begin(), child_starts.end() - 1);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (parents[i] != NO_PARENT)
+        {
+            children[filled[parents[i]]++] = i;
+        }
+    }
+
+    /* 2 Number the nodes depth first, from the roots in the given order */
+
+    std::vector<uint32_t> indices(count, NO_PARENT);
+    std::vector<uint32_t> stack;
+
+    _locals.resize(count);
+    _worlds.resize(count);
+    _world_versions.resize(count);
+    _parents.resize(count);
+    _subtree_ends.resize(count);
+
+    uint32_t next = 0;
+    for (uint32_t root = count; root-- > 0;)
+    {
+        if (parents[root] == NO_PARENT)
+        {
+            stack.push_back(root);
+        }
+    }
+
+    while (!stack.empty())
+    {
+        uint32_t node = stack.back();
+        stack.pop_back();
+
+        uint32_t index = next++;
+        indices[node]  = index;
+
+        _locals[index]  = locals[node];
+        _parents[index] = (parents[node] == NO_PARENT) ? NO_PARENT : indices[parents[node]];
+
+        // pushed in reverse, so the first child is numbered first
+        for (uint32_t c = child_starts[node + 1]; c-- > child_starts[node];)
+        {
+            stack.push_back(children[c]);
+        }
+    }
+
+    /* 3 Subtree ranges, each child extending its parent's */
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        _subtree_ends[i] = i + 1;
+    }
+    for (uint32_t i = count; i-- > 0;)
+    {
+        if (_parents[i] != NO_PARENT)
+        {
+            _subtree_ends[_parents[i]] = std::max(_subtree_ends[_parents[i]], _subtree_ends[i]);
+        }
+    }
+
+    /* 4 World transforms, the roots' subtrees covering everything */
+
+    _dirty_nodes.clear();
+    _dirty.assign(count, 0);
+
+    for (uint32_t root = 0; root < count; root = _subtree_ends[root])
+    {
+        update_subtree(root);
+    }
+
+    return indices;
+}
+
+void TransformHierarchy::clear()
+{
+    _locals.clear();
+    _worlds.clear();
+    _world_versions.clear();
+    _parents.clear();
+    _subtree_ends.clear();
+    _dirty_nodes.clear();
+    _dirty.clear();
+}
+
+void TransformHierarchy::set_local(uint32_t node, const glm::mat4& local)
+{
+    _locals[node] = local;
+
+    if (!_dirty[node])
+    {
+        _dirty[node] = 1;
+        _dirty_nodes.push_back(node);
+    }
+}
+
+bool TransformHierarchy::update(std::vector<TransformRange>& updated)
+{
+    if (_dirty_nodes.empty())
+    {
+        return false;
+    }
+
+    // in hierarchy order, a dirty node inside the subtree of another one is covered by it
+    std::sort(_dirty_nodes.begin(), _dirty_nodes.end());
+
+    uint32_t updated_end = 0;
+    for (uint32_t node : _dirty_nodes)
+    {
+        _dirty[node] = 0;
+
+        if (node < updated_end)
+        {
+            continue;
+        }
+
+        update_subtree(node);
+        updated_end = _subtree_ends[node];
+
+        updated.push_back({node, updated_end});
+    }
+    _dirty_nodes.clear();
+
+    return true;
+}
+
+void TransformHierarchy::update_subtree(uint32_t node)
+{
+    uint32_t end     = _subtree_ends[node];
+    uint64_t version = next_world_version.fetch_add(end - node, std::memory_order_relaxed);
+
+    for (uint32_t i = node; i < end; i++)
+    {
+        _worlds[i]         = (_parents[i] == NO_PARENT) ? _locals[i] : _worlds[_parents[i]] * _locals[i];
+        _world_versions[i] = version++;
+    }
+}
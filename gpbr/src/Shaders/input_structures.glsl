@@ -19,7 +19,7 @@ layout(set = 0, binding = 1) uniform LightData {
 
 #ifdef USE_BINDLESS
 
-layout(set = 0, binding = 2) uniform sampler2D allTextures[];
+layout(set = 2, binding = 0) uniform sampler2D allTextures[];
 #else
 layout(set = 1, binding = 1) uniform sampler2D colorTex;
 layout(set = 1, binding = 2) uniform sampler2D metalRoughTex;
@@ -23,28 +23,44 @@ layout(buffer_reference, std430) readonly buffer VertexBuffer{
 	Vertex vertices[];
 };
 
+struct DrawData {
+	mat4 world_matrix;
+};
+
+layout(buffer_reference, std430) readonly buffer DrawDataBuffer{
+	DrawData draws[];
+};
+
 //push constants block
 layout( push_constant ) uniform constants
 {
-	mat4 render_matrix;
+	mat4 render_matrix; // direct draws only
 	VertexBuffer vertex_buffer;
+	DrawDataBuffer draw_data; // indirect draws only, indexed by the draw's first instance
+	uint indirect;
 } PushConstants;
 
 void main() 
 {
 	Vertex v = PushConstants.vertex_buffer.vertices[gl_VertexIndex];
 
+	mat4 render_matrix = PushConstants.render_matrix;
+	if (PushConstants.indirect != 0)
+	{
+		render_matrix = PushConstants.draw_data.draws[gl_InstanceIndex].world_matrix;
+	}
+
 	vec4 position = vec4(v.position, 1.0f);
 
-	gl_Position =  sceneData.view_proj * PushConstants.render_matrix * position;
+	gl_Position =  sceneData.view_proj * render_matrix * position;
 
 	mat4 view_mat = sceneData.view;
 
 	// Apply the normal matrix; needed for non-uniform scale
-	outNormal = mat3(transpose(inverse(view_mat * PushConstants.render_matrix))) *  v.normal;
+	outNormal = mat3(transpose(inverse(view_mat * render_matrix))) *  v.normal;
 	
 	// View space 
-	outPosition = (view_mat * PushConstants.render_matrix * position).xyz;
+	outPosition = (view_mat * render_matrix * position).xyz;
 	outLightPos = (view_mat * vec4(lightData.position,1.0)).xyz;
 	outCameraPos = (view_mat * vec4(sceneData.camera_pos, 1.0)).xyz;
 
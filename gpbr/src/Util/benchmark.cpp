@@ -0,0 +1,313 @@
+#include "gpbr/Util/benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <numeric>
+#include <sstream>
+
+#include <fmt/core.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+CameraPath CameraPath::orbit(glm::vec3 center, float radius, float height, float duration, int steps)
+{
+    CameraPath path;
+
+    for (int i = 0; i <= steps; i++)
+    {
+        float t     = (float)i / (float)steps;
+        float angle = t * glm::two_pi<float>();
+
+        CameraKeyframe key;
+        key.time     = t * duration;
+        key.position = center + glm::vec3(glm::sin(angle) * radius, height, glm::cos(angle) * radius);
+
+        // the camera looks down -Z; yaw rotates about -Y and pitch about +X
+        glm::vec3 dir = glm::normalize(center - key.position);
+        key.yaw       = glm::atan(dir.x, -dir.z);
+        key.pitch     = glm::asin(dir.y);
+
+        path.add_keyframe(key);
+    }
+
+    // unwrap yaw so interpolation never takes the long way around
+    for (size_t i = 1; i < path.keyframes.size(); i++)
+    {
+        float delta = path.keyframes[i].yaw - path.keyframes[i - 1].yaw;
+        if (delta > glm::pi<float>())
+        {
+            path.keyframes[i].yaw -= glm::two_pi<float>();
+        }
+        else if (delta < -glm::pi<float>())
+        {
+            path.keyframes[i].yaw += glm::two_pi<float>();
+        }
+    }
+
+    return path;
+}
+
+bool CameraPath::load(const std::string& file_path)
+{
+    std::ifstream file(file_path);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    keyframes.clear();
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+
+        std::istringstream stream(line);
+        CameraKeyframe key;
+        if (stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.pitch >> key.yaw)
+        {
+            keyframes.push_back(key);
+        }
+    }
+
+    return !keyframes.empty();
+}
+
+bool CameraPath::save(const std::string& file_path) const
+{
+    std::ofstream file(file_path);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file << "# time x y z pitch yaw\n";
+    for (const CameraKeyframe& key : keyframes)
+    {
+        file << fmt::format("{} {} {} {} {} {}\n",
+                            key.time,
+                            key.position.x,
+                            key.position.y,
+                            key.position.z,
+                            key.pitch,
+                            key.yaw);
+    }
+
+    return true;
+}
+
+CameraKeyframe CameraPath::sample(float time) const
+{
+    if (keyframes.empty())
+    {
+        return CameraKeyframe{0.f, glm::vec3(0.f), 0.f, 0.f};
+    }
+    if (keyframes.size() == 1 || duration() <= 0.f)
+    {
+        return keyframes.front();
+    }
+
+    time = std::fmod(time, duration());
+
+    // first keyframe at or after the requested time
+    auto next = std::lower_bound(keyframes.begin(),
+                                 keyframes.end(),
+                                 time,
+                                 [](const CameraKeyframe& key, float t) { return key.time < t; });
+
+    if (next == keyframes.begin())
+    {
+        return keyframes.front();
+    }
+    if (next == keyframes.end())
+    {
+        return keyframes.back();
+    }
+
+    const CameraKeyframe& a = *(next - 1);
+    const CameraKeyframe& b = *next;
+
+    float span = b.time - a.time;
+    float t    = span > 0.f ? (time - a.time) / span : 0.f;
+
+    CameraKeyframe result;
+    result.time     = time;
+    result.position = glm::mix(a.position, b.position, t);
+    result.pitch    = glm::mix(a.pitch, b.pitch, t);
+    result.yaw      = glm::mix(a.yaw, b.yaw, t);
+    return result;
+}
+
+MetricSummary summarize(std::vector<float> samples)
+{
+    MetricSummary summary{};
+
+    if (samples.empty())
+    {
+        return summary;
+    }
+
+    std::sort(samples.begin(), samples.end());
+
+    // nearest-rank percentile
+    auto percentile = [&](float p)
+    {
+        size_t rank = (size_t)std::ceil(p / 100.f * samples.size());
+        return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+    };
+
+    summary.mean = (float)(std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size());
+    summary.p50  = percentile(50.f);
+    summary.p95  = percentile(95.f);
+    summary.p99  = percentile(99.f);
+    summary.max  = samples.back();
+    return summary;
+}
+
+void BenchmarkRecorder::set_info(const std::string& key, const std::string& value)
+{
+    for (auto& [k, v] : info)
+    {
+        if (k == key)
+        {
+            v = value;
+            return;
+        }
+    }
+    info.emplace_back(key, value);
+}
+
+void BenchmarkRecorder::record(const std::string& metric, float value)
+{
+    for (auto& [name, samples] : metrics)
+    {
+        if (name == metric)
+        {
+            samples.push_back(value);
+            return;
+        }
+    }
+    metrics.emplace_back(metric, std::vector<float>{value});
+}
+
+void BenchmarkRecorder::keep_history(const std::string& metric)
+{
+    if (std::find(history_metrics.begin(), history_metrics.end(), metric) == history_metrics.end())
+    {
+        history_metrics.push_back(metric);
+    }
+}
+
+// Escapes quotes and backslashes for JSON strings.
+static std::string escape_json(const std::string& str)
+{
+    std::string out;
+    out.reserve(str.size());
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out.push_back('\\');
+        }
+        out.push_back(c);
+    }
+    return out;
+}
+
+bool BenchmarkRecorder::write_json(const std::string& file_path) const
+{
+    std::ofstream file(file_path);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    file << "{\n";
+    for (const auto& [key, value] : info)
+    {
+        file << fmt::format("  \"{}\": \"{}\",\n", escape_json(key), escape_json(value));
+    }
+
+    file << "  \"metrics\": {\n";
+    for (size_t i = 0; i < metrics.size(); i++)
+    {
+        const auto& [name, samples] = metrics[i];
+        MetricSummary s             = summarize(samples);
+
+        file << fmt::format("    \"{}\": {{\"samples\": {}, \"mean\": {:.4f}, \"p50\": {:.4f}, \"p95\": {:.4f}, "
+                            "\"p99\": {:.4f}, \"max\": {:.4f}",
+                            escape_json(name),
+                            samples.size(),
+                            s.mean,
+                            s.p50,
+                            s.p95,
+                            s.p99,
+                            s.max);
+
+        if (std::find(history_metrics.begin(), history_metrics.end(), name) != history_metrics.end())
+        {
+            file << ", \"history\": [";
+            for (size_t j = 0; j < samples.size(); j++)
+            {
+                file << fmt::format("{}{:.4f}", (j == 0) ? "" : ", ", samples[j]);
+            }
+            file << "]";
+        }
+
+        file << "}" << ((i + 1 < metrics.size()) ? "," : "") << "\n";
+    }
+    file << "  }\n";
+    file << "}\n";
+
+    return true;
+}
+
+bool BenchmarkRecorder::write_csv(const std::string& file_path) const
+{
+    std::ofstream file(file_path);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    for (const auto& [key, value] : info)
+    {
+        file << fmt::format("# {}: {}\n", key, value);
+    }
+
+    file << "metric,samples,mean,p50,p95,p99,max\n";
+    for (const auto& [name, samples] : metrics)
+    {
+        MetricSummary s = summarize(samples);
+        file << fmt::format(
+            "{},{},{:.4f},{:.4f},{:.4f},{:.4f},{:.4f}\n", name, samples.size(), s.mean, s.p50, s.p95, s.p99, s.max);
+    }
+
+    return true;
+}
+
+bool BenchmarkRecorder::write(const std::string& file_path) const
+{
+    bool is_csv = file_path.size() >= 4 && file_path.compare(file_path.size() - 4, 4, ".csv") == 0;
+
+    return is_csv ? write_csv(file_path) : write_json(file_path);
+}
+
+void BenchmarkRecorder::print_summary() const
+{
+    fmt::println("{:<24} {:>10} {:>10} {:>10} {:>10} {:>10}", "metric", "mean", "p50", "p95", "p99", "max");
+    for (const auto& [name, samples] : metrics)
+    {
+        MetricSummary s = summarize(samples);
+        fmt::println(
+            "{:<24} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}", name, s.mean, s.p50, s.p95, s.p99, s.max);
+    }
+}
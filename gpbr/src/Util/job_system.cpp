@@ -0,0 +1,269 @@
+#include "gpbr/Util/job_system.h"
+#include "gpbr/Util/profiler.h"
+
+#include <algorithm>
+
+#include <fmt/core.h>
+
+namespace util
+{
+namespace
+{
+    thread_local uint32_t local_thread_index = UINT32_MAX;
+
+    // Nesting depth of jobs on this thread; a job run while another waits is not counted twice.
+    thread_local uint32_t local_job_depth = 0;
+} // namespace
+
+JobSystem::JobSystem(uint32_t worker_count)
+{
+    _queues.reserve(worker_count + 1);
+    for (uint32_t i = 0; i < worker_count + 1; i++)
+    {
+        _queues.push_back(std::make_unique<WorkerQueue>());
+    }
+
+    local_thread_index = 0;
+    _stats_start_ns    = profiler_now_ns();
+
+    _workers.reserve(worker_count);
+    for (uint32_t i = 0; i < worker_count; i++)
+    {
+        _workers.emplace_back(&JobSystem::worker_loop, this, i + 1);
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+        _stopping = true;
+    }
+    _work_available.notify_all();
+
+    for (std::thread& worker : _workers)
+    {
+        worker.join();
+    }
+
+    local_thread_index = UINT32_MAX;
+}
+
+uint32_t JobSystem::current_thread_index()
+{
+    return local_thread_index;
+}
+
+void JobSystem::run(Job job, JobCounter* counter)
+{
+    if (counter != nullptr)
+    {
+        counter->_pending.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // threads outside the system have no deque; spread their jobs over the workers' deques
+    uint32_t queue_index = local_thread_index;
+    if (queue_index == UINT32_MAX)
+    {
+        queue_index = _next_external_queue.fetch_add(1, std::memory_order_relaxed) % thread_count();
+    }
+
+    push(queue_index, std::move(job), counter);
+    wake(1);
+}
+
+void JobSystem::wait(JobCounter& counter)
+{
+    uint32_t thread_index = local_thread_index;
+
+    if (thread_index == UINT32_MAX)
+    {
+        std::unique_lock<std::mutex> lock(_wait_mutex);
+        _counter_done.wait(lock, [&]() { return counter.done(); });
+        return;
+    }
+
+    while (!counter.done())
+    {
+        // the remaining jobs are running on other threads
+        if (!try_run_job(thread_index))
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::parallel_for(uint32_t count, uint32_t batch_size, const RangeJob& job)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    batch_size           = std::max(batch_size, 1u);
+    uint32_t batch_count = (count + batch_size - 1) / batch_size;
+
+    // nothing to share; skip the queues
+    if (batch_count == 1 || _workers.empty())
+    {
+        job(0, count, local_thread_index);
+        return;
+    }
+
+    JobCounter counter;
+    counter._pending.store(batch_count, std::memory_order_relaxed);
+
+    uint32_t queue_index = local_thread_index;
+    if (queue_index == UINT32_MAX)
+    {
+        queue_index = _next_external_queue.fetch_add(1, std::memory_order_relaxed) % thread_count();
+    }
+
+    // queued in reverse so that the owner pops the first batch, while thieves take the last ones
+    for (uint32_t batch = batch_count; batch-- > 0;)
+    {
+        uint32_t begin = batch * batch_size;
+        uint32_t end   = std::min(begin + batch_size, count);
+
+        push(queue_index, [&job, begin, end](uint32_t thread_index) { job(begin, end, thread_index); }, &counter);
+    }
+    wake(batch_count);
+
+    wait(counter);
+}
+
+std::vector<WorkerStats> JobSystem::collect_stats()
+{
+    uint64_t now        = profiler_now_ns();
+    uint64_t elapsed_ns = now - _stats_start_ns;
+    _stats_start_ns     = now;
+
+    std::vector<WorkerStats> stats;
+    stats.reserve(_queues.size());
+
+    for (const std::unique_ptr<WorkerQueue>& queue : _queues)
+    {
+        WorkerStats worker;
+        // a job spanning the previous collection is counted entirely in this one
+        worker.busy_ns     = std::min(queue->busy_ns.exchange(0, std::memory_order_relaxed), elapsed_ns);
+        worker.elapsed_ns  = elapsed_ns;
+        worker.jobs_run    = queue->jobs_run.exchange(0, std::memory_order_relaxed);
+        worker.jobs_stolen = queue->jobs_stolen.exchange(0, std::memory_order_relaxed);
+        stats.push_back(worker);
+    }
+    return stats;
+}
+
+void JobSystem::push(uint32_t queue_index, Job job, JobCounter* counter)
+{
+    WorkerQueue& queue = *_queues[queue_index];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back({std::move(job), counter});
+    }
+    _queued_jobs.fetch_add(1, std::memory_order_release);
+}
+
+void JobSystem::wake(uint32_t job_count)
+{
+    // lock so the notification cannot slip in between a worker's check and its wait
+    {
+        std::lock_guard<std::mutex> lock(_sleep_mutex);
+    }
+
+    if (job_count == 1)
+    {
+        _work_available.notify_one();
+    }
+    else
+    {
+        _work_available.notify_all();
+    }
+}
+
+bool JobSystem::try_run_job(uint32_t thread_index)
+{
+    if (_queued_jobs.load(std::memory_order_acquire) == 0)
+    {
+        return false;
+    }
+
+    uint32_t queue_count = thread_count();
+
+    for (uint32_t offset = 0; offset < queue_count; offset++)
+    {
+        WorkerQueue& queue = *_queues[(thread_index + offset) % queue_count];
+        QueuedJob queued;
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.jobs.empty())
+            {
+                continue;
+            }
+
+            // owners take their newest job, thieves the oldest
+            if (offset == 0)
+            {
+                queued = std::move(queue.jobs.back());
+                queue.jobs.pop_back();
+            }
+            else
+            {
+                queued = std::move(queue.jobs.front());
+                queue.jobs.pop_front();
+            }
+        }
+        _queued_jobs.fetch_sub(1, std::memory_order_relaxed);
+
+        WorkerQueue& own_queue = *_queues[thread_index];
+
+        uint64_t start_ns = (local_job_depth == 0) ? profiler_now_ns() : 0;
+        local_job_depth++;
+
+        queued.job(thread_index);
+
+        local_job_depth--;
+        if (local_job_depth == 0)
+        {
+            own_queue.busy_ns.fetch_add(profiler_now_ns() - start_ns, std::memory_order_relaxed);
+        }
+        own_queue.jobs_run.fetch_add(1, std::memory_order_relaxed);
+        if (offset != 0)
+        {
+            own_queue.jobs_stolen.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // the counter may be destroyed as soon as it reaches zero, so only the system is touched afterwards
+        if (queued.counter != nullptr && queued.counter->_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            std::lock_guard<std::mutex> lock(_wait_mutex);
+            _counter_done.notify_all();
+        }
+        return true;
+    }
+    return false;
+}
+
+void JobSystem::worker_loop(uint32_t thread_index)
+{
+    local_thread_index = thread_index;
+    profiler_set_thread_name(fmt::format("worker {}", thread_index));
+
+    while (true)
+    {
+        if (try_run_job(thread_index))
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(_sleep_mutex);
+        _work_available.wait(lock,
+                             [&]() { return _stopping || _queued_jobs.load(std::memory_order_acquire) != 0; });
+
+        if (_stopping)
+        {
+            return;
+        }
+    }
+}
+} // namespace util
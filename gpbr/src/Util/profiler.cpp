@@ -0,0 +1,207 @@
+#include "gpbr/Util/profiler.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <fmt/core.h>
+
+namespace util
+{
+namespace
+{
+    // Events kept per thread. At a few hundred zones per frame this holds well over 60 frames.
+    constexpr uint64_t RING_CAPACITY = 1 << 15;
+
+    // A ring buffer entry, published with a sequence number so a reader can tell when the owning thread overwrote it
+    // during a copy (a seqlock). The fields are atomics only to make those overlapping accesses well defined; relaxed
+    // loads and stores of them compile to plain moves.
+    struct EventSlot
+    {
+        std::atomic<uint64_t> sequence{0}; // One more than the index of the event held, or 0 while being written.
+        std::atomic<const char*> name{nullptr};
+        std::atomic<uint64_t> start_ns{0};
+        std::atomic<uint64_t> end_ns{0};
+        std::atomic<uint32_t> frame{0};
+    };
+
+    // Ring buffer owned by a single recording thread.
+    struct ThreadBuffer
+    {
+        std::array<EventSlot, RING_CAPACITY> events;
+        std::atomic<uint64_t> head{0}; // Total number of events ever written.
+        uint32_t thread_id{0};
+        std::string name;
+    };
+
+    // Buffers are never freed so that traces can still include threads which have exited.
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+    std::atomic<uint32_t> current_frame{0};
+
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    thread_local ThreadBuffer* local_buffer = nullptr;
+
+    ThreadBuffer& get_local_buffer()
+    {
+        if (local_buffer == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+
+            registry.push_back(std::make_unique<ThreadBuffer>());
+            local_buffer            = registry.back().get();
+            local_buffer->thread_id = (uint32_t)registry.size() - 1;
+            local_buffer->name      = fmt::format("thread {}", local_buffer->thread_id);
+        }
+        return *local_buffer;
+    }
+
+    void record(const char* name, uint64_t start_ns, uint64_t end_ns, uint32_t frame)
+    {
+        ThreadBuffer& buffer = get_local_buffer();
+
+        uint64_t head   = buffer.head.load(std::memory_order_relaxed);
+        EventSlot& slot = buffer.events[head & (RING_CAPACITY - 1)];
+
+        // invalidate the slot before overwriting it, so a reader copying the old event discards its copy
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.start_ns.store(start_ns, std::memory_order_relaxed);
+        slot.end_ns.store(end_ns, std::memory_order_relaxed);
+        slot.frame.store(frame, std::memory_order_relaxed);
+
+        // publish the event to readers
+        slot.sequence.store(head + 1, std::memory_order_release);
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Copies event i of buffer into event. Returns false if the slot does not hold it, because the owning thread
+    // has overwritten it, before or during the copy.
+    bool read_event(const ThreadBuffer& buffer, uint64_t i, ProfileEvent& event)
+    {
+        const EventSlot& slot = buffer.events[i & (RING_CAPACITY - 1)];
+
+        if (slot.sequence.load(std::memory_order_acquire) != i + 1)
+        {
+            return false;
+        }
+
+        event.name     = slot.name.load(std::memory_order_relaxed);
+        event.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+        event.end_ns   = slot.end_ns.load(std::memory_order_relaxed);
+        event.frame    = slot.frame.load(std::memory_order_relaxed);
+
+        // the copy is only whole if the slot still holds the same event after it
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.sequence.load(std::memory_order_relaxed) == i + 1;
+    }
+} // namespace
+
+ProfileZone::ProfileZone(const char* name)
+    : _name(name),
+      _start_ns(profiler_now_ns()),
+      _frame(current_frame.load(std::memory_order_relaxed))
+{
+}
+
+ProfileZone::~ProfileZone()
+{
+    record(_name, _start_ns, profiler_now_ns(), _frame);
+}
+
+void ProfileZone::next(const char* name)
+{
+    uint64_t now = profiler_now_ns();
+    record(_name, _start_ns, now, _frame);
+
+    _name     = name;
+    _start_ns = now;
+    _frame    = current_frame.load(std::memory_order_relaxed);
+}
+
+uint64_t profiler_now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void profiler_begin_frame()
+{
+    current_frame.fetch_add(1, std::memory_order_relaxed);
+}
+
+void profiler_set_thread_name(const std::string& name)
+{
+    ThreadBuffer& buffer = get_local_buffer();
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer.name = name;
+}
+
+bool profiler_write_chrome_trace(const std::string& file_path, uint32_t frame_count)
+{
+    std::ofstream file(file_path);
+
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    uint32_t last_frame  = current_frame.load(std::memory_order_relaxed);
+    uint32_t first_frame = (frame_count != 0 && last_frame >= frame_count) ? last_frame - frame_count + 1 : 0;
+
+    std::lock_guard<std::mutex> lock(registry_mutex);
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+    bool first_event = true;
+    auto separator   = [&]()
+    {
+        const char* sep = first_event ? "" : ",\n";
+        first_event     = false;
+        return sep;
+    };
+
+    for (const std::unique_ptr<ThreadBuffer>& buffer : registry)
+    {
+        file << separator()
+             << fmt::format("{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": {}, "
+                            "\"args\": {{\"name\": \"{}\"}}}}",
+                            buffer->thread_id,
+                            buffer->name);
+
+        uint64_t head  = buffer->head.load(std::memory_order_acquire);
+        uint64_t begin = (head > RING_CAPACITY) ? head - RING_CAPACITY : 0;
+
+        for (uint64_t i = begin; i < head; i++)
+        {
+            ProfileEvent event;
+            if (!read_event(*buffer, i, event) || event.frame < first_frame)
+            {
+                continue;
+            }
+
+            // trace_event timestamps are in microseconds
+            file << separator()
+                 << fmt::format("{{\"name\": \"{}\", \"cat\": \"cpu\", \"ph\": \"X\", \"pid\": 0, \"tid\": {}, "
+                                "\"ts\": {:.3f}, \"dur\": {:.3f}, \"args\": {{\"frame\": {}}}}}",
+                                event.name,
+                                buffer->thread_id,
+                                event.start_ns / 1000.0,
+                                (event.end_ns - event.start_ns) / 1000.0,
+                                event.frame);
+        }
+    }
+
+    file << "\n]}\n";
+
+    return true;
+}
+} // namespace util
@@ -1,22 +1,370 @@
 #include <chrono>
 #include <thread>
+#include <string_view>
+#include <charconv>
+#include <cfloat>
+#include <climits>
+#include <filesystem>
+#include <iterator>
 
 #include "gpbr/Graphics/Vulkan/vk_engine.h"
+#include "gpbr/Graphics/cull_benchmark.h"
 
 using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
 
+// Command line options.
+struct LaunchOptions
+{
+    bool headless{false};
+    int frame_count{1};
+    std::string output_dir{};
+    uint32_t width{1920};
+    uint32_t height{1080};
+    TonemapMode tonemap{TonemapMode::Clamp};
+
+    bool benchmark{false};
+    std::string scene{"MetalRoughSpheres"};
+    BenchmarkSettings benchmark_settings{};
+
+    std::string trace_path{};
+    uint32_t trace_frames{120};
+
+    int record_threads{1};
+    bool thread_sweep{false};
+
+    float dynamic_resolution_ms{0.f}; // 0 disables dynamic resolution.
+    float min_render_scale{0.5f};
+
+    bool async_compute{false};
+    bool indirect_draws{false};
+    bool gpu_culling{false};
+    bool occlusion_culling{false};
+
+    bool cull_benchmark{false};
+};
+
+// Largest --width or --height; every Vulkan implementation supports 2D images at least this large.
+static constexpr int max_headless_extent = 16384;
+
+// Largest --record-threads; the engine clamps it further to the job system's thread count.
+static constexpr int max_record_threads = 256;
+
+// Thread counts measured by --thread-sweep.
+static constexpr int sweep_thread_counts[] = {1, 2, 4, 8, 16};
+
+static void print_usage()
+{
+    fmt::println("Usage: gpbr [options]");
+    fmt::println("  --headless           Render offscreen without a window or swapchain.");
+    fmt::println("  --frames <n>         Number of frames to render in headless mode (default 1).");
+    fmt::println("  --output <dir>       Write headless frames to <dir> as PNG files.");
+    fmt::println("  --width <px>         Headless output width (default 1920).");
+    fmt::println("  --height <px>        Headless output height (default 1080).");
+    fmt::println("  --tonemap <op>       Headless tonemap operator: clamp, reinhard, or aces (default clamp).");
+    fmt::println("  --scene <name>       Scene to load: a name from the scene list or a path to a glTF file.");
+    fmt::println("  --benchmark          Replay a camera path with fixed time steps and write a report.");
+    fmt::println("  --warmup <n>         Benchmark frames rendered before measuring (default 60).");
+    fmt::println("  --measure <n>        Benchmark frames which are measured (default 600).");
+    fmt::println("  --camera-path <file> Camera path recorded with F5. An orbit is used if omitted.");
+    fmt::println("  --report <file>      Benchmark report path; .csv selects CSV output (default benchmark.json).");
+    fmt::println("  --label <text>       Free-form tag stored in the benchmark report.");
+    fmt::println("  --trace <file>       Write a Chrome trace of the last frames on exit. F6 writes trace.json.");
+    fmt::println("  --trace-frames <n>   Frames included in CPU traces; 0 keeps everything retained (default 120).");
+    fmt::println("  --record-threads <n> Threads recording geometry into secondary command buffers (default 1).");
+    fmt::println("  --thread-sweep       Benchmark with 1/2/4/8/16 recording threads; writes one report per count.");
+    fmt::println("  --dynamic-res <ms>   Scale the render resolution to hold the given GPU frame time.");
+    fmt::println("  --min-scale <f>      Lowest render scale used by --dynamic-res, in (0, 1] (default 0.5).");
+    fmt::println("  --async-compute      Render the background on a separate compute queue when one exists.");
+    fmt::println("  --indirect           Draw each material batch with one multi-draw indirect call.");
+    fmt::println("  --gpu-cull           Frustum cull opaque and masked surfaces in a compute pass.");
+    fmt::println("  --occlusion-cull     Also cull them against a depth pyramid, in two passes (implies --gpu-cull).");
+    fmt::println("  --cull-bench         Time CPU frustum culling of synthetic objects, no window; writes --report.");
+}
+
+// Parses all of value as a whole number in [min, max]. Returns false, leaving number unchanged, if it is not one.
+static bool parse_number(std::string_view value, int min, int max, int& number)
+{
+    int parsed = 0;
+
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+    if (error != std::errc{} || end != value.data() + value.size() || parsed < min || parsed > max)
+    {
+        return false;
+    }
+
+    number = parsed;
+    return true;
+}
+
+static bool parse_number(std::string_view value, int min, int max, uint32_t& number)
+{
+    int parsed = 0;
+    if (!parse_number(value, min, max, parsed))
+    {
+        return false;
+    }
+
+    number = (uint32_t)parsed;
+    return true;
+}
+
+// Parses all of value as a number greater than min and at most max. Returns false, leaving number unchanged, if it is
+// not one.
+static bool parse_number(std::string_view value, float min, float max, float& number)
+{
+    float parsed = 0.f;
+
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), parsed);
+    if (error != std::errc{} || end != value.data() + value.size() || !(parsed > min && parsed <= max))
+    {
+        return false;
+    }
+
+    number = parsed;
+    return true;
+}
+
+// Parses the command line. Returns false if the program should exit.
+static bool parse_options(int argc, char* argv[], LaunchOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string_view arg = argv[i];
+
+        // returns the value following the current flag, or nullptr if there is none
+        auto next_value = [&]() -> const char* { return (i + 1 < argc) ? argv[++i] : nullptr; };
+
+        if (arg == "--headless")
+        {
+            options.headless = true;
+        }
+        else if (arg == "--benchmark")
+        {
+            options.benchmark = true;
+        }
+        else if (arg == "--async-compute")
+        {
+            options.async_compute = true;
+        }
+        else if (arg == "--indirect")
+        {
+            options.indirect_draws = true;
+        }
+        else if (arg == "--gpu-cull")
+        {
+            options.gpu_culling = true;
+        }
+        else if (arg == "--occlusion-cull")
+        {
+            options.gpu_culling       = true;
+            options.occlusion_culling = true;
+        }
+        else if (arg == "--cull-bench")
+        {
+            options.cull_benchmark = true;
+        }
+        else if (arg == "--thread-sweep")
+        {
+            options.benchmark    = true;
+            options.thread_sweep = true;
+        }
+        else if (arg == "--frames" || arg == "--output" || arg == "--width" || arg == "--height" ||
+                 arg == "--tonemap" || arg == "--scene" || arg == "--warmup" || arg == "--measure" ||
+                 arg == "--camera-path" || arg == "--report" || arg == "--label" || arg == "--trace" ||
+                 arg == "--trace-frames" || arg == "--record-threads" || arg == "--dynamic-res" ||
+                 arg == "--min-scale")
+        {
+            const char* value = next_value();
+            if (value == nullptr)
+            {
+                fmt::println("Missing value for {}", arg);
+                return false;
+            }
+
+            bool valid = true;
+
+            if (arg == "--frames")
+            {
+                valid = parse_number(value, 1, INT_MAX, options.frame_count);
+            }
+            else if (arg == "--output")
+            {
+                options.output_dir = value;
+            }
+            else if (arg == "--width")
+            {
+                valid = parse_number(value, 1, max_headless_extent, options.width);
+            }
+            else if (arg == "--height")
+            {
+                valid = parse_number(value, 1, max_headless_extent, options.height);
+            }
+            else if (arg == "--scene")
+            {
+                options.scene = value;
+            }
+            else if (arg == "--warmup")
+            {
+                valid = parse_number(value, 0, INT_MAX, options.benchmark_settings.warmup_frames);
+            }
+            else if (arg == "--measure")
+            {
+                valid = parse_number(value, 1, INT_MAX, options.benchmark_settings.measured_frames);
+            }
+            else if (arg == "--camera-path")
+            {
+                options.benchmark_settings.camera_path_file = value;
+            }
+            else if (arg == "--report")
+            {
+                options.benchmark_settings.report_path = value;
+            }
+            else if (arg == "--label")
+            {
+                options.benchmark_settings.label = value;
+            }
+            else if (arg == "--trace")
+            {
+                options.trace_path = value;
+            }
+            else if (arg == "--trace-frames")
+            {
+                valid = parse_number(value, 0, INT_MAX, options.trace_frames);
+            }
+            else if (arg == "--record-threads")
+            {
+                valid = parse_number(value, 1, max_record_threads, options.record_threads);
+            }
+            else if (arg == "--dynamic-res")
+            {
+                valid = parse_number(value, 0.f, FLT_MAX, options.dynamic_resolution_ms);
+            }
+            else if (arg == "--min-scale")
+            {
+                valid = parse_number(value, 0.f, 1.f, options.min_render_scale);
+            }
+            else if (std::string_view(value) == "clamp")
+            {
+                options.tonemap = TonemapMode::Clamp;
+            }
+            else if (std::string_view(value) == "reinhard")
+            {
+                options.tonemap = TonemapMode::Reinhard;
+            }
+            else if (std::string_view(value) == "aces")
+            {
+                options.tonemap = TonemapMode::ACES;
+            }
+            else
+            {
+                valid = false;
+            }
+
+            if (!valid)
+            {
+                fmt::println("Invalid value for {}: {}", arg, value);
+                print_usage();
+                return false;
+            }
+        }
+        else
+        {
+            print_usage();
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int main(int argc, char* argv[])
 {
+    LaunchOptions options;
+    if (!parse_options(argc, argv, options))
+    {
+        return 1;
+    }
+
+    if (options.cull_benchmark)
+    {
+        return run_cull_benchmark(options.benchmark_settings.report_path) ? 0 : 1;
+    }
+
     VulkanEngine engine;
 
+    engine._scene_name               = options.scene;
+    options.benchmark_settings.scene = options.scene;
+    engine._trace_frame_count        = options.trace_frames;
+    engine._record_threads           = options.record_threads;
+    engine._async_compute            = options.async_compute;
+    engine._indirect_draws           = options.indirect_draws;
+    engine._gpu_culling              = options.gpu_culling;
+    engine._occlusion_culling        = options.occlusion_culling;
+
+    if (options.dynamic_resolution_ms > 0.f)
+    {
+        engine._dynamic_resolution_enabled            = true;
+        engine._dynamic_resolution.settings.target_ms = options.dynamic_resolution_ms;
+        engine._dynamic_resolution.settings.min_scale = options.min_render_scale;
+    }
+
+    // the sweep oversubscribes machines with fewer cores, which is part of what it measures
+    if (options.thread_sweep)
+    {
+        engine._worker_count = sweep_thread_counts[std::size(sweep_thread_counts) - 1] - 1;
+    }
+
+    if (options.headless)
+    {
+        engine._headless            = true;
+        engine._window_extent       = VkExtent2D{options.width, options.height};
+        engine._headless_output_dir = options.output_dir;
+        engine._tonemap_mode        = options.tonemap;
+    }
+
     engine.init();
 
     TimePoint start_time = std::chrono::high_resolution_clock::now();
 
-    engine.run();
+    if (options.thread_sweep)
+    {
+        std::filesystem::path report = options.benchmark_settings.report_path;
+
+        for (int thread_count : sweep_thread_counts)
+        {
+            std::string file_name =
+                fmt::format("{}_t{}{}", report.stem().string(), thread_count, report.extension().string());
+
+            BenchmarkSettings settings = options.benchmark_settings;
+            settings.report_path       = (report.parent_path() / file_name).string();
+
+            fmt::println("Benchmarking with {} recording threads", thread_count);
+
+            engine._record_threads = thread_count;
+            engine.run_benchmark(settings);
+        }
+    }
+    else if (options.benchmark)
+    {
+        engine.run_benchmark(options.benchmark_settings);
+    }
+    else if (options.headless)
+    {
+        engine.run_headless(options.frame_count);
+    }
+    else
+    {
+        engine.run();
+    }
 
     TimePoint end_time = std::chrono::high_resolution_clock::now();
 
+    if (!options.trace_path.empty())
+    {
+        engine._trace_path = options.trace_path;
+        engine.write_trace();
+    }
+
     engine.cleanup();
 
     std::chrono::duration<double, std::milli> elapsed_time = end_time - start_time;
@@ -24,4 +372,4 @@ int main(int argc, char* argv[])
     fmt::print("Ran for {:.3f}ms", elapsed_time.count());
 
     return 0;
-}
\ No newline at end of file
+}